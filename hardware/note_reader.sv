@@ -1,39 +1,129 @@
-module note_reader(
+/*
+ * Avalon memory-mapped peripheral that reads the guitar controller
+ *
+ * Register map (word addresses):
+ *  0: state       {25 unused bits, KEY[0], GPIO_1[5:0]}, debounced
+ *  1: fifo count  {overflow, 26 unused bits, 5-bit event count}
+ *                 Reading clears overflow
+ *  2: event state {25 unused bits, state after the oldest queued change}
+ *  3: event time  {32-bit cycle count when that change settled}
+ *                 Reading pops the event
+ *  4: now         {32-bit free-running cycle count}
+ *  5: irq control {31 unused bits, FIFO interrupt enable}; reads back too
+ *
+ * Every input must hold a new level for DEBOUNCE_CYCLES before the
+ * debounced state follows it, which hides contact bounce. Each change of the
+ * debounced state is queued with the cycle it settled on, so presses shorter
+ * than software takes to get round to reading them are not lost.
+ *
+ * When enabled, irq is held for as long as the FIFO is not empty, so
+ * software can sleep until there is an event rather than poll for one. It
+ * drops once the last event is popped, or when software disables it.
+ */
+module note_reader #(
+    parameter DEBOUNCE_CYCLES = 16'd50000,  // 1 ms at 50 MHz
+    parameter FIFO_DEPTH_LOG2 = 4
+) (
     input logic clk,
     input logic reset,
     input chipselect,
     input logic [2:0] address,
+    input logic [31:0] writedata,
+    input logic write,
     input logic [3:0] KEY,
     input logic [5:0] GPIO_1,
-    
+
     output [7:0] LEDR,
-    output logic [7:0] readdata,
+    output logic [31:0] readdata,
     input logic read,
-    output logic waitrequest
+    output logic waitrequest,
+    output logic irq
 );
 
+localparam INPUTS = 7;
+localparam FIFO_DEPTH = 1 << FIFO_DEPTH_LOG2;
+
+logic [INPUTS-1:0] sync0, sync1, stable, next_stable;
+logic [15:0] settle[INPUTS-1:0];  // Cycles each input has held a new level
+logic [31:0] cycle_count;
+
+logic [31:0] fifo_time[FIFO_DEPTH-1:0];
+logic [INPUTS-1:0] fifo_state[FIFO_DEPTH-1:0];
+logic [FIFO_DEPTH_LOG2-1:0] head, tail;
+logic [FIFO_DEPTH_LOG2:0] count;
+logic overflow, push, pop;
+logic irq_enable;
+
 assign LEDR = GPIO_1; // Assign GPIO_1 directly to LEDR output
 //assign LEDR[6] = KEY[0]
 
-// Combinational logic to assign readdata based on KEY inputs
+assign waitrequest = 1'b0;
+assign irq = irq_enable && count != 0;
+
+// An input that has held its new level long enough joins the debounced state
 always_comb begin
-    if (read && chipselect) begin
-        readdata = 8'b00000000; // Initialize readdata to all zeros
-        // Loop through each key
-        for (int i = 0; i < 6; i = i + 1) begin
-            // If the corresponding key is pressed, set the corresponding bit in readdata
-            if (GPIO_1[i]) begin
-                readdata = readdata | (1 << i);
-            end
-        end
-		if (KEY[0]) begin
-                readdata = readdata | (1 << 6);
-        end
-    end
-    else begin
-        readdata = 8'b00000000; // Clear readdata if read or chipselect is low
+    next_stable = stable;
+    for (int i = 0; i < INPUTS; i = i + 1)
+        if (sync1[i] != stable[i] && settle[i] == DEBOUNCE_CYCLES - 16'd1)
+            next_stable[i] = sync1[i];
+end
+
+assign push = next_stable != stable;
+assign pop = chipselect && read && address == 3'd3 && count != 0;
+
+always_ff @(posedge clk)
+    if (reset) begin
+        sync0 <= '0;
+        sync1 <= '0;
+        stable <= '0;
+        cycle_count <= 32'd0;
+        head <= '0;
+        tail <= '0;
+        count <= '0;
+        overflow <= 1'b0;
+        irq_enable <= 1'b0;
+        for (int i = 0; i < INPUTS; i = i + 1) settle[i] <= 16'd0;
+    end else begin
+        cycle_count <= cycle_count + 32'd1;
+
+        // The pins are asynchronous to clk
+        sync0 <= {KEY[0], GPIO_1};
+        sync1 <= sync0;
+
+        for (int i = 0; i < INPUTS; i = i + 1)
+            if (sync1[i] == next_stable[i]) settle[i] <= 16'd0;
+            else settle[i] <= settle[i] + 16'd1;
+        stable <= next_stable;
+
+        // Queue the change, timestamped with when the input stopped bouncing
+        if (push && (count != FIFO_DEPTH || pop)) begin
+            fifo_state[tail] <= next_stable;
+            fifo_time[tail] <= cycle_count - DEBOUNCE_CYCLES;
+            tail <= tail + 1'd1;
+        end else if (push) overflow <= 1'b1;
+
+        if (pop) head <= head + 1'd1;
+
+        if (push && count != FIFO_DEPTH && !pop) count <= count + 1'd1;
+        else if (pop && !push) count <= count - 1'd1;
+
+        if (chipselect && read && address == 3'd1) overflow <= 1'b0;
+        if (chipselect && write && address == 3'd5) irq_enable <= writedata[0];
     end
+
+// Combinational logic to assign readdata based on the register address
+always_comb begin
+    readdata = 32'd0; // Clear readdata if read or chipselect is low
+    if (read && chipselect)
+        case (address)
+            3'd0: readdata = {25'd0, stable};
+            3'd1: readdata = {overflow, 26'd0, count};
+            3'd2: readdata = {25'd0, fifo_state[head]};
+            3'd3: readdata = fifo_time[head];
+            3'd4: readdata = cycle_count;
+            3'd5: readdata = {31'd0, irq_enable};
+            default: readdata = 32'd0;
+        endcase
 end
 
 endmodule
-
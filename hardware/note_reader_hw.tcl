@@ -121,7 +121,9 @@ set_interface_property avalon_slave_0 SVD_ADDRESS_GROUP ""
 add_interface_port avalon_slave_0 address address Input 3
 add_interface_port avalon_slave_0 chipselect chipselect Input 1
 add_interface_port avalon_slave_0 read read Input 1
-add_interface_port avalon_slave_0 readdata readdata Output 8
+add_interface_port avalon_slave_0 readdata readdata Output 32
+add_interface_port avalon_slave_0 write write Input 1
+add_interface_port avalon_slave_0 writedata writedata Input 32
 add_interface_port avalon_slave_0 waitrequest waitrequest Output 1
 set_interface_assignment avalon_slave_0 embeddedsw.configuration.isFlash 0
 set_interface_assignment avalon_slave_0 embeddedsw.configuration.isMemoryDevice 0
@@ -129,6 +131,24 @@ set_interface_assignment avalon_slave_0 embeddedsw.configuration.isNonVolatileSt
 set_interface_assignment avalon_slave_0 embeddedsw.configuration.isPrintableDevice 0
 
 
+# 
+# connection point irq
+# 
+add_interface irq interrupt end
+set_interface_property irq associatedAddressablePoint avalon_slave_0
+set_interface_property irq associatedClock clock
+set_interface_property irq associatedReset reset
+set_interface_property irq bridgedReceiverOffset ""
+set_interface_property irq bridgesToReceiver ""
+set_interface_property irq ENABLED true
+set_interface_property irq EXPORT_OF ""
+set_interface_property irq PORT_NAME_MAP ""
+set_interface_property irq CMSIS_SVD_VARIABLES ""
+set_interface_property irq SVD_ADDRESS_GROUP ""
+
+add_interface_port irq irq irq Output 1
+
+
 # 
 # connection point reader
 # 
@@ -0,0 +1,781 @@
+/*
+ * Co-simulation harness: runs the game against the peripheral RTL
+ *
+ * The Verilated vga_framebuffer and note_reader share one simulated 50 MHz
+ * clock. This library stands in for /dev/vga_framebuffer and
+ * /dev/note_reader by catching open(), ioctl(), read(), write(), pwrite()
+ * and close() on those
+ * paths and turning each call into the Avalon transactions the kernel
+ * drivers would issue. Simulated time only moves when the game touches the
+ * bus or waits for a vblank, so a run is cycle-accurate however slowly the
+ * host goes. Once a device is open, clock_gettime(CLOCK_MONOTONIC) reads
+ * simulated time too, so the song, the game's frame deadlines and input
+ * timestamps all keep to it, and a scripted strum lands at the same point
+ * of the song however fast the host runs the model.
+ *
+ * "make" to build (needs Verilator; "make MODEL=1" builds against the cycle
+ * model instead), then run the unmodified game with
+ *   LD_PRELOAD=../hardware/sim/libcosim.so ./game_logic
+ *
+ * Environment:
+ *   COSIM_INPUT        guitar script, one "<ms> <GRYBO frets> <strum>" per
+ *                      line, e.g. "1500 10000 1" (# starts a comment)
+ *   COSIM_FRAMES       directory to write captured VGA frames to as PPMs
+ *   COSIM_FRAME_EVERY  only keep every Nth frame (default 1)
+ *
+ * /dev/note_reader is an eventfd, made readable when note_reader.sv raises
+ * its FIFO interrupt, so the game waits on it in epoll() as it would on the
+ * device, and is only woken when there are events.
+ *
+ * Bus transactions and simulated cycles per game frame (one page flip to
+ * the next), and the note reader's interrupts, are reported on stderr at
+ * exit.
+ */
+
+#include "Vnote_reader.h"
+#include "Vvga_framebuffer.h"
+#include "verilated.h"
+
+extern "C" {
+#include "global_consts.h"
+#include "guitar_reader.h"
+#include "vga_framebuffer.h"
+}
+
+#include <atomic>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const uint64_t CYCLES_PER_MS = 50000;
+const uint64_t NS_PER_CYCLE = 20;
+
+// As the kernel driver waits for the device: status reads to spin through,
+// then the shortest sleep usleep_range() is given between reads
+const int IDLE_SPIN_POLLS = 32;
+const uint64_t IDLE_SLEEP_CYCLES = 20 * CYCLES_PER_MS / 1000;
+
+bool on_screen(uint32_t row, uint32_t col, uint32_t width, uint32_t height) {
+  return row <= VGA_SCREEN_HEIGHT && height <= VGA_SCREEN_HEIGHT - row &&
+         col <= VGA_SCREEN_WIDTH && width <= VGA_SCREEN_WIDTH - col;
+}
+
+// Pin levels with nothing held: the frets and KEY[0] are active low
+const uint8_t PINS_IDLE = 0x5F;
+
+struct ScriptedInput {
+  uint64_t cycle;
+  uint8_t pins; // {KEY[0], GPIO_1[5:0]}
+};
+
+struct FrameStats {
+  uint64_t frames = 0;
+  uint64_t transactions = 0, max_transactions = 0;
+  uint64_t bus_cycles = 0, max_bus_cycles = 0;
+  uint64_t cycles = 0, max_cycles = 0;
+};
+
+class Cosim {
+public:
+  Cosim();
+  ~Cosim();
+
+  std::mutex lock;
+
+  uint64_t now_ns() const;
+  long vga_ioctl(unsigned long request, void *arg);
+  ssize_t vga_pwrite(const void *buf, size_t len, off_t pos);
+  void vga_release(off_t pos);
+  int notes_open(int event_fd);
+  void notes_release();
+  ssize_t notes_read(void *buf, size_t len);
+  int notes_ioctl(unsigned long request, void *arg);
+
+private:
+  VerilatedContext context;
+  Vvga_framebuffer *vga;
+  Vnote_reader *notes;
+  std::atomic<uint64_t> cycle{0}; // Read by now_ns() without the lock
+  uint64_t start_ns;              // Host time when the simulation started
+
+  std::vector<ScriptedInput> script;
+  size_t next_input = 0;
+
+  // VGA capture
+  std::vector<uint8_t> frame;
+  int beam_x = 0, beam_y = 0;
+  bool last_vga_clk = false, last_blank_n = false, last_vs = true;
+  unsigned long vblank_count = 0;
+  const char *frames_dir;
+  unsigned long frame_every = 1;
+
+  // Per game frame accounting, reset at each page flip
+  uint64_t transactions = 0, frame_transactions = 0;
+  uint64_t bus_cycles = 0, frame_bus_cycles = 0, frame_start_cycle = 0;
+  FrameStats stats;
+  uint32_t fixed_start = VGA_SCREEN_HEIGHT;
+
+  // The note reader's interrupt, as guitar_reader.c handles it: raising it
+  // makes notes_event_fd readable until read() has drained the FIFO
+  int notes_event_fd = -1;
+  bool events_ready = false;
+  uint64_t notes_interrupts = 0;
+
+  void load_script(const char *path);
+  void tick();
+  void sample_vga(bool blank_n, const uint8_t rgb[3]);
+  void write_frame();
+  void vga_write(int address, uint32_t data);
+  uint32_t vga_bus_read(int address);
+  void wait_idle();
+  uint32_t notes_bus_read(int address);
+  void notes_bus_write(int address, uint32_t data);
+  void end_game_frame();
+};
+
+// Set once the simulation has started, when clock_gettime() switches over
+std::atomic<bool> simulating{false};
+
+int host_clock_gettime(clockid_t clock, struct timespec *ts) {
+  static int (*real_clock_gettime)(clockid_t, struct timespec *) =
+      (int (*)(clockid_t, struct timespec *))dlsym(RTLD_NEXT,
+                                                   "clock_gettime");
+  return real_clock_gettime(clock, ts);
+}
+
+// read() and write() on the notes eventfd, past the ones interposed below
+ssize_t host_read(int fd, void *buf, size_t len) {
+  static ssize_t (*real_read)(int, void *, size_t) =
+      (ssize_t(*)(int, void *, size_t))dlsym(RTLD_NEXT, "read");
+  return real_read(fd, buf, len);
+}
+
+ssize_t host_write(int fd, const void *buf, size_t len) {
+  static ssize_t (*real_write)(int, const void *, size_t) =
+      (ssize_t(*)(int, const void *, size_t))dlsym(RTLD_NEXT, "write");
+  return real_write(fd, buf, len);
+}
+
+Cosim::Cosim() : frame(VGA_SCREEN_WIDTH * VGA_SCREEN_HEIGHT * 3) {
+  struct timespec ts;
+
+  host_clock_gettime(CLOCK_MONOTONIC, &ts);
+  start_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  vga = new Vvga_framebuffer(&context);
+  notes = new Vnote_reader(&context);
+
+  frames_dir = getenv("COSIM_FRAMES");
+  if (getenv("COSIM_FRAME_EVERY"))
+    frame_every = strtoul(getenv("COSIM_FRAME_EVERY"), NULL, 10);
+  if (frame_every == 0)
+    frame_every = 1;
+  if (getenv("COSIM_INPUT"))
+    load_script(getenv("COSIM_INPUT"));
+
+  notes->GPIO_1 = PINS_IDLE & 0x3F;
+  notes->KEY = 0xF;
+  vga->reset = notes->reset = 1;
+  for (int i = 0; i < 4; i++)
+    tick();
+  vga->reset = notes->reset = 0;
+  simulating = true;
+}
+
+Cosim::~Cosim() {
+  simulating = false;
+  fprintf(stderr, "---CO-SIMULATION---\n");
+  fprintf(stderr, "Simulated: %llu cycles (%.3f s), %lu vblanks\n",
+          (unsigned long long)cycle, (double)cycle / (CYCLES_PER_MS * 1000),
+          vblank_count);
+  fprintf(stderr, "Bus transactions: %llu over %llu cycles\n",
+          (unsigned long long)transactions, (unsigned long long)bus_cycles);
+  if (stats.frames) {
+    fprintf(stderr, "Game frames: %llu\n", (unsigned long long)stats.frames);
+    fprintf(stderr, "Bus transactions/frame: avg %.1f, max %llu\n",
+            (double)stats.transactions / stats.frames,
+            (unsigned long long)stats.max_transactions);
+    fprintf(stderr, "Bus cycles/frame: avg %.1f, max %llu\n",
+            (double)stats.bus_cycles / stats.frames,
+            (unsigned long long)stats.max_bus_cycles);
+    fprintf(stderr, "Cycles/frame: avg %.1f, max %llu\n",
+            (double)stats.cycles / stats.frames,
+            (unsigned long long)stats.max_cycles);
+  }
+  fprintf(stderr, "Note reader interrupts: %llu\n",
+          (unsigned long long)notes_interrupts);
+
+  vga->final();
+  notes->final();
+  delete vga;
+  delete notes;
+}
+
+void Cosim::load_script(const char *path) {
+  FILE *file = fopen(path, "r");
+  char line[128];
+
+  if (file == NULL) {
+    perror("cosim: could not open COSIM_INPUT");
+    return;
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    unsigned long ms;
+    char frets[6];
+    int strum;
+
+    if (line[0] == '#' || sscanf(line, "%lu %5s %d", &ms, frets, &strum) != 3)
+      continue;
+
+    ScriptedInput input = {ms * CYCLES_PER_MS, PINS_IDLE};
+    for (int i = 0; i < 5 && frets[i]; i++)
+      if (frets[i] == '1')
+        input.pins &= ~(1 << i);
+    if (strum)
+      input.pins |= 1 << 5;
+    script.push_back(input);
+  }
+
+  fclose(file);
+}
+
+// The host time the game sees: where the simulation has got to
+uint64_t Cosim::now_ns() const { return start_ns + cycle * NS_PER_CYCLE; }
+
+void Cosim::tick() {
+  // What the DAC latches on this edge is what was out before it
+  bool blank_n = vga->VGA_BLANK_n;
+  const uint8_t rgb[3] = {vga->VGA_R, vga->VGA_G, vga->VGA_B};
+
+  while (next_input < script.size() && script[next_input].cycle <= cycle) {
+    notes->GPIO_1 = script[next_input].pins & 0x3F;
+    notes->KEY = 0xE | ((script[next_input].pins >> 6) & 1);
+    next_input++;
+  }
+
+  vga->clk = notes->clk = 0;
+  vga->eval();
+  notes->eval();
+  vga->clk = notes->clk = 1;
+  vga->eval();
+  notes->eval();
+  cycle++;
+
+  // The handler: wake up whoever is waiting on the device
+  if (notes->irq && !events_ready && notes_event_fd != -1) {
+    uint64_t one = 1;
+    events_ready = true;
+    notes_interrupts++;
+    if (host_write(notes_event_fd, &one, sizeof(one)) != sizeof(one))
+      perror("cosim: could not signal /dev/note_reader");
+  }
+
+  sample_vga(blank_n, rgb);
+}
+
+// Follow the beam, keeping every pixel the DAC would latch on the rising
+// edge of VGA_CLK: blank_n and rgb are from just before the edge
+void Cosim::sample_vga(bool blank_n, const uint8_t rgb[3]) {
+  if (vga->VGA_CLK && !last_vga_clk && blank_n &&
+      beam_x < VGA_SCREEN_WIDTH && beam_y < VGA_SCREEN_HEIGHT) {
+    memcpy(&frame[(beam_y * VGA_SCREEN_WIDTH + beam_x) * 3], rgb, 3);
+    beam_x++;
+  }
+
+  if (last_blank_n && !vga->VGA_BLANK_n && beam_x) {
+    beam_x = 0;
+    beam_y++;
+  }
+
+  if (last_vs && !vga->VGA_VS) {
+    if (beam_y)
+      write_frame();
+    beam_x = beam_y = 0;
+    vblank_count++;
+  }
+
+  last_vga_clk = vga->VGA_CLK;
+  last_blank_n = vga->VGA_BLANK_n;
+  last_vs = vga->VGA_VS;
+}
+
+void Cosim::write_frame() {
+  if (frames_dir == NULL || vblank_count % frame_every)
+    return;
+
+  // Frames are written from whichever game thread is on the bus, which may
+  // be one the game keeps off the heap while playing, so no stdio here
+  char path[4096], header[32];
+  snprintf(path, sizeof(path), "%s/frame_%06lu.ppm", frames_dir, vblank_count);
+  int length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+                        VGA_SCREEN_WIDTH, VGA_SCREEN_HEIGHT);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1 || write(fd, header, length) != length ||
+      write(fd, frame.data(), frame.size()) != (ssize_t)frame.size())
+    perror("cosim: could not write frame");
+  if (fd != -1)
+    close(fd);
+}
+
+// One Avalon write, held until the slave stops asserting waitrequest
+void Cosim::vga_write(int address, uint32_t data) {
+  uint64_t start = cycle;
+
+  vga->chipselect = 1;
+  vga->write = 1;
+  vga->address = address;
+  vga->writedata = data;
+  vga->eval();
+  while (vga->waitrequest)
+    tick();
+  tick();
+  vga->chipselect = 0;
+  vga->write = 0;
+
+  transactions++;
+  bus_cycles += cycle - start;
+}
+
+uint32_t Cosim::vga_bus_read(int address) {
+  vga->chipselect = 1;
+  vga->read = 1;
+  vga->address = address;
+  vga->eval();
+  uint32_t data = vga->readdata;
+  tick();
+  vga->chipselect = 0;
+  vga->read = 0;
+
+  transactions++;
+  bus_cycles++;
+  return data;
+}
+
+// Mirrors wait_idle() in the kernel driver: the bus is free while it sleeps
+void Cosim::wait_idle() {
+  for (int polls = 0;
+       vga_bus_read(VGA_FRAMEBUFFER_REG_STATUS) & VGA_FRAMEBUFFER_STATUS_BUSY;
+       polls++)
+    if (polls >= IDLE_SPIN_POLLS)
+      for (uint64_t i = 0; i < IDLE_SLEEP_CYCLES; i++)
+        tick();
+}
+
+uint32_t Cosim::notes_bus_read(int address) {
+  notes->chipselect = 1;
+  notes->read = 1;
+  notes->address = address;
+  notes->eval();
+  uint32_t data = notes->readdata;
+  tick();
+  notes->chipselect = 0;
+  notes->read = 0;
+
+  transactions++;
+  bus_cycles++;
+  return data;
+}
+
+void Cosim::notes_bus_write(int address, uint32_t data) {
+  notes->chipselect = 1;
+  notes->write = 1;
+  notes->address = address;
+  notes->writedata = data;
+  notes->eval();
+  tick();
+  notes->chipselect = 0;
+  notes->write = 0;
+
+  transactions++;
+  bus_cycles++;
+}
+
+void Cosim::end_game_frame() {
+  uint64_t frame_tx = transactions - frame_transactions;
+  uint64_t frame_bus = bus_cycles - frame_bus_cycles;
+  uint64_t frame_cycles = cycle - frame_start_cycle;
+
+  stats.frames++;
+  stats.transactions += frame_tx;
+  stats.bus_cycles += frame_bus;
+  stats.cycles += frame_cycles;
+  if (frame_tx > stats.max_transactions)
+    stats.max_transactions = frame_tx;
+  if (frame_bus > stats.max_bus_cycles)
+    stats.max_bus_cycles = frame_bus;
+  if (frame_cycles > stats.max_cycles)
+    stats.max_cycles = frame_cycles;
+
+  frame_transactions = transactions;
+  frame_bus_cycles = bus_cycles;
+  frame_start_cycle = cycle;
+}
+
+// Mirrors vga_framebuffer_ioctl() in the kernel driver
+long Cosim::vga_ioctl(unsigned long request, void *arg) {
+  switch (request) {
+  case VGA_FRAMEBUFFER_UPDATE:
+    wait_idle();
+    vga_write(VGA_FRAMEBUFFER_REG_PIXEL,
+              ((vga_framebuffer_arg_t *)arg)->pixel_writedata);
+    break;
+
+  case VGA_FRAMEBUFFER_SET_SCROLL: {
+    vga_framebuffer_scroll_t *scroll = (vga_framebuffer_scroll_t *)arg;
+    if (scroll->fixed_start == 0 || scroll->fixed_start > VGA_SCREEN_HEIGHT ||
+        scroll->offset >= scroll->fixed_start ||
+        scroll->first_column >= scroll->end_column ||
+        scroll->end_column > VGA_SCREEN_WIDTH)
+      return -EINVAL;
+    vga_write(VGA_FRAMEBUFFER_REG_SCROLL_COLUMNS,
+              scroll->end_column << 10 | scroll->first_column);
+    vga_write(VGA_FRAMEBUFFER_REG_FIXED_START, scroll->fixed_start);
+    vga_write(VGA_FRAMEBUFFER_REG_SCROLL_OFFSET, scroll->offset);
+    fixed_start = scroll->fixed_start;
+    break;
+  }
+
+  case VGA_FRAMEBUFFER_WRITE_PACKED: {
+    vga_framebuffer_packed_t *packed = (vga_framebuffer_packed_t *)arg;
+    if (packed->count > VGA_FRAMEBUFFER_FRAME_BYTES / 4)
+      return -EINVAL;
+    wait_idle();
+    vga_write(VGA_FRAMEBUFFER_REG_WRITE_POINTER, packed->start);
+    for (uint32_t i = 0; i < packed->count; i++)
+      vga_write(VGA_FRAMEBUFFER_REG_PACKED_PIXELS, packed->words[i]);
+    break;
+  }
+
+  case VGA_FRAMEBUFFER_FLIP:
+    if (*(uint32_t *)arg >= fixed_start)
+      return -EINVAL;
+    wait_idle();
+    vga_write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, *(uint32_t *)arg);
+    end_game_frame();
+    break;
+
+  case VGA_FRAMEBUFFER_SET_PALETTE: {
+    vga_framebuffer_palette_t *colors = (vga_framebuffer_palette_t *)arg;
+    if (colors->first >= VGA_FRAMEBUFFER_PALETTE_SIZE ||
+        colors->count > VGA_FRAMEBUFFER_PALETTE_SIZE - colors->first)
+      return -EINVAL;
+    for (uint32_t i = 0; i < colors->count; i++)
+      vga_write(VGA_FRAMEBUFFER_REG_PALETTE,
+                (colors->first + i) << 24 | (colors->colors[i] & 0xffffff));
+    break;
+  }
+
+  case VGA_FRAMEBUFFER_BLIT: {
+    vga_framebuffer_blits_t *list = (vga_framebuffer_blits_t *)arg;
+    if (list->count > VGA_FRAMEBUFFER_MAX_BLITS)
+      return -EINVAL;
+    for (uint32_t i = 0; i < list->count; i++) {
+      const vga_framebuffer_blit_t &blit = list->blits[i];
+      bool copy = blit.op == VGA_FRAMEBUFFER_BLIT_COPY;
+      if (blit.op > VGA_FRAMEBUFFER_BLIT_COPY ||
+          !on_screen(blit.row, blit.col, blit.width, blit.height) ||
+          (copy && !on_screen(blit.src_row, blit.src_col, blit.width,
+                              blit.height)) ||
+          blit.color >= VGA_FRAMEBUFFER_PALETTE_SIZE)
+        return -EINVAL;
+
+      wait_idle();
+      uint32_t start = blit.color;
+      if (copy) {
+        vga_write(VGA_FRAMEBUFFER_REG_BLIT_SOURCE,
+                  VGA_FRAMEBUFFER_POINTER(blit.src_row, blit.src_col));
+        start |= VGA_FRAMEBUFFER_START_COPY;
+        if (blit.src_on_screen)
+          start |= VGA_FRAMEBUFFER_START_SOURCE_ON_SCREEN;
+      }
+      vga_write(VGA_FRAMEBUFFER_REG_BLIT_DEST,
+                VGA_FRAMEBUFFER_POINTER(blit.row, blit.col));
+      vga_write(VGA_FRAMEBUFFER_REG_BLIT_SIZE,
+                VGA_FRAMEBUFFER_POINTER(blit.height, blit.width));
+      vga_write(VGA_FRAMEBUFFER_REG_BLIT_START, start);
+    }
+    break;
+  }
+
+  case VGA_FRAMEBUFFER_WAIT_VBLANK: {
+    unsigned long seen = vblank_count;
+    while (vblank_count == seen)
+      tick();
+    *(uint32_t *)arg = vblank_count;
+    break;
+  }
+
+  default:
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+// Mirrors vga_framebuffer_write() in the kernel driver
+ssize_t Cosim::vga_pwrite(const void *buf, size_t len, off_t pos) {
+  const uint32_t *words = (const uint32_t *)buf;
+
+  if (pos < 0 || pos % 4 || len % 4)
+    return -EINVAL;
+  if (pos >= VGA_FRAMEBUFFER_FRAME_BYTES)
+    return len ? -ENOSPC : 0;
+  if (len > (size_t)(VGA_FRAMEBUFFER_FRAME_BYTES - pos))
+    len = VGA_FRAMEBUFFER_FRAME_BYTES - pos;
+  if (len == 0)
+    return 0;
+
+  uint32_t word = pos / 4, row_words = VGA_SCREEN_WIDTH / PIXELS_PER_WORD;
+  wait_idle();
+  vga_write(VGA_FRAMEBUFFER_REG_WRITE_POINTER,
+            VGA_FRAMEBUFFER_POINTER(word / row_words,
+                                    word % row_words * PIXELS_PER_WORD));
+  for (size_t i = 0; i < len / 4; i++)
+    vga_write(VGA_FRAMEBUFFER_REG_PACKED_PIXELS, words[i]);
+
+  return len;
+}
+
+// Mirrors vga_framebuffer_release() in the kernel driver
+void Cosim::vga_release(off_t pos) {
+  if (pos == VGA_FRAMEBUFFER_FRAME_BYTES) {
+    wait_idle();
+    vga_write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+    end_game_frame();
+  }
+}
+
+// Mirrors guitar_reader_read() in the kernel driver, on simulated time
+ssize_t Cosim::notes_read(void *buf, size_t len) {
+  guitar_reader_event_t *events = (guitar_reader_event_t *)buf;
+
+  if (len < sizeof(guitar_reader_event_t))
+    return -EINVAL;
+
+  uint32_t count = notes_bus_read(GUITAR_READER_REG_FIFO_COUNT) &
+                   GUITAR_READER_FIFO_COUNT_MASK;
+  uint32_t now_cycle = notes_bus_read(GUITAR_READER_REG_CYCLE_COUNT);
+  // Stamped against the monotonic clock like ktime_get_ns(), so the game
+  // can line events up with its own clock, which is simulated time here
+  uint64_t now = now_ns();
+
+  if (count > len / sizeof(guitar_reader_event_t))
+    count = len / sizeof(guitar_reader_event_t);
+
+  for (uint32_t i = 0; i < count; i++) {
+    events[i].state = notes_bus_read(GUITAR_READER_REG_EVENT_STATE);
+    events[i].cycle = notes_bus_read(GUITAR_READER_REG_EVENT_TIME);
+    events[i].time_ns =
+        now - (uint64_t)(uint32_t)(now_cycle - events[i].cycle) *
+                     NS_PER_CYCLE;
+  }
+
+  // Rearm: anything still queued raises the interrupt again on this write
+  if (notes_event_fd != -1) {
+    uint64_t signalled;
+    events_ready = false;
+    host_read(notes_event_fd, &signalled, sizeof(signalled));
+    notes_bus_write(GUITAR_READER_REG_IRQ_CONTROL, GUITAR_READER_IRQ_ENABLE);
+  }
+
+  return count * sizeof(guitar_reader_event_t);
+}
+
+// Mirrors guitar_reader_probe() enabling the interrupt; returns event_fd
+int Cosim::notes_open(int event_fd) {
+  notes_event_fd = event_fd;
+  events_ready = false;
+  notes_bus_write(GUITAR_READER_REG_IRQ_CONTROL, GUITAR_READER_IRQ_ENABLE);
+  return event_fd;
+}
+
+void Cosim::notes_release() { notes_event_fd = -1; }
+
+int Cosim::notes_ioctl(unsigned long request, void *arg) {
+  if (request != GUITAR_READER_READ)
+    return -EINVAL;
+  *(int *)arg = notes_bus_read(GUITAR_READER_REG_STATE);
+  return 0;
+}
+
+// Only built once the game opens one of the devices
+Cosim &cosim() {
+  static Cosim instance;
+  return instance;
+}
+
+// Descriptors handed out for the simulated devices
+int vga_fd = -1, notes_fd = -1;
+// File position of vga_fd, which write() moves
+off_t vga_pos = 0;
+
+typedef int (*open_fn)(const char *, int, ...);
+
+int open_device(const char *path, int flags, mode_t mode,
+                open_fn real_open) {
+  int *fd = NULL;
+
+  if (strcmp(path, "/dev/vga_framebuffer") == 0)
+    fd = &vga_fd;
+  else if (strcmp(path, "/dev/note_reader") == 0)
+    fd = &notes_fd;
+  else
+    return real_open(path, flags, mode);
+
+  // Hand out a real descriptor so the number is unique and close() works
+  std::lock_guard<std::mutex> guard(cosim().lock);
+  if (fd == &notes_fd)
+    return *fd = cosim().notes_open(
+               eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  *fd = real_open("/dev/null", O_RDWR);
+  vga_pos = 0;
+  return *fd;
+}
+
+} // namespace
+
+extern "C" {
+
+int open(const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = (flags & O_CREAT) ? va_arg(args, mode_t) : 0;
+  va_end(args);
+  static open_fn real_open = (open_fn)dlsym(RTLD_NEXT, "open");
+  return open_device(path, flags, mode, real_open);
+}
+
+int open64(const char *path, int flags, ...) {
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = (flags & O_CREAT) ? va_arg(args, mode_t) : 0;
+  va_end(args);
+  static open_fn real_open64 = (open_fn)dlsym(RTLD_NEXT, "open64");
+  return open_device(path, flags, mode, real_open64);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+  static int (*real_ioctl)(int, unsigned long, ...) =
+      (int (*)(int, unsigned long, ...))dlsym(RTLD_NEXT, "ioctl");
+  va_list args;
+  va_start(args, request);
+  void *arg = va_arg(args, void *);
+  va_end(args);
+
+  if (fd >= 0 && (fd == vga_fd || fd == notes_fd)) {
+    std::lock_guard<std::mutex> guard(cosim().lock);
+    long ret = fd == vga_fd ? cosim().vga_ioctl(request, arg)
+                                    : cosim().notes_ioctl(request, arg);
+    if (ret < 0) {
+      errno = -ret;
+      return -1;
+    }
+    return 0;
+  }
+
+  return real_ioctl(fd, request, arg);
+}
+
+ssize_t read(int fd, void *buf, size_t len) {
+  static ssize_t (*real_read)(int, void *, size_t) =
+      (ssize_t(*)(int, void *, size_t))dlsym(RTLD_NEXT, "read");
+
+  if (fd >= 0 && fd == notes_fd) {
+    std::lock_guard<std::mutex> guard(cosim().lock);
+    ssize_t ret = cosim().notes_read(buf, len);
+    if (ret < 0) {
+      errno = -ret;
+      return -1;
+    }
+    return ret;
+  }
+
+  return real_read(fd, buf, len);
+}
+
+ssize_t write(int fd, const void *buf, size_t len) {
+  static ssize_t (*real_write)(int, const void *, size_t) =
+      (ssize_t(*)(int, const void *, size_t))dlsym(RTLD_NEXT, "write");
+
+  if (fd >= 0 && fd == vga_fd) {
+    std::lock_guard<std::mutex> guard(cosim().lock);
+    ssize_t ret = cosim().vga_pwrite(buf, len, vga_pos);
+    if (ret < 0) {
+      errno = -ret;
+      return -1;
+    }
+    vga_pos += ret;
+    return ret;
+  }
+
+  return real_write(fd, buf, len);
+}
+
+static ssize_t device_pwrite(const void *buf, size_t len, off_t pos) {
+  std::lock_guard<std::mutex> guard(cosim().lock);
+  ssize_t ret = cosim().vga_pwrite(buf, len, pos);
+  if (ret < 0) {
+    errno = -ret;
+    return -1;
+  }
+  return ret;
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t len, off_t pos) {
+  static ssize_t (*real_pwrite)(int, const void *, size_t, off_t) =
+      (ssize_t(*)(int, const void *, size_t, off_t))dlsym(RTLD_NEXT,
+                                                           "pwrite");
+
+  if (fd >= 0 && fd == vga_fd)
+    return device_pwrite(buf, len, pos);
+  return real_pwrite(fd, buf, len, pos);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t len, off64_t pos) {
+  static ssize_t (*real_pwrite64)(int, const void *, size_t, off64_t) =
+      (ssize_t(*)(int, const void *, size_t, off64_t))dlsym(RTLD_NEXT,
+                                                             "pwrite64");
+
+  if (fd >= 0 && fd == vga_fd)
+    return device_pwrite(buf, len, pos);
+  return real_pwrite64(fd, buf, len, pos);
+}
+
+int close(int fd) {
+  static int (*real_close)(int) = (int (*)(int))dlsym(RTLD_NEXT, "close");
+
+  if (fd >= 0 && fd == vga_fd) {
+    std::lock_guard<std::mutex> guard(cosim().lock);
+    cosim().vga_release(vga_pos);
+    vga_fd = -1;
+  } else if (fd >= 0 && fd == notes_fd) {
+    std::lock_guard<std::mutex> guard(cosim().lock);
+    cosim().notes_release();
+    notes_fd = -1;
+  }
+
+  return real_close(fd);
+}
+
+int clock_gettime(clockid_t clock, struct timespec *ts) {
+  if (clock != CLOCK_MONOTONIC || !simulating)
+    return host_clock_gettime(clock, ts);
+
+  uint64_t now = cosim().now_ns();
+  ts->tv_sec = now / 1000000000ULL;
+  ts->tv_nsec = now % 1000000000ULL;
+  return 0;
+}
+}
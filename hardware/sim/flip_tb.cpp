@@ -0,0 +1,133 @@
+/*
+ * Page flip testbench for vga_framebuffer.sv
+ *
+ * Fills each page with a color of its own, then writes the page flip
+ * register at different points of a frame: halfway down the visible rows,
+ * in the front porch just before vertical sync, and during vertical sync
+ * just after it started. Every scanned-out pixel is checked: the page on
+ * screen may only change at the falling edge of VGA_VS, so each frame must
+ * come whole from one page or the other, never torn between them.
+ *
+ * The vblank interrupt must rise the cycle after that same edge and at no
+ * other time, stay up until a write to the irq control register
+ * acknowledges it, and stay down while disabled.
+ *
+ * "make flip_tb && ./flip_tb"; exits nonzero if anything is out of place.
+ */
+
+#include "vga_bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace {
+
+// What each page is filled with; neither is 0, which blanking shows as
+const int FIRST_COLOR = 21, SECOND_COLOR = 42;
+
+// Counts rises of irq at any time but the cycle after vsync
+class Bench : public VgaBench {
+public:
+  int stray_irqs = 0;
+
+  void fill_page(int color);
+
+private:
+  bool last_irq = false;
+
+  void ticked() override;
+};
+
+void Bench::ticked() {
+  if (vga->irq && !last_irq && cycle != vs_fell + 1) {
+    fprintf(stderr, "flip_tb: irq rose %llu cycles after vsync\n",
+            (unsigned long long)(cycle - vs_fell));
+    stray_irqs++;
+  }
+  last_irq = vga->irq;
+}
+
+// Fills the page not on screen, and waits for the blitter to finish
+void Bench::fill_page(int color) {
+  write(VGA_FRAMEBUFFER_REG_BLIT_DEST, VGA_FRAMEBUFFER_POINTER(0, 0));
+  write(VGA_FRAMEBUFFER_REG_BLIT_SIZE,
+        VGA_FRAMEBUFFER_POINTER(HEIGHT, WIDTH));
+  write(VGA_FRAMEBUFFER_REG_BLIT_START, color);
+  drain();
+}
+
+// Counts the pixels of the last frame that are not color
+int check(const char *what, const Bench &bench, int color) {
+  return check_frame("flip_tb", what, bench, Page(WIDTH * HEIGHT, color));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Verilated::commandArgs(argc, argv);
+  Bench bench;
+  int wrong = 0;
+
+  printf("---FLIP TESTBENCH---\n");
+  bench.load_test_palette();
+
+  // Page 1 comes up hidden: fill it, show it, then fill page 0 behind it
+  bench.fill_page(FIRST_COLOR);
+  bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+  bench.run_to_vsync();
+  bench.fill_page(SECOND_COLOR);
+  bench.run_to_vsync();
+  wrong += check("Flipped at vsync", bench, FIRST_COLOR);
+
+  // Flipping halfway down the screen must not tear the frame being shown
+  bench.run_to_row(HEIGHT / 2);
+  bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+  bench.run_to_vsync();
+  wrong += check("Flip mid-frame: rest of the frame", bench, FIRST_COLOR);
+  bench.run_to_vsync();
+  wrong += check("Flip mid-frame: next frame", bench, SECOND_COLOR);
+
+  // In the front porch the flip takes effect at the vsync just ahead
+  bench.run_to_row(HEIGHT);
+  bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+  bench.run_to_vsync();
+  wrong += check("Flip in the front porch: that frame", bench, SECOND_COLOR);
+  bench.run_to_vsync();
+  wrong += check("Flip in the front porch: next frame", bench, FIRST_COLOR);
+
+  // Once vsync has started, the flip waits for the next one
+  bench.run_to_vsync();
+  bench.run(100);
+  bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+  bench.run_to_vsync();
+  wrong += check("Flip during vsync: that frame", bench, FIRST_COLOR);
+  bench.run_to_vsync();
+  wrong += check("Flip during vsync: next frame", bench, SECOND_COLOR);
+
+  wrong += expect("No irq while disabled", !bench.irq());
+
+  // Enabled, it rises with vsync and holds until acknowledged
+  bench.write(VGA_FRAMEBUFFER_REG_IRQ_CONTROL, VGA_FRAMEBUFFER_IRQ_ENABLE);
+  bench.run_to_vsync();
+  bench.run(1);
+  wrong += expect("irq raised by vsync", bench.irq());
+  bench.run_to_row(HEIGHT / 2);
+  wrong += expect("irq held until acknowledged", bench.irq());
+  bench.write(VGA_FRAMEBUFFER_REG_IRQ_CONTROL, VGA_FRAMEBUFFER_IRQ_ENABLE);
+  wrong += expect("irq acknowledged", !bench.irq());
+  bench.run_to_row(HEIGHT);
+  wrong += expect("irq stays down until the next vsync", !bench.irq());
+  bench.run_to_vsync();
+  bench.run(1);
+  wrong += expect("irq raised by the next vsync", bench.irq());
+
+  // Disabling acknowledges it too, and no vsync raises it again
+  bench.write(VGA_FRAMEBUFFER_REG_IRQ_CONTROL, 0);
+  bench.run_to_vsync();
+  bench.run_to_vsync();
+  wrong += expect("irq disabled", !bench.irq());
+  wrong += expect("irq rose only with vsync", bench.stray_irqs == 0);
+
+  printf("Wrong: %d\n", wrong);
+  return wrong != 0;
+}
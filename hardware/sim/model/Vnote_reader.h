@@ -0,0 +1,142 @@
+/*
+ * Cycle model of hardware/note_reader.sv, with its default parameters; see
+ * verilated.h
+ *
+ * As in Vvga_framebuffer.h, a rising edge of clk works out every register's
+ * next value from the current ones, then takes them all at once, and
+ * readdata is the module's combinational read of them.
+ */
+
+#ifndef VNOTE_READER_H
+#define VNOTE_READER_H
+
+#include "verilated.h"
+
+#include <stdint.h>
+
+struct Vnote_reader {
+  // Ports
+  CData clk = 0, reset = 0, chipselect = 0, address = 0, read = 0, write = 0;
+  IData writedata = 0;
+  CData KEY = 0xF, GPIO_1 = 0;
+  CData LEDR = 0, waitrequest = 0, irq = 0;
+  IData readdata = 0;
+
+  explicit Vnote_reader(VerilatedContext *context) { (void)context; }
+
+  void eval() {
+    if (clk && !last_clk)
+      posedge();
+    last_clk = clk;
+    outputs();
+  }
+
+  void final() {}
+
+private:
+  static const int INPUTS = 7, FIFO_DEPTH = 16;
+  static const uint32_t DEBOUNCE_CYCLES = 50000;
+
+  struct Regs {
+    uint32_t sync0 = 0, sync1 = 0, stable = 0;
+    uint32_t settle[INPUTS] = {};
+    uint32_t cycle_count = 0;
+    uint32_t fifo_time[FIFO_DEPTH] = {}, fifo_state[FIFO_DEPTH] = {};
+    uint32_t head = 0, tail = 0, count = 0;
+    bool overflow = false, irq_enable = false;
+  };
+
+  Regs r;
+  CData last_clk = 0;
+
+  // An input that has held its new level long enough joins the debounced
+  // state
+  uint32_t next_stable() const {
+    uint32_t next = r.stable;
+    for (int i = 0; i < INPUTS; i++)
+      if ((r.sync1 >> i & 1) != (r.stable >> i & 1) &&
+          r.settle[i] == DEBOUNCE_CYCLES - 1)
+        next = (next & ~(1u << i)) | (r.sync1 & 1u << i);
+    return next;
+  }
+
+  void outputs() {
+    LEDR = GPIO_1;
+    waitrequest = 0;
+    irq = r.irq_enable && r.count != 0;
+    readdata = 0;
+    if (read && chipselect)
+      switch (address) {
+      case 0:
+        readdata = r.stable;
+        break;
+      case 1:
+        readdata = (uint32_t)r.overflow << 31 | r.count;
+        break;
+      case 2:
+        readdata = r.fifo_state[r.head];
+        break;
+      case 3:
+        readdata = r.fifo_time[r.head];
+        break;
+      case 4:
+        readdata = r.cycle_count;
+        break;
+      case 5:
+        readdata = r.irq_enable;
+        break;
+      }
+  }
+
+  void posedge() {
+    Regs n = r;
+
+    if (reset) {
+      n = Regs();
+      r = n;
+      return;
+    }
+
+    uint32_t next = next_stable();
+    bool push = next != r.stable;
+    bool pop = chipselect && read && address == 3 && r.count != 0;
+
+    n.cycle_count = r.cycle_count + 1;
+
+    // The pins are asynchronous to clk
+    n.sync0 = (KEY & 1) << 6 | (GPIO_1 & 0x3f);
+    n.sync1 = r.sync0;
+
+    for (int i = 0; i < INPUTS; i++)
+      n.settle[i] = (r.sync1 >> i & 1) == (next >> i & 1)
+                        ? 0
+                        : (r.settle[i] + 1) & 0xffff;
+    n.stable = next;
+
+    // Queue the change, timestamped with when the input stopped bouncing
+    if (push && (r.count != FIFO_DEPTH || pop)) {
+      n.fifo_state[r.tail] = next;
+      n.fifo_time[r.tail] = r.cycle_count - DEBOUNCE_CYCLES;
+      n.tail = (r.tail + 1) % FIFO_DEPTH;
+    } else if (push) {
+      n.overflow = true;
+    }
+
+    if (pop)
+      n.head = (r.head + 1) % FIFO_DEPTH;
+
+    if (push && r.count != FIFO_DEPTH && !pop)
+      n.count = r.count + 1;
+    else if (pop && !push)
+      n.count = r.count - 1;
+
+    if (chipselect && read && address == 1)
+      n.overflow = false;
+    if (chipselect && write && address == 5)
+      n.irq_enable = writedata & 1;
+
+    r = n;
+  }
+};
+
+#endif /* VNOTE_READER_H */
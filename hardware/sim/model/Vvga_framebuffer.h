@@ -0,0 +1,337 @@
+/*
+ * Cycle model of hardware/vga_framebuffer.sv; see verilated.h
+ *
+ * Every register of the module is in Regs. A rising edge of clk works out
+ * the next value of each from the current ones only, as the RTL's
+ * nonblocking assignments do, then takes them all at once; the outputs are
+ * the module's continuous assignments of the registers. The sections of
+ * posedge() follow the module's always blocks in order.
+ *
+ * Building with one of these defined (make MODEL=1 MODEL_FLAGS=-D...) puts
+ * back an earlier version of the RTL:
+ *   MODEL_OLD_COLUMN0   column 0 read from the end of the row before;
+ *                       scroll_tb catches it
+ *   MODEL_FLIP_AT_ONCE  page flips taken at once rather than at vsync;
+ *                       flip_tb catches it
+ *   MODEL_OLD_PALETTE   palette read combinationally into VGA_R/G/B. This
+ *                       shows the same pixels: what it changed was the
+ *                       timing and the RAM Quartus infers, which no cycle
+ *                       model sees, so palette_tb passes either way
+ */
+
+#ifndef VVGA_FRAMEBUFFER_H
+#define VVGA_FRAMEBUFFER_H
+
+#include "verilated.h"
+
+#include <stdint.h>
+#include <vector>
+
+struct Vvga_framebuffer {
+  // Ports
+  CData clk = 0, reset = 0;
+  IData writedata = 0, readdata = 0;
+  CData write = 0, read = 0, chipselect = 0, address = 0;
+  CData waitrequest = 0, irq = 0;
+  CData VGA_R = 0, VGA_G = 0, VGA_B = 0;
+  CData VGA_CLK = 0, VGA_HS = 1, VGA_VS = 1, VGA_BLANK_n = 0, VGA_SYNC_n = 0;
+
+  explicit Vvga_framebuffer(VerilatedContext *context)
+      : data(1 << 20) { // 20 address bits; the RTL's array stops at 614399
+    (void)context;
+    for (int i = 0; i < 64; i++)
+      palette[i] = 0xffffff;
+    const uint32_t colors[] = {
+        0x000000, 0xffffff, 0xff0000, 0x00ff00, 0x0000ff, 0x14d345,
+        0x11a132, 0x10a237, 0xd3362f, 0x9a2a26, 0x9b2929, 0xfef335,
+        0xc5bd1a, 0xcfbd3d, 0x5375e0, 0x3b59af, 0x4059ab, 0xda562b,
+        0x8b3518, 0x8f3719, 0x000080, 0x303030, 0x707070,
+    };
+    for (unsigned i = 0; i < sizeof(colors) / sizeof(colors[0]); i++)
+      palette[i] = colors[i];
+    outputs();
+  }
+
+  void eval() {
+    if (clk && !last_clk)
+      posedge();
+    last_clk = clk;
+    outputs();
+  }
+
+  void final() {}
+
+private:
+  struct Regs {
+    // vga_counters
+    uint32_t hcount = 0, vcount = 0;
+    // vga_mem's read ports
+    uint32_t rd = 0, wrd = 0;
+    // The palette's read register
+    uint32_t pixel_rgb = 0;
+    // vga_framebuffer
+    uint32_t write_addr = 0, write_data = 0;
+    bool write_mem = false;
+    uint32_t scroll_offset = 0, fixed_start = 480;
+    uint32_t scroll_first = 0, scroll_end = 640;
+    uint32_t pointer_row = 0, pointer_col = 0;
+    uint32_t packed_data = 0, packed_left = 0;
+    bool display_page = false, flip_pending = false, irq_enable = false;
+    bool irq = false, vs_prev = true;
+    uint32_t flip_offset = 0;
+    uint32_t blit_row = 0, blit_height = 0, blit_src_row = 0, blit_y = 0;
+    uint32_t blit_col = 0, blit_width = 0, blit_src_col = 0, blit_x = 0;
+    uint32_t blit_color = 0;
+    bool blit_busy = false, blit_copy = false, blit_src_front = false;
+    bool blit_rows_up = false, blit_cols_left = false;
+    bool blit_phase = false, blit_forward = false;
+  };
+
+  Regs r;
+  std::vector<uint8_t> data; // vga_mem, both pages
+  uint32_t palette[64];
+  CData last_clk = 0;
+
+  static uint32_t pixel_address(bool page, uint32_t row, uint32_t col) {
+    return ((page ? 307200 : 0) + (row << 9) + (row << 7) + col) & 0xfffff;
+  }
+
+  bool blit_holds() const {
+    return address == 0 || address == 4 || address == 5 || address >= 9;
+  }
+  bool held() const {
+    return chipselect && write &&
+           (r.packed_left != 0 || (r.blit_busy && blit_holds()));
+  }
+
+  // vga_counters' syncs and blanking
+  bool vsync_n() const { return !((r.vcount >> 1) == 245); }
+  bool blank_n() const {
+    return !((r.hcount >> 10 & 1) && ((r.hcount >> 9 | r.hcount >> 8) & 1)) &&
+           !((r.vcount >> 9 & 1) || (r.vcount >> 5 & 15) == 15);
+  }
+
+  // The pixel after this one, scrolled
+  uint32_t read_addr() const {
+    uint32_t pixel_y = r.vcount & 0x1ff;
+    uint32_t pixel_x = ((r.hcount >> 1) + 1) & 0x3ff;
+#ifndef MODEL_OLD_COLUMN0
+    if ((r.hcount >> 1) == 799) { // line_end
+      pixel_x = 0;
+      pixel_y = r.vcount == 524 ? 0 : (r.vcount + 1) & 0x1ff;
+    }
+#endif
+    uint32_t scroll_sum = (pixel_y + r.scroll_offset) & 0x3ff;
+    bool scroll_column = pixel_x >= r.scroll_first && pixel_x < r.scroll_end;
+    uint32_t scrolled_y;
+    if (pixel_y >= r.fixed_start || !scroll_column)
+      scrolled_y = pixel_y;
+    else if (scroll_sum >= r.fixed_start)
+      scrolled_y = ((scroll_sum & 0x1ff) - r.fixed_start) & 0x1ff;
+    else
+      scrolled_y = scroll_sum & 0x1ff;
+    return pixel_address(r.display_page, scrolled_y, pixel_x);
+  }
+
+  void outputs() {
+    waitrequest = held();
+    readdata = chipselect && read && address == 13
+                   ? r.blit_busy || r.packed_left != 0
+                   : 0;
+    irq = r.irq;
+    VGA_HS = !((r.hcount >> 8 & 7) == 5 && !((r.hcount >> 5 & 7) == 7));
+    VGA_VS = vsync_n();
+    VGA_BLANK_n = blank_n();
+    VGA_SYNC_n = 0;
+    VGA_CLK = r.hcount & 1;
+#ifdef MODEL_OLD_PALETTE
+    uint32_t rgb = VGA_BLANK_n ? palette[r.rd] : 0;
+#else
+    uint32_t rgb = VGA_BLANK_n ? r.pixel_rgb : 0;
+#endif
+    VGA_R = rgb >> 16;
+    VGA_G = rgb >> 8;
+    VGA_B = rgb;
+  }
+
+  void posedge() {
+    Regs n = r;
+    bool vs = vsync_n();
+
+    // vga_counters
+    if (reset) {
+      n.hcount = n.vcount = 0;
+    } else if (r.hcount == 1599) {
+      n.hcount = 0;
+      n.vcount = r.vcount == 524 ? 0 : r.vcount + 1;
+    } else {
+      n.hcount = r.hcount + 1;
+    }
+
+    // vga_mem: reads see what was there before this edge's write
+    uint32_t ra = read_addr(), wa = r.write_addr;
+    n.rd = data[ra];
+    n.wrd = data[wa];
+    if (r.write_mem)
+      data[wa] = (r.blit_forward ? r.wrd : r.write_data) & 63;
+
+    // The palette
+    n.pixel_rgb = palette[r.rd];
+    if (chipselect && write && !held() && address == 8)
+      palette[writedata >> 24 & 63] = writedata & 0xffffff;
+
+    if (reset) {
+      n.write_addr = 0;
+      n.write_data = 0;
+      n.write_mem = false;
+      n.scroll_offset = 0;
+      n.fixed_start = 480;
+      n.scroll_first = 0;
+      n.scroll_end = 640;
+      n.pointer_row = 0;
+      n.pointer_col = 0;
+      n.packed_data = 0;
+      n.packed_left = 0;
+      n.display_page = false;
+      n.flip_pending = false;
+      n.flip_offset = 0;
+      n.irq_enable = false;
+      n.irq = false;
+      n.vs_prev = true;
+      n.blit_busy = false;
+      n.blit_forward = false;
+      r = n;
+      return;
+    }
+
+    uint32_t blit_dy = r.blit_rows_up ? r.blit_height - 1 - r.blit_y : r.blit_y;
+    uint32_t blit_dx =
+        r.blit_cols_left ? r.blit_width - 1 - r.blit_x : r.blit_x;
+
+    n.write_mem = false;
+    n.blit_forward = false;
+    if (r.blit_busy) {
+      if (!r.blit_copy || r.blit_phase) {
+        n.write_addr =
+            pixel_address(!r.display_page, (r.blit_row + blit_dy) & 0x1ff,
+                          (r.blit_col + blit_dx) & 0x3ff);
+        n.write_data = r.blit_color;
+        n.write_mem = true;
+        n.blit_forward = r.blit_copy;
+        n.blit_phase = false;
+        if (r.blit_x == r.blit_width - 1) {
+          n.blit_x = 0;
+          if (r.blit_y == r.blit_height - 1)
+            n.blit_busy = false;
+          else
+            n.blit_y = r.blit_y + 1;
+        } else {
+          n.blit_x = r.blit_x + 1;
+        }
+      } else {
+        n.write_addr = pixel_address(
+            r.blit_src_front ? r.display_page : !r.display_page,
+            (r.blit_src_row + blit_dy) & 0x1ff,
+            (r.blit_src_col + blit_dx) & 0x3ff);
+        n.blit_phase = true;
+      }
+    } else if (r.packed_left != 0) {
+      n.write_addr =
+          pixel_address(!r.display_page, r.pointer_row, r.pointer_col);
+      n.write_data = r.packed_data & 63;
+      n.write_mem = true;
+      n.packed_data = r.packed_data >> 6;
+      n.packed_left = r.packed_left - 1;
+      if (r.pointer_col == 639) {
+        n.pointer_col = 0;
+        n.pointer_row = r.pointer_row == 479 ? 0 : r.pointer_row + 1;
+      } else {
+        n.pointer_col = r.pointer_col + 1;
+      }
+    } else if (chipselect && write && address == 0) {
+      n.write_addr = pixel_address(!r.display_page, writedata >> 16 & 0x1ff,
+                                   writedata >> 6 & 0x3ff);
+      n.write_data = writedata & 63;
+      n.write_mem = true;
+    }
+
+    // Register writes, as long as nothing is holding them off
+    if (chipselect && write && !held()) {
+      uint32_t row = writedata >> 16 & 0x1ff, col = writedata >> 6 & 0x3ff;
+      switch (address) {
+      case 1:
+        n.scroll_offset = writedata & 0x1ff;
+        break;
+      case 2:
+        n.fixed_start = writedata & 0x1ff;
+        break;
+      case 3:
+        n.pointer_row = row;
+        n.pointer_col = col;
+        break;
+      case 4:
+        n.packed_data = writedata & 0x3fffffff;
+        n.packed_left = 5;
+        break;
+      case 5:
+        n.flip_offset = writedata & 0x1ff;
+        n.flip_pending = true;
+#ifdef MODEL_FLIP_AT_ONCE
+        n.display_page = !r.display_page;
+        n.flip_pending = false;
+#endif
+        break;
+      case 6:
+        n.irq_enable = writedata & 1;
+        n.irq = false;
+        break;
+      case 7:
+        n.scroll_end = writedata >> 10 & 0x3ff;
+        n.scroll_first = writedata & 0x3ff;
+        break;
+      case 9:
+        n.blit_row = row;
+        n.blit_col = col;
+        break;
+      case 10:
+        n.blit_height = row;
+        n.blit_width = col;
+        break;
+      case 11:
+        n.blit_src_row = row;
+        n.blit_src_col = col;
+        break;
+      case 12:
+        n.blit_copy = writedata >> 31 & 1;
+        n.blit_src_front = writedata >> 30 & 1;
+        n.blit_color = writedata & 63;
+        n.blit_rows_up = (writedata >> 31 & 1) && r.blit_row > r.blit_src_row;
+        n.blit_cols_left =
+            (writedata >> 31 & 1) && r.blit_col > r.blit_src_col;
+        n.blit_x = 0;
+        n.blit_y = 0;
+        n.blit_phase = false;
+        n.blit_busy = r.blit_width != 0 && r.blit_height != 0;
+        break;
+      default: // 0, a pixel, and 8, the palette, are written above
+        break;
+      }
+    }
+
+    // Vertical sync is starting: flip pages and raise the vblank interrupt
+    n.vs_prev = vs;
+    if (r.vs_prev && !vs) {
+      if (r.flip_pending) {
+        n.display_page = !r.display_page;
+        n.scroll_offset = r.flip_offset;
+        n.flip_pending = false;
+      }
+      if (r.irq_enable)
+        n.irq = true;
+    }
+
+    r = n;
+  }
+};
+
+#endif /* VVGA_FRAMEBUFFER_H */
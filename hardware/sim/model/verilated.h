@@ -0,0 +1,33 @@
+/*
+ * Stand-in for Verilator's runtime, for building the testbenches and the
+ * co-simulation harness against the hand-written cycle models in this
+ * directory rather than Verilated RTL: "make MODEL=1 check"
+ *
+ * Each model (Vvga_framebuffer.h, Vnote_reader.h) is a line-by-line C++
+ * translation of its module, with the ports and the eval()/final() calls
+ * the Verilated class has, so the same testbench source builds against
+ * either. They are not generated from the RTL: when a module changes, its
+ * model has to be changed to match, and where the two disagree the RTL is
+ * right. Running the same testbenches under Verilator is the check that
+ * counts; the models are for when Verilator is not to hand, and are what
+ * "passes against the cycle model" in the history refers to.
+ */
+
+#ifndef VERILATED_H
+#define VERILATED_H
+
+#include <stdint.h>
+
+typedef uint8_t CData;  // Ports up to 8 bits wide
+typedef uint16_t SData; // Up to 16
+typedef uint32_t IData; // Up to 32
+
+struct VerilatedContext {};
+
+struct Verilated {
+  static void commandArgs(int argc, char **argv) {
+    (void)argc, (void)argv;
+  }
+};
+
+#endif /* VERILATED_H */
@@ -0,0 +1,294 @@
+/*
+ * Testbench for note_reader.sv
+ *
+ * Drives the controller pins and reads the peripheral's registers the way
+ * the driver does. Pins that bounce must give one event per settled change:
+ * a press or release that chatters for a while is queued once, stamped with
+ * the cycle the pin took its final level, and a glitch shorter than the
+ * debounce time is never queued at all. Two pins settling apart are two
+ * events; settling on the same cycle, one.
+ *
+ * Then more changes are made than the 16-entry FIFO holds without reading
+ * any: the first 16 must come out in order with their states and cycle
+ * stamps, the rest must be dropped rather than overwrite them, and the
+ * overflow bit must be set until the count register is read.
+ *
+ * Last, the interrupt: nothing until it is enabled, then held for as long
+ * as the FIFO is not empty, dropping when the last event is popped or when
+ * it is disabled again.
+ *
+ * "make note_reader_tb && ./note_reader_tb"; exits nonzero if anything is
+ * wrong.
+ */
+
+#include "Vnote_reader.h"
+#include "verilated.h"
+
+extern "C" {
+#include "guitar_reader.h"
+}
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+// The register map, as the driver and cosim.cpp use it
+enum {
+  NOTES_STATE = GUITAR_READER_REG_STATE,
+  NOTES_COUNT = GUITAR_READER_REG_FIFO_COUNT,
+  NOTES_EVENT_STATE = GUITAR_READER_REG_EVENT_STATE,
+  NOTES_EVENT_TIME = GUITAR_READER_REG_EVENT_TIME,
+  NOTES_NOW = GUITAR_READER_REG_CYCLE_COUNT,
+  NOTES_IRQ_CONTROL = GUITAR_READER_REG_IRQ_CONTROL,
+};
+
+const uint32_t NOTES_OVERFLOW = GUITAR_READER_FIFO_OVERFLOW,
+               NOTES_COUNT_MASK = GUITAR_READER_FIFO_COUNT_MASK;
+
+// note_reader.sv's defaults, which the Makefile builds it with
+const int DEBOUNCE_CYCLES = 50000, FIFO_DEPTH = GUITAR_READER_FIFO_DEPTH;
+
+// Any two of the seven inputs, {KEY[0], GPIO_1[5:0]}. The pins idle low
+// here, as the debounced state comes out of reset, so nothing is queued
+// before the first change
+const int GREEN = 1 << 0, RED = 1 << 1;
+
+struct Event {
+  uint32_t state, time;
+};
+
+class Bench {
+public:
+  Bench();
+  ~Bench();
+
+  uint32_t read(int address);
+  void write(int address, uint32_t data);
+  bool irq() const { return notes->irq; }
+  uint32_t set(int pins);
+  void run(int cycles);
+  Event pop();
+
+private:
+  VerilatedContext context;
+  Vnote_reader *notes;
+  uint32_t cycle = 0, offset = 0; // The peripheral's cycle count is both
+
+  void tick();
+};
+
+Bench::Bench() : notes(new Vnote_reader(&context)) {
+  notes->KEY = 0xE;
+  notes->GPIO_1 = 0;
+  notes->reset = 1;
+  for (int i = 0; i < 4; i++)
+    tick();
+  notes->reset = 0;
+  uint32_t now = cycle;
+  offset = read(NOTES_NOW) - now;
+}
+
+Bench::~Bench() {
+  notes->final();
+  delete notes;
+}
+
+void Bench::tick() {
+  notes->clk = 0;
+  notes->eval();
+  notes->clk = 1;
+  notes->eval();
+  cycle++;
+}
+
+// One Avalon read; the slave never asserts waitrequest
+uint32_t Bench::read(int address) {
+  notes->chipselect = 1;
+  notes->read = 1;
+  notes->address = address;
+  notes->eval();
+  uint32_t data = notes->readdata;
+  tick();
+  notes->chipselect = 0;
+  notes->read = 0;
+  notes->eval();
+  return data;
+}
+
+// One Avalon write, taken in a single cycle
+void Bench::write(int address, uint32_t data) {
+  notes->chipselect = 1;
+  notes->write = 1;
+  notes->address = address;
+  notes->writedata = data;
+  notes->eval();
+  tick();
+  notes->chipselect = 0;
+  notes->write = 0;
+  notes->eval();
+}
+
+// Drives the pins; returns the peripheral's cycle count as they change,
+// which the first synchronizer flop takes them on the edge after
+uint32_t Bench::set(int pins) {
+  notes->KEY = 0xE | (pins >> 6 & 1);
+  notes->GPIO_1 = pins & 0x3F;
+  notes->eval();
+  return cycle + offset;
+}
+
+void Bench::run(int cycles) {
+  for (int i = 0; i < cycles; i++)
+    tick();
+}
+
+Event Bench::pop() {
+  Event event;
+
+  event.state = read(NOTES_EVENT_STATE);
+  event.time = read(NOTES_EVENT_TIME);
+  return event;
+}
+
+int expect(const char *what, bool ok) {
+  printf("%-48s %s\n", what, ok ? "ok" : "WRONG");
+  return !ok;
+}
+
+// Pops one event and checks it is state, settled at the changed cycle
+int expect_event(const char *what, Bench &bench, uint32_t state,
+                 uint32_t changed) {
+  Event event = bench.pop();
+
+  if (event.state != state || event.time != changed + 1)
+    fprintf(stderr,
+            "note_reader_tb: %s: state %02x at cycle %u, expected %02x at "
+            "%u\n",
+            what, event.state, event.time, state, changed + 1);
+  return expect(what, event.state == state && event.time == changed + 1);
+}
+
+// Toggles between from and to, changes cycles apart, ending on to; returns
+// the cycle of the last change
+uint32_t bounce(Bench &bench, int from, int to, int changes, int cycles) {
+  uint32_t changed = 0;
+
+  for (int i = 0; i < changes; i++) {
+    changed = bench.set(i % 2 ? from : to);
+    bench.run(cycles);
+  }
+  if (changes % 2 == 0)
+    changed = bench.set(to);
+  return changed;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Verilated::commandArgs(argc, argv);
+  Bench bench;
+  uint32_t changed, second;
+  int wrong = 0;
+
+  printf("---NOTE READER TESTBENCH---\n");
+
+  // A press that chatters for about 10 ms, then holds
+  changed = bounce(bench, 0, GREEN, 21, DEBOUNCE_CYCLES / 2);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("Bouncing press queued once",
+                  (bench.read(NOTES_COUNT) & NOTES_COUNT_MASK) == 1);
+  wrong += expect_event("Stamped with its last bounce", bench, GREEN, changed);
+  wrong += expect("Debounced state pressed",
+                  bench.read(NOTES_STATE) == GREEN);
+
+  // And a release that chatters faster
+  changed = bounce(bench, GREEN, 0, 101, 700);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("Bouncing release queued once",
+                  (bench.read(NOTES_COUNT) & NOTES_COUNT_MASK) == 1);
+  wrong += expect_event("Release stamped with its last bounce", bench, 0,
+                        changed);
+
+  // Too short to be a press
+  bench.set(GREEN);
+  bench.run(DEBOUNCE_CYCLES - 100);
+  bench.set(0);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("Glitch not queued", bench.read(NOTES_COUNT) == 0);
+  wrong += expect("Glitch not in the state", bench.read(NOTES_STATE) == 0);
+
+  // Two pins settling apart, then released together
+  changed = bench.set(GREEN);
+  bench.run(DEBOUNCE_CYCLES / 4);
+  second = bench.set(GREEN | RED);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  uint32_t released = bench.set(0);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("Two pins apart, released together: 3 events",
+                  (bench.read(NOTES_COUNT) & NOTES_COUNT_MASK) == 3);
+  wrong += expect_event("First pin", bench, GREEN, changed);
+  wrong += expect_event("Second pin", bench, GREEN | RED, second);
+  wrong += expect_event("Both released", bench, 0, released);
+
+  // Reading an empty FIFO pops nothing
+  bench.pop();
+  wrong += expect("Empty FIFO stays empty", bench.read(NOTES_COUNT) == 0);
+
+  // More changes than the FIFO holds, none of them read
+  std::vector<uint32_t> times;
+  for (int i = 0; i < FIFO_DEPTH + 4; i++) {
+    times.push_back(bench.set(i % 2 ? 0 : RED));
+    bench.run(DEBOUNCE_CYCLES + 100);
+  }
+  uint32_t count = bench.read(NOTES_COUNT);
+  wrong += expect("FIFO full", (count & NOTES_COUNT_MASK) == FIFO_DEPTH);
+  wrong += expect("Overflow flagged", count & NOTES_OVERFLOW);
+  wrong += expect("Reading the count clears overflow",
+                  !(bench.read(NOTES_COUNT) & NOTES_OVERFLOW));
+
+  int lost = 0;
+  for (int i = 0; i < FIFO_DEPTH; i++) {
+    Event event = bench.pop();
+    uint32_t state = i % 2 ? 0 : RED;
+    if (event.state != state || event.time != times[i] + 1) {
+      fprintf(stderr,
+              "note_reader_tb: event %d: state %02x at cycle %u, expected "
+              "%02x at %u\n",
+              i, event.state, event.time, state, times[i] + 1);
+      lost++;
+    }
+  }
+  wrong += expect("The first 16 kept, in order, with their stamps",
+                  lost == 0);
+  wrong += expect("The rest dropped", bench.read(NOTES_COUNT) == 0);
+
+  // Room again: the next change is queued as usual. The last four dropped
+  // left the pin released
+  changed = bench.set(RED);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("Queued again after draining",
+                  bench.read(NOTES_COUNT) == 1);
+  wrong += expect_event("Stamped as usual", bench, RED, changed);
+
+  // The interrupt, with an event waiting and without
+  bench.set(0);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("No irq while disabled", !bench.irq());
+  bench.write(NOTES_IRQ_CONTROL, GUITAR_READER_IRQ_ENABLE);
+  wrong += expect("Irq once enabled with an event waiting", bench.irq());
+  wrong += expect("Enable reads back", bench.read(NOTES_IRQ_CONTROL) ==
+                                           GUITAR_READER_IRQ_ENABLE);
+  bench.pop();
+  wrong += expect("Irq drops when the FIFO empties", !bench.irq());
+  bench.set(RED);
+  bench.run(2 * DEBOUNCE_CYCLES);
+  wrong += expect("Irq raised by the next event", bench.irq());
+  bench.write(NOTES_IRQ_CONTROL, 0);
+  wrong += expect("Irq drops when disabled", !bench.irq() &&
+                                                 bench.read(NOTES_COUNT) == 1);
+
+  printf("Wrong: %d\n", wrong);
+  return wrong != 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Packed pixel write testbench for vga_framebuffer.sv
+ *
+ * Drives the write pointer and packed write registers directly: a whole
+ * page is drawn from one pointer write, as 61,440 packed words in a row,
+ * so the pointer has to wrap at the end of every row and from the last row
+ * back to the first. Then single words are written across the end of a row
+ * and across the end of the last row, part of the word on either side.
+ * A reference model of both pages is kept alongside, and each page is
+ * flipped on screen and every scanned-out pixel checked against it, which
+ * also checks the five pixels of a word land in order, [5:0] first.
+ *
+ * Every word holds waitrequest while its pixels drain, one a cycle: the
+ * next access, packed or not, must be held off for exactly that long and
+ * take effect only after, so a pointer write never splits a word.
+ *
+ * "make packed_tb && ./packed_tb"; exits nonzero if anything is wrong.
+ */
+
+#include "vga_bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace {
+
+class Bench : public VgaBench {
+public:
+  Bench() : front(WIDTH * HEIGHT), back(WIDTH * HEIGHT) {}
+
+  // What the hardware should hold: the page on screen and the one drawn
+  Page front, back;
+
+  int pointer(int row, int col);
+  int packed(const uint8_t pixels[PIXELS_PER_WORD]);
+  void flip();
+
+private:
+  int row = 0, col = 0; // Where the model's write pointer is
+};
+
+// Returns the cycles the write was held for
+int Bench::pointer(int row, int col) {
+  this->row = row;
+  this->col = col;
+  return write(VGA_FRAMEBUFFER_REG_WRITE_POINTER,
+               VGA_FRAMEBUFFER_POINTER(row, col));
+}
+
+// Writes five pixels at the pointer, advancing it as the hardware should;
+// returns the cycles the write was held for
+int Bench::packed(const uint8_t pixels[PIXELS_PER_WORD]) {
+  uint32_t word = 0;
+
+  for (int i = PIXELS_PER_WORD - 1; i >= 0; i--)
+    word = word << 6 | pixels[i];
+  for (int i = 0; i < PIXELS_PER_WORD; i++) {
+    back[row * WIDTH + col] = pixels[i];
+    if (++col == WIDTH) {
+      col = 0;
+      row = (row + 1) % HEIGHT;
+    }
+  }
+  return write(VGA_FRAMEBUFFER_REG_PACKED_PIXELS, word);
+}
+
+// Shows the page drawn so far, and scans it out for a whole frame
+void Bench::flip() {
+  write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+  run_to_vsync();
+  run_to_vsync();
+  front.swap(back);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Verilated::commandArgs(argc, argv);
+  Bench bench;
+  uint8_t pixels[PIXELS_PER_WORD];
+  int wrong = 0, held = 0, words = 0;
+
+  printf("---PACKED WRITE TESTBENCH---\n");
+  bench.load_test_palette();
+
+  // A whole page from one pointer write, then one word more, which has to
+  // land back at the top left. No two neighbouring pixels match, so a
+  // pixel out of place within its word shows
+  bench.pointer(0, 0);
+  for (int i = 0; i <= WIDTH * HEIGHT; i += PIXELS_PER_WORD) {
+    for (int p = 0; p < PIXELS_PER_WORD; p++)
+      pixels[p] = (i + p + i / WIDTH) % VGA_FRAMEBUFFER_PALETTE_SIZE;
+    held += bench.packed(pixels);
+    words++;
+  }
+  bench.flip();
+  wrong += check_frame("packed_tb", "Whole page, wrapping every row", bench,
+                       bench.front);
+
+  // Back to back, every word after the first waits for the one before
+  wrong += expect("Each word held off while the last drains",
+                  held == (words - 1) * PIXELS_PER_WORD);
+
+  // The other page: the same, then words straddling the end of a row and
+  // the end of the last row
+  bench.pointer(0, 0);
+  for (int i = 0; i < WIDTH * HEIGHT; i += PIXELS_PER_WORD) {
+    for (int p = 0; p < PIXELS_PER_WORD; p++)
+      pixels[p] = (i + p + 2 * (i / WIDTH) + 7) % VGA_FRAMEBUFFER_PALETTE_SIZE;
+    bench.packed(pixels);
+  }
+  const uint8_t across_row[PIXELS_PER_WORD] = {11, 12, 13, 14, 15};
+  const uint8_t across_page[PIXELS_PER_WORD] = {21, 22, 23, 24, 25};
+  bench.pointer(50, WIDTH - 3);
+  bench.packed(across_row);
+  bench.pointer(HEIGHT - 1, WIDTH - 2);
+  bench.packed(across_page);
+
+  // A pointer write right behind a word waits for it to drain, so the
+  // word's pixels all go where the pointer was
+  const uint8_t before_pointer[PIXELS_PER_WORD] = {31, 32, 33, 34, 35};
+  const uint8_t after_pointer[PIXELS_PER_WORD] = {41, 42, 43, 44, 45};
+  bench.pointer(200, 100);
+  bench.packed(before_pointer);
+  held = bench.pointer(300, 400);
+  wrong += expect("Pointer write held off by a word", held == PIXELS_PER_WORD);
+  bench.packed(after_pointer);
+
+  bench.flip();
+  wrong += check_frame("packed_tb",
+                       "Words across a row, the page and a pointer", bench,
+                       bench.front);
+
+  printf("Wrong: %d\n", wrong);
+  return wrong != 0;
+}
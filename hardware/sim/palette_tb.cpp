@@ -0,0 +1,134 @@
+/*
+ * Palette testbench for vga_framebuffer.sv
+ *
+ * Shows a page of 64 stripes, one per color index, and checks the full
+ * 24-bit color of every scanned-out pixel. The palette must come up with
+ * the colors software uses (colors.c) and white everywhere else; after
+ * every entry is rewritten, the next frame must show the new colors. A
+ * write halfway down the screen must recolor its index from the next row
+ * scanned out, leaving the rows above as they were. A palette write held
+ * off by waitrequest behind a packed write must still land, and so must
+ * one made while a blit runs, which must not be held off at all.
+ *
+ * "make palette_tb && ./palette_tb"; exits nonzero if any pixel is wrong.
+ */
+
+#include "vga_bench.h"
+
+extern "C" {
+#include "colors.h"
+}
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace {
+
+const int STRIPE = WIDTH / VGA_FRAMEBUFFER_PALETTE_SIZE;
+
+class Bench : public VgaBench {
+public:
+  void fill(int col, int width, int color);
+};
+
+// Starts filling columns of the page not on screen; see drain()
+void Bench::fill(int col, int width, int color) {
+  write(VGA_FRAMEBUFFER_REG_BLIT_DEST, VGA_FRAMEBUFFER_POINTER(0, col));
+  write(VGA_FRAMEBUFFER_REG_BLIT_SIZE, VGA_FRAMEBUFFER_POINTER(HEIGHT, width));
+  write(VGA_FRAMEBUFFER_REG_BLIT_START, color);
+}
+
+uint32_t rgb(const RGB &color) {
+  return color.R << 16 | color.G << 8 | color.B;
+}
+
+// What each index should be after the rewrite: every one different
+uint32_t rewritten(int index) {
+  return (0xFF - index) << 16 | index << 10 | (index * 37 & 0xFF);
+}
+
+// Counts the pixels of the last frame that are not colors[their stripe],
+// or from row on, changed[their stripe]
+int check(const char *what, const Bench &bench, const uint32_t *colors,
+          const uint32_t *changed = NULL, int row = HEIGHT) {
+  int wrong = 0;
+
+  for (int y = 0; y < HEIGHT; y++)
+    for (int x = 0; x < WIDTH; x++) {
+      int index = x / STRIPE;
+      uint32_t expected = y < row ? colors[index] : changed[index];
+      uint32_t pixel = bench.shown[y * WIDTH + x];
+      if (pixel == expected)
+        continue;
+      if (wrong < 10)
+        fprintf(stderr,
+                "palette_tb: %s: (%d, %d) shows %06x, expected %06x\n", what,
+                x, y, pixel, expected);
+      wrong++;
+    }
+  printf("%-44s %s\n", what, wrong ? "WRONG" : "ok");
+  return wrong;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Verilated::commandArgs(argc, argv);
+  Bench bench;
+  uint32_t colors[VGA_FRAMEBUFFER_PALETTE_SIZE];
+  uint32_t changed[VGA_FRAMEBUFFER_PALETTE_SIZE];
+  int wrong = 0;
+
+  printf("---PALETTE TESTBENCH---\n");
+
+  // A stripe of each index, on both pages
+  for (int page = 0; page < 2; page++) {
+    for (int i = 0; i < VGA_FRAMEBUFFER_PALETTE_SIZE; i++) {
+      bench.fill(i * STRIPE, STRIPE, i);
+      bench.drain();
+    }
+    bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+    bench.run_to_vsync();
+  }
+
+  // Power-on colors
+  for (int i = 0; i < VGA_FRAMEBUFFER_PALETTE_SIZE; i++)
+    colors[i] = i < COLOR_COUNT ? rgb(palette[i]) : 0xFFFFFF;
+  bench.run_to_vsync();
+  wrong += check("Power-on palette", bench, colors);
+
+  // Every entry rewritten
+  for (int i = 0; i < VGA_FRAMEBUFFER_PALETTE_SIZE; i++) {
+    colors[i] = rewritten(i);
+    bench.write(VGA_FRAMEBUFFER_REG_PALETTE, i << 24 | colors[i]);
+  }
+  bench.run_to_vsync();
+  bench.run_to_vsync();
+  wrong += check("Every entry rewritten", bench, colors);
+
+  // Recoloring one index halfway down the screen: from the next row on
+  std::copy(colors, colors + VGA_FRAMEBUFFER_PALETTE_SIZE, changed);
+  changed[5] = 0x123456;
+  bench.run_to_row(HEIGHT / 2);
+  bench.write(VGA_FRAMEBUFFER_REG_PALETTE, 5 << 24 | changed[5]);
+  bench.run_to_vsync();
+  wrong += check("Recolored mid-frame", bench, colors, changed, HEIGHT / 2);
+  bench.run_to_vsync();
+  wrong += check("Recolored: next frame", bench, changed);
+
+  // Behind a packed write, held off by waitrequest, and during a blit
+  changed[6] = 0x654321;
+  changed[63] = 0xABCDEF;
+  bench.write(VGA_FRAMEBUFFER_REG_PACKED_PIXELS, 0);
+  bench.write(VGA_FRAMEBUFFER_REG_PALETTE, 6 << 24 | changed[6]);
+  bench.fill(0, STRIPE, 0);
+  int held = bench.write(VGA_FRAMEBUFFER_REG_PALETTE, 63 << 24 | changed[63]);
+  bench.run_to_vsync();
+  bench.run_to_vsync();
+  wrong += check("After a packed write and during a blit", bench, changed);
+  wrong += expect("Not held off by the blit", held == 0);
+
+  printf("Wrong pixels: %d\n", wrong);
+  return wrong != 0;
+}
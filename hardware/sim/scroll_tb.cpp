@@ -0,0 +1,129 @@
+/*
+ * Hardware scroll testbench for vga_framebuffer.sv
+ *
+ * Draws a page in which every row and column can be told apart, shows it,
+ * then sets the scroll offset, fixed start and scroll columns and checks
+ * every pixel of the next frame against where it should have been read
+ * from. Screen row y of the scrolling region shows buffer row
+ * (y + scroll_offset) mod fixed_start, so with the whole screen scrolling
+ * the read address has to wrap at row 480, and with a fixed region it has
+ * to wrap at fixed_start instead. Rows at and below fixed_start, and the
+ * columns outside the scroll columns, must never move. Last, a page flip
+ * loads a scroll offset of its own.
+ *
+ * "make scroll_tb && ./scroll_tb"; exits nonzero if any pixel is wrong.
+ */
+
+#include "vga_bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace {
+
+struct Scroll {
+  int offset, fixed_start, first_column, end_column;
+};
+
+class Bench : public VgaBench {
+public:
+  void draw(const Page &page);
+  void scroll(const Scroll &scroll);
+};
+
+// Draws the page not on screen with packed writes
+void Bench::draw(const Page &page) {
+  write(VGA_FRAMEBUFFER_REG_WRITE_POINTER, VGA_FRAMEBUFFER_POINTER(0, 0));
+  for (int i = 0; i < WIDTH * HEIGHT; i += PIXELS_PER_WORD) {
+    uint32_t word = 0;
+    for (int p = PIXELS_PER_WORD - 1; p >= 0; p--)
+      word = word << 6 | page[i + p];
+    write(VGA_FRAMEBUFFER_REG_PACKED_PIXELS, word);
+  }
+}
+
+// Takes effect on the pixels scanned out after it; wait for the next frame
+void Bench::scroll(const Scroll &scroll) {
+  write(VGA_FRAMEBUFFER_REG_SCROLL_OFFSET, scroll.offset);
+  write(VGA_FRAMEBUFFER_REG_FIXED_START, scroll.fixed_start);
+  write(VGA_FRAMEBUFFER_REG_SCROLL_COLUMNS,
+        scroll.end_column << 10 | scroll.first_column);
+}
+
+// Scans out the next whole frame and counts the pixels that differ from
+// expected
+int check_next_frame(const char *what, Bench &bench, const Page &expected) {
+  bench.run_to_vsync();
+  return check_frame("scroll_tb", what, bench, expected);
+}
+
+// What the screen should show of page when scrolled
+Page scrolled(const Page &page, const Scroll &scroll) {
+  Page screen(WIDTH * HEIGHT);
+
+  for (int y = 0; y < HEIGHT; y++)
+    for (int x = 0; x < WIDTH; x++) {
+      int row = y;
+      if (y < scroll.fixed_start && x >= scroll.first_column &&
+          x < scroll.end_column)
+        row = (y + scroll.offset) % scroll.fixed_start;
+      screen[y * WIDTH + x] = page[row * WIDTH + x];
+    }
+  return screen;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Verilated::commandArgs(argc, argv);
+  Bench bench;
+  Page pattern(WIDTH * HEIGHT);
+  int wrong = 0;
+
+  // Neighbouring rows and columns differ, and so do rows 64 apart (or any
+  // multiple of it), in the leftmost 80 columns at least
+  for (int y = 0; y < HEIGHT; y++)
+    for (int x = 0; x < WIDTH; x++)
+      pattern[y * WIDTH + x] = (y + x + y / 64 * (x / 80 + 1)) % 64;
+
+  printf("---SCROLL TESTBENCH---\n");
+  bench.load_test_palette();
+  bench.draw(pattern);
+  bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, 0);
+  bench.run_to_vsync();
+
+  const struct {
+    const char *what;
+    Scroll scroll;
+  } cases[] = {
+      // The whole screen scrolling, wrapping at row 480
+      {"Not scrolled", {0, HEIGHT, 0, WIDTH}},
+      {"Whole screen by 1: row 479 shows row 0", {1, HEIGHT, 0, WIDTH}},
+      {"Whole screen by 240", {240, HEIGHT, 0, WIDTH}},
+      {"Whole screen by 479: row 1 shows row 0", {479, HEIGHT, 0, WIDTH}},
+      // The game's highway: rows from 432 down, and the side panels, fixed
+      {"Highway by 100, wrapping at 432", {100, 432, 245, 395}},
+      {"Highway by 431, wrapping at 432", {431, 432, 245, 395}},
+      {"Scroll columns 0 to 1", {7, 432, 0, 1}},
+      {"Scroll columns 639 to 640", {7, 432, WIDTH - 1, WIDTH}},
+      {"Fixed from row 240, by 239", {239, 240, 0, WIDTH}},
+  };
+  for (const auto &c : cases) {
+    bench.scroll(c.scroll);
+    bench.run_to_vsync();
+    wrong += check_next_frame(c.what, bench, scrolled(pattern, c.scroll));
+  }
+
+  // A flip brings its own offset, for the page it shows
+  const Scroll highway = {50, 432, 245, 395};
+  bench.scroll({0, highway.fixed_start, highway.first_column,
+                highway.end_column});
+  bench.draw(pattern);
+  bench.write(VGA_FRAMEBUFFER_REG_PAGE_FLIP, highway.offset);
+  bench.run_to_vsync();
+  wrong += check_next_frame("Offset loaded by a flip", bench,
+                            scrolled(pattern, highway));
+
+  printf("Wrong pixels: %d\n", wrong);
+  return wrong != 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Fixture shared by the vga_framebuffer.sv testbenches; see vga_bench.h
+ */
+
+#include "vga_bench.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+VgaBench::VgaBench()
+    : shown(WIDTH * HEIGHT, NOT_SHOWN), vga(new Vvga_framebuffer(&context)),
+      scanning(WIDTH * HEIGHT, NOT_SHOWN) {
+  vga->reset = 1;
+  for (int i = 0; i < 4; i++)
+    tick();
+  vga->reset = 0;
+}
+
+VgaBench::~VgaBench() {
+  vga->final();
+  delete vga;
+}
+
+// One clock cycle, following the beam as it goes. The DAC latches a pixel
+// on the rising edge of VGA_CLK, so it gets what was out before the edge
+void VgaBench::tick() {
+  bool blank_n = vga->VGA_BLANK_n;
+  uint32_t rgb = vga->VGA_R << 16 | vga->VGA_G << 8 | vga->VGA_B;
+
+  vga->clk = 0;
+  vga->eval();
+  vga->clk = 1;
+  vga->eval();
+  cycle++;
+
+  if (vga->VGA_CLK && !last_vga_clk && blank_n && beam_x < WIDTH &&
+      beam_y < HEIGHT)
+    scanning[beam_y * WIDTH + beam_x++] = rgb;
+  if (last_blank_n && !vga->VGA_BLANK_n && beam_x) {
+    beam_x = 0;
+    beam_y++;
+  }
+  if (last_vs && !vga->VGA_VS) {
+    shown.swap(scanning);
+    std::fill(scanning.begin(), scanning.end(), NOT_SHOWN);
+    beam_x = beam_y = 0;
+    vs_fell = cycle;
+  }
+
+  last_vga_clk = vga->VGA_CLK;
+  last_blank_n = vga->VGA_BLANK_n;
+  last_vs = vga->VGA_VS;
+  ticked();
+}
+
+// One Avalon write, held until the slave stops asserting waitrequest;
+// returns the cycles it was held for
+int VgaBench::write(int address, uint32_t data) {
+  int held = 0;
+
+  vga->chipselect = 1;
+  vga->write = 1;
+  vga->address = address;
+  vga->writedata = data;
+  vga->eval();
+  for (; vga->waitrequest; held++)
+    tick();
+  tick();
+  vga->chipselect = 0;
+  vga->write = 0;
+  vga->eval();
+  return held;
+}
+
+// One Avalon read; the slave answers in the same cycle
+uint32_t VgaBench::read(int address) {
+  vga->chipselect = 1;
+  vga->read = 1;
+  vga->address = address;
+  vga->eval();
+  uint32_t data = vga->readdata;
+  tick();
+  vga->chipselect = 0;
+  vga->read = 0;
+  vga->eval();
+  return data;
+}
+
+// Polls the status register, as the driver does, until whatever the last
+// write started is done; returns the cycle it read back idle
+uint64_t VgaBench::drain() {
+  while (read(VGA_FRAMEBUFFER_REG_STATUS) & VGA_FRAMEBUFFER_STATUS_BUSY)
+    ;
+  return cycle;
+}
+
+void VgaBench::run(int cycles) {
+  for (int i = 0; i < cycles; i++)
+    tick();
+}
+
+// Until the beam has finished the visible rows above row; HEIGHT is the
+// front porch, after the last visible row and before vertical sync
+void VgaBench::run_to_row(int row) {
+  while (beam_y != row)
+    tick();
+}
+
+// Until the next falling edge of VGA_VS, when shown holds the frame before
+void VgaBench::run_to_vsync() {
+  uint64_t last = vs_fell;
+  while (vs_fell == last)
+    tick();
+}
+
+void VgaBench::load_test_palette() {
+  for (int i = 0; i < VGA_FRAMEBUFFER_PALETTE_SIZE; i++)
+    write(VGA_FRAMEBUFFER_REG_PALETTE, (uint32_t)i << 24 | test_color(i));
+}
+
+uint32_t test_color(int index) {
+  return (index << 2) << 16 | 0x80 << 8 | (0xFF - index);
+}
+
+int check_frame(const char *name, const char *what, const VgaBench &bench,
+                const Page &expected) {
+  int wrong = 0;
+
+  for (int i = 0; i < WIDTH * HEIGHT; i++) {
+    uint32_t pixel = bench.shown[i];
+    if (pixel == test_color(expected[i]))
+      continue;
+    if (wrong < 10)
+      fprintf(stderr, "%s: %s: (%d, %d) shows %06x (%d), expected %d\n",
+              name, what, i % WIDTH, i / WIDTH, pixel, (int)(pixel >> 18),
+              expected[i]);
+    wrong++;
+  }
+  printf("%-44s %s\n", what, wrong ? "WRONG" : "ok");
+  return wrong;
+}
+
+int expect(const char *what, bool ok) {
+  printf("%-44s %s\n", what, ok ? "ok" : "WRONG");
+  return !ok;
+}
@@ -0,0 +1,80 @@
+/*
+ * Fixture shared by the vga_framebuffer.sv testbenches
+ *
+ * Holds the Verilated peripheral, makes Avalon writes to it the way the
+ * bridge does and follows the beam, keeping the last frame scanned out in
+ * full. Register addresses and bits come from vga_framebuffer.h, as the
+ * driver and cosim.cpp use them.
+ */
+
+#ifndef VGA_BENCH_H
+#define VGA_BENCH_H
+
+#include "Vvga_framebuffer.h"
+#include "verilated.h"
+
+extern "C" {
+#include "global_consts.h"
+#include "vga_framebuffer.h"
+}
+
+#include <stdint.h>
+#include <vector>
+
+const int WIDTH = VGA_SCREEN_WIDTH, HEIGHT = VGA_SCREEN_HEIGHT;
+
+typedef std::vector<uint8_t> Page;   // Color indices, row by row
+typedef std::vector<uint32_t> Frame; // 24-bit colors, row by row
+
+// In a Frame: a pixel the beam never showed
+const uint32_t NOT_SHOWN = 0xFFFFFFFF;
+
+class VgaBench {
+public:
+  VgaBench();
+  virtual ~VgaBench();
+
+  // The last frame scanned out in full
+  Frame shown;
+  int beam_y = 0;       // Visible rows finished in the frame being scanned
+  uint64_t cycle = 0;   // Clock cycles since reset
+  uint64_t vs_fell = 0; // Cycle of the last falling edge of VGA_VS
+
+  bool irq() const { return vga->irq; }
+
+  int write(int address, uint32_t data);
+  uint32_t read(int address);
+  uint64_t drain();
+  void run(int cycles);
+  void run_to_row(int row);
+  void run_to_vsync();
+  void load_test_palette();
+
+protected:
+  VerilatedContext context;
+  Vvga_framebuffer *vga;
+
+  // Called after every cycle, for testbenches that watch other outputs
+  virtual void ticked() {}
+
+private:
+  Frame scanning; // The frame being scanned out
+  int beam_x = 0;
+  bool last_vga_clk = false, last_blank_n = false, last_vs = true;
+
+  void tick();
+};
+
+// What load_test_palette() shows index as: its red alone tells it apart
+uint32_t test_color(int index);
+
+// Counts the pixels of the bench's last frame that do not show expected
+// through the test palette, reporting the first few as name: what; prints
+// what with ok or WRONG
+int check_frame(const char *name, const char *what, const VgaBench &bench,
+                const Page &expected);
+
+// Prints what with ok or WRONG; returns 1 if wrong
+int expect(const char *what, bool ok);
+
+#endif /* VGA_BENCH_H */
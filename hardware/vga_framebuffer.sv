@@ -8,10 +8,14 @@
 module vga_framebuffer (
     input logic clk,
     input logic reset,
-    input logic [31:0] writedata,  // Format: {9 unused bits, 17-bit pixel number, 6-bit pixel data}
+    input logic [31:0] writedata,  // See register map below
     input logic write,
+    input logic read,
     input chipselect,
-    input logic [1:0] address,  // Unused, because a 17-bit address is weird
+    input logic [3:0] address,
+    output logic [31:0] readdata,
+    output logic waitrequest,
+    output logic irq,
 
     output logic [7:0] VGA_R,
     VGA_G,
@@ -23,19 +27,123 @@ module vga_framebuffer (
     output logic       VGA_SYNC_n
 );
 
+  /*
+   * Register map (word addresses):
+   *  0: pixel write    {7 unused bits, 9-bit row, 10-bit column, 6-bit data}
+   *  1: scroll offset  {23 unused bits, 9-bit row offset}
+   *  2: fixed start    {23 unused bits, 9-bit first non-scrolling row}
+   *  3: write pointer  {7 unused bits, 9-bit row, 10-bit column, 6 unused}
+   *  4: packed write   {2 unused bits, 5 x 6-bit pixel data, first in [5:0]}
+   *  5: page flip      {23 unused bits, 9-bit scroll offset for the new page}
+   *  6: irq control    {31 unused bits, vblank interrupt enable}
+   *  7: scroll columns {12 unused bits, 10-bit end column, 10-bit first}
+   *  8: palette write  {2 unused bits, 6-bit color index, 24-bit RGB}
+   *  9: blit dest      {7 unused bits, 9-bit row, 10-bit column, 6 unused}
+   * 10: blit size      {7 unused bits, 9-bit height, 10-bit width, 6 unused}
+   * 11: blit source    {7 unused bits, 9-bit row, 10-bit column, 6 unused}
+   * 12: blit start     {1-bit copy, 1-bit source on screen, 24 unused bits,
+   *                     6-bit fill color}
+   * 13: status (read)  {31 unused bits, busy: a blit or packed pixels still
+   *                     being written}
+   *
+   * The whole 640x480 screen comes from the buffer. Pixels above fixed_start
+   * and in the scroll columns form the scrolling region: screen row y shows
+   * buffer row (y + scroll_offset) mod fixed_start there. Everything else is
+   * never scrolled, so the strike line and the side panels can live there.
+   * Software must keep scroll_offset < fixed_start.
+   *
+   * Each packed write stores its five pixels at the write pointer, which
+   * advances across the 640 columns of a row, then to the next row,
+   * wrapping from the last row back to the first. The pixels are written one
+   * per cycle, so waitrequest holds off the next write while they drain.
+   *
+   * There are two pages: one is scanned out while all writes go to the
+   * other. A page flip swaps them, and loads the new page's scroll offset,
+   * at the start of the next vertical sync so a frame is never shown half
+   * drawn. The same edge raises irq when enabled; any write to the irq
+   * control register acknowledges it.
+   *
+   * Pixels hold color indices, which go out through a 64-entry palette RAM.
+   * A palette write changes every pixel of that index from the next one
+   * scanned out, so recoloring a whole lane is one write. The palette comes
+   * up with the colors software uses (colors.c).
+   *
+   * The blitter fills a rectangle of the page being drawn with one color, a
+   * pixel a cycle, or copies a rectangle into it, a pixel every two cycles,
+   * from either page. Overlapping copies within a page come out as if the
+   * source were read first. The blit start write is taken at once and the
+   * blit runs on its own. A write that would change what it draws (pixel,
+   * packed, page flip or blit registers) is held off by waitrequest until it
+   * is done, so software polls busy in the status register first; reads and
+   * every other write go straight through, and a long blit never holds up
+   * the bus. Software keeps rectangles on screen.
+   */
+
+  localparam BUFFER_WIDTH = 10'd640, BUFFER_HEIGHT = 9'd480, PIXELS_PER_WORD = 3'd5;
+  localparam PAGE_PIXELS = 20'd307200;  // 640 x 480
+
   logic [10:0] hcount;
   logic [ 9:0] vcount;
   logic [ 8:0] pixel_y;
   logic [ 9:0] pixel_x;
-  logic [16:0] read_addr, write_addr;
+  logic line_end;
+  logic [19:0] read_addr, write_addr;  // Pixel number across both pages
+  logic [ 8:0] scroll_offset, fixed_start, scrolled_y;
+  logic [ 9:0] scroll_sum, scroll_first, scroll_end;
+  logic scroll_column;
 
-  logic [7:0] background_r, background_g, background_b;
   logic [5:0] write_data, pixel_data;
   logic write_mem;
 
-  assign pixel_y   = vcount[8:0];
-  assign pixel_x   = hcount[10:1] - 10'd244;  // Offset by 1 b/c we need a clock cycle to read
-  assign read_addr = {pixel_y, pixel_x[7:0]};
+  logic [ 8:0] pointer_row;
+  logic [ 9:0] pointer_col;
+  logic [29:0] packed_data;
+  logic [ 2:0] packed_left;  // Pixels of packed_data still to be written
+
+  logic display_page, flip_pending, irq_enable, vs_prev;
+  logic [23:0] palette[63:0];
+  logic [23:0] pixel_rgb;
+
+  logic [8:0] blit_row, blit_height, blit_src_row, blit_y, blit_dy;
+  logic [9:0] blit_col, blit_width, blit_src_col, blit_x, blit_dx;
+  logic [5:0] blit_color, blit_pixel;
+  logic blit_busy, blit_copy, blit_src_front, blit_rows_up, blit_cols_left;
+  logic blit_holds;    // The write would change what a running blit draws
+  logic blit_phase;    // Copies: 0 reads the source pixel, 1 writes it
+  logic blit_forward;  // The memory writes the pixel it just read
+  logic [8:0] flip_offset;
+
+  // Rows are packed end to end, and so are the pages: row * 640 is two
+  // shifts and an add
+  function automatic logic [19:0] pixel_address(logic page, logic [8:0] row, logic [9:0] col);
+    pixel_address = (page ? PAGE_PIXELS : 20'd0) + {2'd0, row, 9'd0} + {4'd0, row, 7'd0} +
+        {10'd0, col};
+  endfunction
+
+  assign blit_holds = address == 4'd0 || address == 4'd4 || address == 4'd5 || address >= 4'd9;
+  assign waitrequest = chipselect && write && (packed_left != 3'd0 || blit_busy && blit_holds);
+  assign readdata = chipselect && read && address == 4'd13 ?
+      {31'd0, blit_busy || packed_left != 3'd0} : 32'd0;
+
+  // Where the blit is within its rectangle, walked backwards along an axis
+  // when a copy moves pixels that way, so no source is overwritten first
+  assign blit_dy = blit_rows_up ? blit_height - 9'd1 - blit_y : blit_y;
+  assign blit_dx = blit_cols_left ? blit_width - 10'd1 - blit_x : blit_x;
+
+  // Offset by 1 b/c we need a clock cycle to read. The pixel after the last
+  // of a line is the first of the next one, not one past the end of the row
+  assign line_end  = hcount[10:1] == 10'd799;
+  assign pixel_y   = line_end ? (vcount == 10'd524 ? 9'd0 : vcount[8:0] + 9'd1) : vcount[8:0];
+  assign pixel_x   = line_end ? 10'd0 : hcount[10:1] + 10'd1;
+  assign scroll_sum = pixel_y + scroll_offset;
+  assign scroll_column = pixel_x >= scroll_first && pixel_x < scroll_end;
+  assign read_addr = pixel_address(display_page, scrolled_y, pixel_x);
+
+  // Wrap the scrolling region modulo its height; leave the fixed region alone
+  always_comb
+    if (pixel_y >= fixed_start || !scroll_column) scrolled_y = pixel_y;
+    else if (scroll_sum >= {1'b0, fixed_start}) scrolled_y = scroll_sum[8:0] - fixed_start;
+    else scrolled_y = scroll_sum[8:0];
 
   vga_counters counters (
       .clk50(clk),
@@ -48,76 +156,178 @@ module vga_framebuffer (
       .ra(read_addr),
       .wa(write_addr),
       .write(write_mem),
-      .wd(write_data),
-      .rd(pixel_data)
+      .wd(blit_forward ? blit_pixel : write_data),
+      .rd(pixel_data),
+      .wrd(blit_pixel)
   );
 
   always_ff @(posedge clk)
     if (reset) begin
-      background_r <= 8'h0;
-      background_g <= 8'h0;
-      background_b <= 8'h80;
-      write_addr <= 17'h0;
+      write_addr <= 20'h0;
       write_data <= 8'h0;
       write_mem <= 1'd0;
+      scroll_offset <= 9'd0;
+      fixed_start <= 9'd480;  // Whole screen scrolls by default
+      scroll_first <= 10'd0;
+      scroll_end <= BUFFER_WIDTH;
+      pointer_row <= 9'd0;
+      pointer_col <= 10'd0;
+      packed_data <= 30'd0;
+      packed_left <= 3'd0;
+      display_page <= 1'd0;
+      flip_pending <= 1'd0;
+      flip_offset <= 9'd0;
+      irq_enable <= 1'd0;
+      irq <= 1'd0;
+      vs_prev <= 1'd1;
+      blit_busy <= 1'd0;
+      blit_forward <= 1'd0;
     end else begin
       write_mem <= 1'd0;
-      if (chipselect && write) begin
-        //write_addr <= 17'd5;
-        write_addr <= writedata[22:6];  // Extracting 17-bit pixel number from writedata
-        write_data <= writedata[5:0];  // Extracting 8-bit pixel data from writedata
+      blit_forward <= 1'd0;
+      if (blit_busy) begin
+        if (!blit_copy || blit_phase) begin
+          write_addr <= pixel_address(~display_page, blit_row + blit_dy, blit_col + blit_dx);
+          write_data <= blit_color;
+          write_mem <= 1'd1;
+          blit_forward <= blit_copy;  // Copies write what was just read
+          blit_phase <= 1'd0;
+          if (blit_x == blit_width - 10'd1) begin
+            blit_x <= 10'd0;
+            if (blit_y == blit_height - 9'd1) blit_busy <= 1'd0;
+            else blit_y <= blit_y + 9'd1;
+          end else blit_x <= blit_x + 10'd1;
+        end else begin
+          // Read the source pixel; it comes out of the memory next cycle
+          write_addr <= pixel_address(blit_src_front ? display_page : ~display_page,
+                                      blit_src_row + blit_dy, blit_src_col + blit_dx);
+          blit_phase <= 1'd1;
+        end
+      end else if (packed_left != 3'd0) begin
+        // Drain one packed pixel per cycle at the write pointer
+        write_addr <= pixel_address(~display_page, pointer_row, pointer_col);
+        write_data <= packed_data[5:0];
+        write_mem <= 1'd1;
+        packed_data <= packed_data >> 6;
+        packed_left <= packed_left - 3'd1;
+        if (pointer_col == BUFFER_WIDTH - 10'd1) begin
+          pointer_col <= 10'd0;
+          pointer_row <= pointer_row == BUFFER_HEIGHT - 9'd1 ? 9'd0 : pointer_row + 9'd1;
+        end else pointer_col <= pointer_col + 10'd1;
+      end else if (chipselect && write && address == 4'd0) begin
+        write_addr <= pixel_address(~display_page, writedata[24:16], writedata[15:6]);
+        write_data <= writedata[5:0];  // Extracting 6-bit pixel data from writedata
         write_mem  <= 1'd1;
       end
-    end
 
+      // Register writes, as long as nothing is holding them off
+      if (chipselect && write && !waitrequest)
+        case (address)
+          4'd1: scroll_offset <= writedata[8:0];
+          4'd2: fixed_start <= writedata[8:0];
+          4'd3: {pointer_row, pointer_col} <= writedata[24:6];
+          4'd4: begin
+            packed_data <= writedata[29:0];
+            packed_left <= PIXELS_PER_WORD;
+          end
+          4'd5: begin
+            flip_offset  <= writedata[8:0];
+            flip_pending <= 1'd1;
+          end
+          4'd6: begin
+            irq_enable <= writedata[0];
+            irq <= 1'd0;
+          end
+          4'd7: {scroll_end, scroll_first} <= writedata[19:0];
+          4'd9: {blit_row, blit_col} <= writedata[24:6];
+          4'd10: {blit_height, blit_width} <= writedata[24:6];
+          4'd11: {blit_src_row, blit_src_col} <= writedata[24:6];
+          4'd12: begin
+            blit_copy <= writedata[31];
+            blit_src_front <= writedata[30];
+            blit_color <= writedata[5:0];
+            blit_rows_up <= writedata[31] && blit_row > blit_src_row;
+            blit_cols_left <= writedata[31] && blit_col > blit_src_col;
+            blit_x <= 10'd0;
+            blit_y <= 9'd0;
+            blit_phase <= 1'd0;
+            blit_busy <= blit_width != 10'd0 && blit_height != 9'd0;
+          end
+          default: ;  // 0, a pixel, is written above; 8, the palette, below
+        endcase
 
-  always_comb begin
-    {VGA_R, VGA_G, VGA_B} = {8'h0, 8'h0, 8'h0};
-    if (VGA_BLANK_n) begin
-      if (hcount[10:1] >= 10'd245 && hcount[10:1] < 10'd395 && vcount[9:0] < 10'd480) begin
-        case (pixel_data)
-	  6'd0: {VGA_R, VGA_G, VGA_B} = 24'h000000; // Black
-	  6'd1: {VGA_R, VGA_G, VGA_B} = 24'hffffff; // White
-	  6'd2: {VGA_R, VGA_G, VGA_B} = 24'hff0000; // Red
-	  6'd3: {VGA_R, VGA_G, VGA_B} = 24'h00ff00; // Green
-	  6'd4: {VGA_R, VGA_G, VGA_B} = 24'h0000ff; // Blue
-	  6'd5: {VGA_R, VGA_G, VGA_B} = 24'h14d345; // Light_green
-	  6'd6: {VGA_R, VGA_G, VGA_B} = 24'h11a132; // Middle_green
-	  6'd7: {VGA_R, VGA_G, VGA_B} = 24'h10a237; // Dark_green
-	  6'd8: {VGA_R, VGA_G, VGA_B} = 24'hd3362f; // Light_red
-	  6'd9: {VGA_R, VGA_G, VGA_B} = 24'h9a2a26; // Middle_red
-	  6'd10: {VGA_R, VGA_G, VGA_B} = 24'h9b2929; // Dark_red
-	  6'd11: {VGA_R, VGA_G, VGA_B} = 24'hfef335; // Light_yellow
-	  6'd12: {VGA_R, VGA_G, VGA_B} = 24'hc5bd1a; // Middle_yellow
-	  6'd13: {VGA_R, VGA_G, VGA_B} = 24'hcfbd3d; // Dark_yellow
-	  6'd14: {VGA_R, VGA_G, VGA_B} = 24'h5375e0; // Light_blue
-	  6'd15: {VGA_R, VGA_G, VGA_B} = 24'h3b59af; // Middle_blue
-	  6'd16: {VGA_R, VGA_G, VGA_B} = 24'h4059ab; // Dark_blue
-	  6'd17: {VGA_R, VGA_G, VGA_B} = 24'hda562b; // Light_orange
-	  6'd18: {VGA_R, VGA_G, VGA_B} = 24'h8b3518; // Middle_orange
-	  6'd19: {VGA_R, VGA_G, VGA_B} = 24'h8f3719; // Dark_orange
-	  default: {VGA_R, VGA_G, VGA_B} = 24'hffffff; // Default to white
-	endcase
-      end else begin
-        {VGA_R, VGA_G, VGA_B} = {background_r, background_g, background_b};
+      // Vertical sync is starting: flip pages and raise the vblank interrupt
+      vs_prev <= VGA_VS;
+      if (vs_prev && !VGA_VS) begin
+        if (flip_pending) begin
+          display_page <= ~display_page;
+          scroll_offset <= flip_offset;
+          flip_pending <= 1'd0;
+        end
+        if (irq_enable) irq <= 1'd1;
       end
     end
+
+
+  // Palette RAM. Kept out of the reset logic, and read through a register,
+  // so it can be a RAM block. The frame buffer is read a pixel ahead and
+  // each pixel lasts two cycles, so the registered color still lines up
+  // with VGA_BLANK_n and the syncs; it now changes on the falling edge of
+  // VGA_CLK rather than the rising edge the DAC latches on
+  always_ff @(posedge clk) begin
+    if (chipselect && write && !waitrequest && address == 4'd8)
+      palette[writedata[29:24]] <= writedata[23:0];
+    pixel_rgb <= palette[pixel_data];
+  end
+
+  // Power-on palette, generated by software/generate_verilog_colors.py
+  initial begin
+    for (int i = 0; i < 64; i++) palette[i] = 24'hffffff;  // Default to white
+    palette[0] = 24'h000000;  // Black
+    palette[1] = 24'hffffff;  // White
+    palette[2] = 24'hff0000;  // Red
+    palette[3] = 24'h00ff00;  // Green
+    palette[4] = 24'h0000ff;  // Blue
+    palette[5] = 24'h14d345;  // Light_green
+    palette[6] = 24'h11a132;  // Middle_green
+    palette[7] = 24'h10a237;  // Dark_green
+    palette[8] = 24'hd3362f;  // Light_red
+    palette[9] = 24'h9a2a26;  // Middle_red
+    palette[10] = 24'h9b2929;  // Dark_red
+    palette[11] = 24'hfef335;  // Light_yellow
+    palette[12] = 24'hc5bd1a;  // Middle_yellow
+    palette[13] = 24'hcfbd3d;  // Dark_yellow
+    palette[14] = 24'h5375e0;  // Light_blue
+    palette[15] = 24'h3b59af;  // Middle_blue
+    palette[16] = 24'h4059ab;  // Dark_blue
+    palette[17] = 24'hda562b;  // Light_orange
+    palette[18] = 24'h8b3518;  // Middle_orange
+    palette[19] = 24'h8f3719;  // Dark_orange
+    palette[20] = 24'h000080;  // Navy
+    palette[21] = 24'h303030;  // Dark_gray
+    palette[22] = 24'h707070;  // Gray
   end
 
+  assign {VGA_R, VGA_G, VGA_B} = VGA_BLANK_n ? pixel_rgb : 24'h000000;
+
 endmodule
 
 module vga_mem (
     input logic clk,
-    input logic [16:0] ra, wa,
+    input logic [19:0] ra, wa,
     input logic write,
     input logic [5:0] wd,
-    output logic [5:0] rd
+    output logic [5:0] rd,
+    output logic [5:0] wrd  // What was at wa, for the blitter's copies
 );
 
-  logic [5:0] data[122775:0];  // 480 rows * 256 offset / row, plus up to 150 col offset 
+  // Two 640 x 480 pages, one after the other: 3,686,400 bits, which takes
+  // most of the 5CSEMA5's 397 M10K blocks
+  logic [5:0] data[614399:0];
   always_ff @(posedge clk) begin
     if (write) data[wa] <= wd;
-    rd <= data[ra];
+    rd  <= data[ra];
+    wrd <= data[wa];
   end
 endmodule
 
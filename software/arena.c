@@ -0,0 +1,144 @@
+// MAP_ANONYMOUS
+#define _GNU_SOURCE
+#include "arena.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+static unsigned char *base; // NULL until arena_init()
+static size_t capacity, used;
+static long long allocations, failures;
+static int playing;
+static __thread int guarded;
+
+int arena_init(size_t bytes) {
+  // Anonymous memory comes zeroed, and under the realtime profile's
+  // mlockall() it is all faulted in and locked right here
+  void *block = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (block == MAP_FAILED) {
+    perror("Error reserving the arena");
+    return 1;
+  }
+  base = block;
+  capacity = bytes;
+  used = 0;
+  return 0;
+}
+
+void *arena_alloc(size_t size) {
+  size_t start =
+      (used + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+
+#ifndef NDEBUG
+  // Nothing here is locked: the arena is only safe to grow before play
+  // starts, when the main thread is the only one allocating
+  if (__atomic_load_n(&playing, __ATOMIC_RELAXED)) {
+    guarded = 0; // Reporting it may allocate
+    fprintf(stderr, "arena: arena_alloc(%zu) while playing\n", size);
+    assert(!"no arena allocation while playing");
+  }
+#endif
+
+  if (base == NULL || start > capacity || size > capacity - start) {
+    fprintf(stderr, "arena: no room for %zu B (%zu of %zu B used)\n", size,
+            used, capacity);
+    failures++;
+    errno = ENOMEM; // As malloc() would, for callers' perror()
+    return NULL;
+  }
+  used = start + size;
+  allocations++;
+  return base + start;
+}
+
+void arena_guard_thread(void) { guarded = 1; }
+
+void arena_play_start(void) {
+  __atomic_store_n(&playing, 1, __ATOMIC_RELAXED);
+}
+
+void arena_play_end(void) { __atomic_store_n(&playing, 0, __ATOMIC_RELAXED); }
+
+void arena_print_stats(void) {
+  printf("---ARENA STATISTICS---\n");
+  printf("Used: %zu of %zu KB (%.1f%%)\n", used / 1024, capacity / 1024,
+         capacity ? 100.0 * used / capacity : 0.0);
+  printf("Allocations: %lld (%lld did not fit)\n", allocations, failures);
+}
+
+void arena_destroy(void) {
+  if (base == NULL)
+    return;
+  munmap(base, capacity);
+  base = NULL;
+  capacity = used = 0;
+}
+
+#if !defined(NDEBUG) && defined(__GLIBC__)
+// Stand in for the C library's allocator, so an allocation from a guarded
+// thread while playing is caught wherever it comes from, libraries included
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *memory, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+
+static void check_heap(const char *what, size_t size) {
+  if (!guarded || !__atomic_load_n(&playing, __ATOMIC_RELAXED))
+    return;
+
+  guarded = 0; // Reporting it may allocate
+  fprintf(stderr, "arena: %s(%zu) while playing\n", what, size);
+  assert(!"no heap allocation while playing");
+}
+
+void *malloc(size_t size) {
+  check_heap("malloc", size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  check_heap("calloc", count * size);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, size_t size) {
+  check_heap("realloc", size);
+  return __libc_realloc(memory, size);
+}
+
+int posix_memalign(void **memory, size_t alignment, size_t size) {
+  check_heap("posix_memalign", size);
+  if (alignment % sizeof(void *) || alignment & (alignment - 1))
+    return EINVAL;
+  if ((*memory = __libc_memalign(alignment, size)) == NULL)
+    return ENOMEM;
+  return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  check_heap("aligned_alloc", size);
+  return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  check_heap("memalign", size);
+  return __libc_memalign(alignment, size);
+}
+
+void *valloc(size_t size) {
+  check_heap("valloc", size);
+  return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size) {
+  check_heap("pvalloc", size);
+  return __libc_pvalloc(size);
+}
+#endif
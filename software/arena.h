@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Room for everything the game keeps while it plays: two full frames, the
+// sprites, the HUD, the judges, the autoplay plans and the audio ring, with
+// room to spare for four players
+#define ARENA_BYTES (8 * 1024 * 1024)
+// Every allocation starts on a cache line of its own, so threads writing
+// neighbouring allocations never share one
+#define ARENA_ALIGNMENT 64
+
+// All of the game's memory, reserved in one block at startup and handed out
+// in order; nothing is freed until the whole arena is released at exit. The
+// size the game runs in is fixed before the first frame, and allocating
+// never takes a lock: everything is allocated from the main thread before
+// play starts, which arena_alloc() asserts.
+//
+// Unless built with NDEBUG, and only with glibc, the heap is off limits to
+// the game's own threads while playing: any malloc(), calloc(), realloc(),
+// posix_memalign(), aligned_alloc(), memalign(), valloc() or pvalloc() from
+// one of them fails an assertion. Memory that does not come through these,
+// like mmap() or a library's own allocator, is not caught
+
+// Reserves bytes; returns 0 on success
+int arena_init(size_t bytes);
+// size bytes of zeroed memory, or NULL with errno ENOMEM if the arena is
+// full
+void *arena_alloc(size_t size);
+// Marks the calling thread as one that must not touch the heap while
+// playing
+void arena_guard_thread(void);
+// Between these, guarded threads must not allocate
+void arena_play_start(void);
+void arena_play_end(void);
+void arena_print_stats(void);
+// Releases everything allocated from the arena
+void arena_destroy(void);
+
+#endif /* ARENA_H */
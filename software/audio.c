@@ -0,0 +1,190 @@
+#include "audio.h"
+#include "helpers.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Frames the decoder reads from the file at a time
+#define DECODE_CHUNK_FRAMES 1024
+
+static audio_sink *audio_sinks[] = {&sdl_audio_sink, &null_audio_sink,
+                                    &file_audio_sink};
+
+#define NUM_AUDIO_SINKS (int)(sizeof(audio_sinks) / sizeof(audio_sinks[0]))
+
+audio_sink *find_audio_sink(const char *name) {
+  for (int i = 0; i < NUM_AUDIO_SINKS; i++) {
+    if (strcmp(audio_sinks[i]->name, name) == 0)
+      return audio_sinks[i];
+  }
+
+  return NULL;
+}
+
+// Keeps the ring topped up from the file, well ahead of the output
+static void *decode_song(void *arg) {
+  audio_engine *audio = (audio_engine *)arg;
+  int16_t chunk[DECODE_CHUNK_FRAMES * AUDIO_MAX_CHANNELS];
+
+  trace_thread("audio decoder");
+  while (audio->running) {
+    if (ring_buffer_space(&audio->ring) < DECODE_CHUNK_FRAMES) {
+      usleep(2000); // The ring holds far more than this
+      continue;
+    }
+
+    trace_begin("decode");
+    int frames = wav_read(&audio->song, chunk, DECODE_CHUNK_FRAMES);
+    if (frames > 0)
+      ring_buffer_write(&audio->ring, chunk, frames);
+    trace_end("decode");
+    if (frames <= 0)
+      break; // The end of the song, or an error already reported
+  }
+
+  audio->decoded_all = 1;
+  return NULL;
+}
+
+// Publishes where the song is being heard. The sequence count is odd while
+// the clock is being changed, so readers know to try again
+static void set_clock(audio_engine *audio, long long frames, long long us) {
+  unsigned seq = audio->clock_seq;
+
+  __atomic_store_n(&audio->clock_seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&audio->clock_frames, frames, __ATOMIC_RELAXED);
+  __atomic_store_n(&audio->clock_us, us, __ATOMIC_RELAXED);
+  __atomic_store_n(&audio->clock_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int audio_init(audio_engine *audio, const char *path, audio_sink *sink,
+               const char *sink_arg) {
+  memset(audio, 0, sizeof(*audio));
+  audio->sink = sink;
+
+  if (wav_open(&audio->song, path))
+    return 1;
+  if (audio->song.channels > AUDIO_MAX_CHANNELS) {
+    fprintf(stderr, "Song audio has %d channels; at most %d are supported\n",
+            audio->song.channels, AUDIO_MAX_CHANNELS);
+    wav_close(&audio->song, 0);
+    return 1;
+  }
+
+  if (ring_buffer_init(&audio->ring, AUDIO_RING_FRAMES,
+                       audio->song.channels)) {
+    perror("Error allocating audio ring buffer!\n");
+    wav_close(&audio->song, 0);
+    return 1;
+  }
+
+  if (sink->open(sink, audio, sink_arg)) {
+    wav_close(&audio->song, 0);
+    return 1;
+  }
+
+  return 0;
+}
+
+int audio_start(audio_engine *audio) {
+  audio->running = 1;
+
+  if (pthread_create(&audio->decoder_thread, NULL, decode_song, audio) != 0) {
+    perror("pthread_create(decoder_thread) failed\n");
+    return 1;
+  }
+
+  // Let the decoder get ahead so the first periods don't underrun
+  while (!audio->decoded_all &&
+         ring_buffer_available(&audio->ring) < AUDIO_RING_FRAMES / 2)
+    usleep(1000);
+
+  // Nothing is heard until the output's buffers have filled
+  set_clock(audio, -audio->latency_frames, current_time_in_us());
+  audio->last_pull_us = 0;
+  audio->sink->start(audio->sink);
+  return 0;
+}
+
+void audio_pull(audio_engine *audio, int16_t *samples, int frames) {
+  long long now = current_time_in_us();
+  // Checked first: once set, everything the decoder will write is readable
+  int decoded_all = audio->decoded_all;
+  int got = ring_buffer_read(&audio->ring, samples, frames);
+
+  if (got < frames) {
+    memset(samples + got * audio->song.channels, 0,
+           (frames - got) * audio->song.channels * sizeof(int16_t));
+    if (!decoded_all)
+      audio->underruns++;
+  }
+
+  // The first frame handed over now is heard once the output's buffers
+  // have played out
+  set_clock(audio, audio->frames_played - audio->latency_frames, now);
+  audio->frames_played += got;
+
+  if (audio->last_pull_us) {
+    long long gap = now - audio->last_pull_us;
+    audio->pull_gap_us += gap;
+    if (gap > audio->max_pull_gap_us)
+      audio->max_pull_gap_us = gap;
+  }
+  audio->last_pull_us = now;
+  audio->pulls++;
+}
+
+long long audio_song_clock(void *arg, long long time_us) {
+  audio_engine *audio = (audio_engine *)arg;
+  unsigned seq;
+  long long frames, us;
+
+  do {
+    seq = __atomic_load_n(&audio->clock_seq, __ATOMIC_ACQUIRE);
+    frames = __atomic_load_n(&audio->clock_frames, __ATOMIC_RELAXED);
+    us = __atomic_load_n(&audio->clock_us, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) ||
+           seq != __atomic_load_n(&audio->clock_seq, __ATOMIC_RELAXED));
+
+  // Between pulls the song moves on in real time, but never past what the
+  // output has been given: if the audio stalls, so does the song
+  long long elapsed_us = time_us - us;
+  long long period_us = 1000000LL * AUDIO_PERIOD_FRAMES / audio->song.rate;
+  if (elapsed_us > period_us)
+    elapsed_us = period_us;
+
+  return frames * 1000000LL / audio->song.rate + elapsed_us;
+}
+
+int audio_finished(audio_engine *audio) {
+  return audio->decoded_all && ring_buffer_available(&audio->ring) == 0;
+}
+
+void audio_print_stats(audio_engine *audio) {
+  printf("---AUDIO STATISTICS (%s)---\n", audio->sink->name);
+  printf("Played: %.2fs of %.2fs\n",
+         (double)audio->frames_played / audio->song.rate,
+         (double)audio->song.frames / audio->song.rate);
+  printf("Output latency: %.1fms (%d frames)\n",
+         1000.0 * audio->latency_frames / audio->song.rate,
+         audio->latency_frames);
+  printf("Underruns: %lld\n", audio->underruns);
+  if (audio->pulls > 1)
+    printf("Period: avg %.2fms, max %.2fms (nominal %.2fms)\n",
+           audio->pull_gap_us / 1000.0 / (audio->pulls - 1),
+           audio->max_pull_gap_us / 1000.0,
+           1000.0 * AUDIO_PERIOD_FRAMES / audio->song.rate);
+}
+
+void audio_destroy(audio_engine *audio) {
+  // The output goes first so nothing pulls from a ring that is going away
+  audio->sink->close(audio->sink);
+  if (audio->running) {
+    audio->running = 0;
+    pthread_join(audio->decoder_thread, NULL);
+  }
+  wav_close(&audio->song, 0);
+}
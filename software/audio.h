@@ -0,0 +1,74 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "ring_buffer.h"
+#include "wav.h"
+#include <pthread.h>
+
+// Frames the output asks for at a time. Small, to keep latency down
+#define AUDIO_PERIOD_FRAMES 256
+// Mono or stereo songs only
+#define AUDIO_MAX_CHANNELS 2
+// Decoded audio waiting for the output: about 185 ms at 44.1 kHz
+#define AUDIO_RING_FRAMES 8192
+
+typedef struct audio_engine audio_engine;
+
+// Where the audio goes. Each sink pulls frames with audio_pull() from its own
+// thread or callback, a period at a time
+typedef struct audio_sink audio_sink;
+struct audio_sink {
+  const char *name;
+  // Gets ready to play the engine's audio, with arg from the command line
+  // (e.g. a file name) or NULL. Sets engine->latency_frames. Returns 0 on
+  // success
+  int (*open)(audio_sink *self, audio_engine *engine, const char *arg);
+  void (*start)(audio_sink *self);
+  void (*close)(audio_sink *self);
+};
+
+extern audio_sink sdl_audio_sink, null_audio_sink, file_audio_sink;
+
+// Looks a sink up by name; returns NULL if there is none
+audio_sink *find_audio_sink(const char *name);
+
+struct audio_engine {
+  wav_file song;
+  ring_buffer ring; // Decoder thread -> output
+  audio_sink *sink;
+  pthread_t decoder_thread;
+  volatile int running;
+  volatile int decoded_all; // Set once the whole song is in the ring
+  // Frames that play before one handed over by audio_pull() is heard
+  int latency_frames;
+
+  // Where the song was heard, and when: written by the output, read by
+  // anyone through the sequence count
+  unsigned clock_seq;
+  long long clock_frames, clock_us;
+
+  // Only the output touches these
+  long long frames_played; // Song frames pulled so far
+  long long underruns;     // Periods the decoder did not keep up with
+  long long pulls, pull_gap_us, max_pull_gap_us, last_pull_us;
+};
+
+// Opens the song and the sink; returns 0 on success
+int audio_init(audio_engine *audio, const char *path, audio_sink *sink,
+               const char *sink_arg);
+// Starts decoding and, once some audio is buffered, playing
+int audio_start(audio_engine *audio);
+// Fills samples with the next frames of the song, or silence if there are
+// none. Never blocks
+void audio_pull(audio_engine *audio, int16_t *samples, int frames);
+// The master song clock: how far into the song, in us, the player was
+// hearing at time_us (a current_time_in_us() time). Meant to be a judge's
+// song clock, with the engine as its argument
+long long audio_song_clock(void *arg, long long time_us);
+// Whether all of the song has been played
+int audio_finished(audio_engine *audio);
+void audio_print_stats(audio_engine *audio);
+// Stops playing and frees everything
+void audio_destroy(audio_engine *audio);
+
+#endif /* AUDIO_H */
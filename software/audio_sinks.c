@@ -0,0 +1,164 @@
+#include "audio.h"
+#include <SDL2/SDL.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+// SDL audio: plays through whatever SDL finds (ALSA on the board). The
+// callback runs on SDL's audio thread and pulls straight from the ring
+
+static SDL_AudioDeviceID sdl_device;
+
+static void sdl_audio_callback(void *userdata, Uint8 *stream, int len) {
+  audio_engine *audio = (audio_engine *)userdata;
+
+  audio_pull(audio, (int16_t *)stream,
+             len / (audio->song.channels * sizeof(int16_t)));
+}
+
+static int sdl_audio_open(audio_sink *self, audio_engine *audio,
+                          const char *arg) {
+  SDL_AudioSpec want, have;
+  (void)self;
+  (void)arg;
+
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+    fprintf(stderr, "SDL audio could not initialize! SDL_Error: %s\n",
+            SDL_GetError());
+    return 1;
+  }
+
+  SDL_zero(want);
+  want.freq = audio->song.rate;
+  want.format = AUDIO_S16SYS;
+  want.channels = audio->song.channels;
+  want.samples = AUDIO_PERIOD_FRAMES;
+  want.callback = sdl_audio_callback;
+  want.userdata = audio;
+
+  // SDL converts if the device wants something else, so what we pull is
+  // always the song's own format
+  sdl_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+  if (sdl_device == 0) {
+    fprintf(stderr, "Could not open audio device! SDL_Error: %s\n",
+            SDL_GetError());
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    return 1;
+  }
+
+  // While the callback fills one buffer, the one before it is playing
+  audio->latency_frames = have.samples;
+  return 0;
+}
+
+static void sdl_audio_start(audio_sink *self) {
+  (void)self;
+
+  SDL_PauseAudioDevice(sdl_device, 0);
+}
+
+static void sdl_audio_close(audio_sink *self) {
+  (void)self;
+
+  SDL_CloseAudioDevice(sdl_device);
+  SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+audio_sink sdl_audio_sink = {.name = "sdl",
+                             .open = sdl_audio_open,
+                             .start = sdl_audio_start,
+                             .close = sdl_audio_close};
+
+// The null and file sinks: a thread pulls a period at a time on a steady
+// real-time schedule, as a sound card would, for running without one. The
+// file sink also keeps what it pulled
+
+static pthread_t timed_thread;
+static volatile int timed_running;
+static audio_engine *timed_audio;
+static wav_file timed_file;
+static int timed_writing;
+
+static void *timed_output(void *arg) {
+  int16_t period[AUDIO_PERIOD_FRAMES * AUDIO_MAX_CHANNELS];
+  long long period_ns =
+      1000000000LL * AUDIO_PERIOD_FRAMES / timed_audio->song.rate;
+  struct timespec next;
+  (void)arg;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (timed_running) {
+    audio_pull(timed_audio, period, AUDIO_PERIOD_FRAMES);
+    if (timed_writing &&
+        wav_write(&timed_file, period, AUDIO_PERIOD_FRAMES)) {
+      perror("could not write audio file");
+      timed_writing = 0;
+    }
+
+    next.tv_nsec += period_ns;
+    while (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  return NULL;
+}
+
+static int null_audio_open(audio_sink *self, audio_engine *audio,
+                           const char *arg) {
+  (void)self;
+  (void)arg;
+
+  timed_audio = audio;
+  timed_writing = 0;
+  // Frames are "heard" as soon as they are pulled
+  audio->latency_frames = 0;
+  return 0;
+}
+
+static int file_audio_open(audio_sink *self, audio_engine *audio,
+                           const char *arg) {
+  if (arg == NULL) {
+    fprintf(stderr, "The file audio sink needs a file name\n");
+    return 1;
+  }
+
+  null_audio_open(self, audio, NULL);
+  if (wav_create(&timed_file, arg, audio->song.rate, audio->song.channels))
+    return 1;
+  timed_writing = 1;
+  return 0;
+}
+
+static void timed_audio_start(audio_sink *self) {
+  (void)self;
+
+  timed_running = 1;
+  if (pthread_create(&timed_thread, NULL, timed_output, NULL) != 0) {
+    perror("pthread_create(timed_thread) failed\n");
+    timed_running = 0;
+  }
+}
+
+static void timed_audio_close(audio_sink *self) {
+  (void)self;
+
+  if (timed_running) {
+    timed_running = 0;
+    pthread_join(timed_thread, NULL);
+  }
+  if (timed_file.file)
+    wav_close(&timed_file, 1);
+}
+
+audio_sink null_audio_sink = {.name = "null",
+                              .open = null_audio_open,
+                              .start = timed_audio_start,
+                              .close = timed_audio_close};
+
+audio_sink file_audio_sink = {.name = "file",
+                              .open = file_audio_open,
+                              .start = timed_audio_start,
+                              .close = timed_audio_close};
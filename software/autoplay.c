@@ -0,0 +1,168 @@
+#include "autoplay.h"
+#include "arena.h"
+#include "global_consts.h"
+#include "guitar_reader.h"
+#include "helpers.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// How long the frets go down before a strum, and the strum bar is held,
+// unless rows come closer together than that
+#define FRET_LEAD_US 30000
+#define STRUM_HOLD_US 30000
+// Longest the thread sleeps at once, so it keeps up with a clock (the
+// audio's) that does not run at exactly the wall clock's rate
+#define MAX_SLEEP_US 10000
+
+static void plan(autoplayer *a, long long song_us, unsigned char frets,
+                 int strum) {
+  replay_event *event = &a->events[a->count++];
+
+  event->song_us = song_us;
+  event->player = a->player;
+  event->gs.frets = frets;
+  event->gs.strum = strum;
+}
+
+int autoplay_init(autoplayer *a, judge *j, int player, long long offset_us) {
+  long long lead_us = j->note_us / 4 < FRET_LEAD_US ? j->note_us / 4
+                                                     : FRET_LEAD_US;
+  long long hold_us = j->note_us / 4 < STRUM_HOLD_US ? j->note_us / 4
+                                                      : STRUM_HOLD_US;
+  // Strums are aimed past the calibration, which the pipe does not have the
+  // lag for, so the judge sees them exactly offset_us off
+  long long aim_us =
+      offset_us + (j->calibration.input_offset_ms +
+                   j->calibration.display_offset_ms) *
+                      1000LL;
+
+  memset(a, 0, sizeof(*a));
+  a->j = j;
+  a->player = player;
+  a->offset_us = offset_us;
+  a->listener = judge_input;
+  a->listener_arg = j;
+  a->fds[0] = a->fds[1] = -1;
+
+  // Frets down, strum, strum up: three changes a row at most
+  a->events = arena_alloc(3 * j->num_rows * sizeof(*a->events) + 1);
+  if (a->events == NULL) {
+    perror("Error allocating the autoplay plan");
+    return 1;
+  }
+  for (int row = 0; row < j->num_rows; row++) {
+    long long strum_us = j->first_note_us + row * j->note_us + aim_us;
+
+    if (!j->rows[row])
+      continue;
+    plan(a, strum_us - lead_us, j->rows[row], 0);
+    plan(a, strum_us, j->rows[row], 1);
+    plan(a, strum_us + hold_us, j->rows[row], 0);
+  }
+
+  if (pipe(a->fds)) {
+    perror("pipe(autoplay) failed");
+    return 1;
+  }
+  snprintf(a->input_path, sizeof(a->input_path), "/proc/self/fd/%d",
+           a->fds[0]);
+  return 0;
+}
+
+// Writes each change to the pipe once the song gets to it, stamped with
+// when it was due, as the device stamps when its inputs settled
+static void *autoplay_loop(void *arg) {
+  static const char *thread_names[MAX_PLAYERS] = {
+      "autoplay player 1", "autoplay player 2", "autoplay player 3",
+      "autoplay player 4"};
+  autoplayer *a = (autoplayer *)arg;
+
+  trace_thread(thread_names[a->player]);
+  while (a->running && a->next < a->count) {
+    long long now = current_time_in_us();
+    long long song_us = judge_song_time_us(a->j, now);
+    const replay_event *event = &a->events[a->next];
+
+    if (event->song_us > song_us) {
+      long long wait_us = event->song_us - song_us;
+      usleep(wait_us < MAX_SLEEP_US ? wait_us : MAX_SLEEP_US);
+      continue;
+    }
+
+    // Held frets read 0, and the strum bar 1 while down
+    long long late_us = song_us - event->song_us;
+    guitar_reader_event_t device_event = {
+        .time_ns = (now - late_us) * 1000ULL,
+        .cycle = 0,
+        .state = (~event->gs.frets & ALL_FRETS) | (event->gs.strum ? 0x20 : 0)};
+    trace_instant("autoplay input");
+    if (write(a->fds[1], &device_event, sizeof(device_event)) !=
+        sizeof(device_event)) {
+      perror("write(autoplay) failed");
+      break;
+    }
+
+    a->written++;
+    a->late_us += late_us;
+    if (late_us > a->max_late_us)
+      a->max_late_us = late_us;
+    a->next++;
+  }
+
+  return NULL;
+}
+
+int autoplay_start(autoplayer *a) {
+  a->running = 1;
+  if (pthread_create(&a->thread, NULL, autoplay_loop, a) != 0) {
+    perror("pthread_create(autoplay) failed");
+    a->running = 0;
+    return 1;
+  }
+  return 0;
+}
+
+void autoplay_input(void *arg, const guitar_state *gs, long long time_us) {
+  autoplayer *a = (autoplayer *)arg;
+  long long delivery_us = current_time_in_us() - time_us;
+
+  // Only this player's input thread gets here, so no lock
+  a->delivered++;
+  a->delivery_us += delivery_us;
+  if (delivery_us > a->max_delivery_us)
+    a->max_delivery_us = delivery_us;
+  a->listener(a->listener_arg, gs, time_us);
+}
+
+void autoplay_print_stats(autoplayer *a) {
+  printf("---AUTOPLAY STATISTICS (player %d)---\n", a->player + 1);
+  printf("Aimed: %+.1fms\n", a->offset_us / 1000.0);
+  printf("Changes written: %lld of %d", a->written, a->count);
+  if (a->written)
+    printf(" (%.1fus late on average, %lldus at worst)",
+           (double)a->late_us / a->written, a->max_late_us);
+  printf("\n");
+  printf("Changes delivered: %lld", a->delivered);
+  if (a->delivered)
+    printf(" (%.1fus after being due on average, %lldus at worst)",
+           (double)a->delivery_us / a->delivered, a->max_delivery_us);
+  printf("\n");
+  if (a->j->num_errors)
+    printf("Judged: %+.1fms median error, %d PERFECT\n",
+           judge_median_error_us(a->j) / 1000.0,
+           a->j->totals.counts[JUDGMENT_PERFECT]);
+}
+
+void autoplay_destroy(autoplayer *a) {
+  if (a->running) {
+    a->running = 0;
+    pthread_join(a->thread, NULL);
+  }
+  if (a->fds[0] >= 0) {
+    close(a->fds[0]);
+    close(a->fds[1]);
+  }
+}
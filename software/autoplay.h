@@ -0,0 +1,50 @@
+#ifndef AUTOPLAY_H
+#define AUTOPLAY_H
+
+#include "guitar_state.h"
+#include "judge.h"
+#include "replay.h"
+#include <pthread.h>
+
+// Plays a player's chart by itself: the frets go down a little ahead of each
+// row and the strum lands offset_us after the row reaches the line. The
+// input goes in as device events through a pipe, which the backend opens as
+// the player's input path, so it takes the same way in as a real guitar's
+// and its timing is known exactly
+typedef struct {
+  judge *j; // Whose chart and clock to play by
+  int player;
+  long long offset_us;
+
+  // The plan, in song order; gs.strum is the strum bar's level
+  replay_event *events;
+  int count, next;
+
+  int fds[2];          // The pipe: the backend reads fds[0] by input_path
+  char input_path[32]; // Set the backend's input path to this
+  pthread_t thread;
+  volatile int running;
+
+  // Where input goes once it has been timed; set by autoplay_init() to
+  // judge_input on the player's judge
+  guitar_listener listener;
+  void *listener_arg;
+
+  // For the statistics. late_us is how long after they were due events were
+  // written; delivery_us how long after that the backend passed them on
+  long long written, late_us, max_late_us;
+  long long delivered, delivery_us, max_delivery_us;
+} autoplayer;
+
+// Plans the player's whole chart; returns 0 on success
+int autoplay_init(autoplayer *a, judge *j, int player, long long offset_us);
+// Starts playing, by the judge's clock; judge_start() must have been called
+int autoplay_start(autoplayer *a);
+// A guitar_listener, with the autoplayer as arg: times the input, then
+// passes it on to a->listener
+void autoplay_input(void *arg, const guitar_state *gs, long long time_us);
+void autoplay_print_stats(autoplayer *a);
+// Stops playing; call once the backend has stopped reading
+void autoplay_destroy(autoplayer *a);
+
+#endif /* AUTOPLAY_H */
@@ -0,0 +1,53 @@
+#include "backend.h"
+#include "helpers.h"
+#include <stdio.h>
+#include <string.h>
+
+static backend *backends[] = {&hardware_backend, &cosim_backend, &sdl_backend,
+                              &headless_backend, &sim_backend};
+
+#define NUM_BACKENDS (int)(sizeof(backends) / sizeof(backends[0]))
+
+backend *find_backend(const char *name) {
+  for (int i = 0; i < NUM_BACKENDS; i++) {
+    if (strcmp(backends[i]->name, name) == 0)
+      return backends[i];
+  }
+
+  return NULL;
+}
+
+void print_backend_names(FILE *stream) {
+  for (int i = 0; i < NUM_BACKENDS; i++)
+    fprintf(stream, "%s%s", i ? " " : "", backends[i]->name);
+}
+
+void print_backend_stats(backend *b) {
+  backend_stats stats;
+  b->stats(b, &stats);
+
+  printf("---BACKEND STATISTICS (%s)---\n", b->name);
+  printf("Frames submitted: %lld\n", stats.frames_submitted);
+  printf("Frames shown: %lld\n", stats.frames_shown);
+  printf("Transfers: %lld", stats.transfers);
+  if (stats.frames_shown)
+    printf(" (%.1f/frame)", (double)stats.transfers / stats.frames_shown);
+  printf("\n");
+  printf("Transfer time: %lldus", stats.transfer_us);
+  if (stats.frames_shown)
+    printf(" (%.1fus/frame)", (double)stats.transfer_us / stats.frames_shown);
+  printf("\n");
+  if (stats.present_us && stats.frames_shown)
+    printf("Display latency: %.1fus/frame\n",
+           (double)stats.present_us / stats.frames_shown);
+  if (stats.input_wakeups && stats.frames_shown)
+    printf("Input wake-ups: %lld (%.1f/frame)\n", stats.input_wakeups,
+           (double)stats.input_wakeups / stats.frames_shown);
+  if (stats.frame_work_us && stats.frames_shown)
+    printf("Frame work: %.1fus/frame\n",
+           (double)stats.frame_work_us / stats.frames_shown);
+}
+
+long long backend_time_us(backend *b) {
+  return b->now_us ? b->now_us(b) : current_time_in_us();
+}
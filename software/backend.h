@@ -0,0 +1,87 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "damage.h"
+#include "global_consts.h"
+#include "guitar_state.h"
+#include "latency.h"
+#include <stdio.h>
+
+// A finished frame, handed to a backend to display
+typedef struct {
+  // screen.width x screen.height pixels, 4 B/pixel as B, G, R, unused
+  const unsigned char *pixels;
+  // How far the note highway has scrolled since the song started, in px.
+  // Backends that can scroll in hardware only send what scrolled into view
+  int scroll_px;
+  // Where it differs from the frame submitted before it; NULL if it may
+  // differ anywhere. Backends only need to copy and send those pixels
+  const damage_list *damage;
+  // The input this frame is the first to show, if any. Backends report when
+  // it is pushed and shown
+  latency_tag latency;
+} frame;
+
+// What a backend has done so far, for comparing them side by side
+typedef struct {
+  long long frames_submitted; // Frames the game handed over
+  long long frames_shown;     // Frames that reached the display
+  long long transfers;        // Device writes (or equivalent) made
+  long long transfer_us;      // Time spent moving frames to the display
+  // Total time from frames being submitted to them being on screen, or 0 if
+  // the backend cannot tell
+  long long present_us;
+  // Wall clock time the game spent on its frames, for backends that never
+  // wait for a display; 0 otherwise
+  long long frame_work_us;
+  // Times the thread reading input woke up, or 0 if the backend cannot tell
+  long long input_wakeups;
+} backend_stats;
+
+// A display and input implementation. Everything device-specific lives
+// behind these operations so the game loop never sees it
+typedef struct backend backend;
+struct backend {
+  const char *name;
+  // Set before init to hear about input as it happens, from the backend's
+  // own input threads, rather than once per frame through poll_input. Each
+  // player's changes come with that player's argument
+  guitar_listener listener;
+  void *listener_args[MAX_PLAYERS];
+  // Where each of screen.players reads input from, for backends with input
+  // devices: a device or a FIFO of guitar_reader_event_t. NULL for the
+  // player's own device
+  const char *input_paths[MAX_PLAYERS];
+  // Set before init for backends that replay input: the replay file (NULL
+  // for none), and how far the sim backend's clock moves each frame (0 for
+  // 60 Hz)
+  const char *replay_path;
+  long long frame_us;
+  // Opens the devices and starts any threads; returns 0 on success
+  int (*init)(backend *self);
+  // Takes a copy of the frame; may return before it is on screen
+  void (*submit_frame)(backend *self, const frame *f);
+  // Fills in one player's controller state. Strums are reported once each.
+  // Returns 0, or -1 once there is no more input (e.g. the window closed)
+  int (*poll_input)(backend *self, int player, guitar_state *gs);
+  // Paces the game loop: returns when the next frame should be drawn
+  void (*wait_vsync)(backend *self);
+  // The clock the game runs by, for backends that keep their own time; NULL
+  // for current_time_in_us(). Use backend_time_us()
+  long long (*now_us)(backend *self);
+  void (*stats)(backend *self, backend_stats *stats);
+  void (*destroy)(backend *self);
+};
+
+extern backend hardware_backend, cosim_backend, sdl_backend, headless_backend,
+    sim_backend;
+
+// Looks a backend up by name; returns NULL if there is none
+backend *find_backend(const char *name);
+// Prints the names of all backends, separated by spaces
+void print_backend_names(FILE *stream);
+void print_backend_stats(backend *b);
+// What time it is by the backend's clock, in us
+long long backend_time_us(backend *b);
+
+#endif /* BACKEND_H */
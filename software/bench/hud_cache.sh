@@ -0,0 +1,32 @@
+#!/bin/sh
+# What the HUD's text cache saves. The sim backend plays the song through
+# as fast as it can, one player playing it perfectly, RUNS times with the
+# cache on and RUNS off; each run prints the HUD's render time and the
+# rasterizer's, per frame. The sim backend's fixed time step makes every
+# run draw the same frames, so only the host's noise differs.
+#
+# From software/ after "make": bench/hud_cache.sh [RUNS]
+
+RUNS=${1:-3}
+REPLAY=/tmp/hud_cache_replay.$$.txt
+
+# Only player 1's input
+awk '/^#/ || $2 == 1' bench/perfect4.txt > "$REPLAY" || exit 1
+trap 'rm -f "$REPLAY"' EXIT
+
+printf '%-6s %14s %16s %12s\n' cache "HUD us/frame" "raster us/frame" glyphs/frame
+for cache in on off; do
+  flag=
+  [ $cache = off ] && flag=--no-hud-cache
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    ./game_logic sim --replay "$REPLAY" $flag | awk -v cache=$cache '
+      /^---/ { section = $0 }
+      section ~ /HUD/ && /^Render time/ { hud = $3 + 0 }
+      section ~ /HUD/ && /^Glyphs re-rendered/ { glyphs = $4 }
+      section ~ /RASTERIZER/ && /^Render time/ { raster = $3 + 0 }
+      END { gsub(/[^0-9.]/, "", glyphs)
+            printf "%-6s %14.1f %16.1f %12s\n", cache, hud, raster, glyphs }'
+    i=$((i + 1))
+  done
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# What each added player costs. The sim backend plays the song through as
+# fast as it can with 1 to 4 players, every one of them playing it
+# perfectly, RUNS times each; each run prints the backend's frame work
+# (building the draw list, the HUD and rasterizing) and the rasterizer's
+# share, per frame. The sim backend's fixed time step makes every run draw
+# the same frames, so only the host's noise differs.
+#
+# From software/ after "make": bench/players.sh [RUNS] [RENDER_THREADS]
+
+RUNS=${1:-3}
+THREADS=${2:-1}
+REPLAY=/tmp/players_replay.$$.txt
+trap 'rm -f "$REPLAY"' EXIT
+
+printf '%-8s %16s %16s %14s\n' players "frame us/frame" "raster us/frame" "redrawn/frame"
+for players in 1 2 3 4; do
+  # Only the players in this game
+  awk -v players=$players '/^#/ || $2 <= players' bench/perfect4.txt \
+    > "$REPLAY" || exit 1
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    ./game_logic sim --replay "$REPLAY" --players $players \
+      --render-threads "$THREADS" | awk -v players=$players '
+      /^---/ { section = $0 }
+      section ~ /BACKEND/ && /^Frame work/ { frame = $3 + 0 }
+      section ~ /RASTERIZER/ && /^Render time/ { raster = $3 + 0 }
+      section ~ /RASTERIZER/ && /^Redrawn/ { redrawn = $2 }
+      END { printf "%-8d %16.1f %16.1f %14s\n", players, frame, raster,
+                   redrawn }'
+    i=$((i + 1))
+  done
+done
@@ -0,0 +1,116 @@
+#include "chart.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Notes per row for every combination of frets
+static const unsigned char row_notes[ALL_FRETS + 1] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5};
+
+int notes_in_row(note_row row) { return row_notes[row & ALL_FRETS]; }
+
+void set_note(note_row *note_state, const char *binary_string) {
+  if (note_state == NULL || binary_string == NULL) {
+    return; // Error handling: Ensure note_state and binary_string are not NULL
+  }
+
+  // The last character is green, the one before it red, and so on
+  *note_state = 0;
+  for (int fret = 0; fret < NUM_FRETS; fret++)
+    *note_state |= (binary_string[7 - fret] == '1') << fret;
+}
+
+// Copies a title in capitals, up to the first '.' if it is a file name
+static void set_title(song_chart *chart, const char *title, int file_name) {
+  int i;
+
+  for (i = 0; i < SONG_TITLE_LENGTH - 1 && title[i]; i++) {
+    if (file_name && title[i] == '.')
+      break;
+    chart->title[i] = title[i] == '_' ? ' ' : toupper((unsigned char)title[i]);
+  }
+  chart->title[i] = '\0';
+}
+
+int chart_load(const char *path, song_chart *chart) {
+  FILE *file = fopen(path, "r");
+  const char *name = strrchr(path, '/');
+  char line[128];
+
+  if (file == NULL) {
+    fprintf(stderr, "Could not open chart %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  set_title(chart, name ? name + 1 : path, 1);
+  chart->bpm = SONG_BPM;
+  chart->num_rows = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (strncmp(line, "#title ", 7) == 0)
+      set_title(chart, line + 7, 0);
+    else if (sscanf(line, "#bpm %d", &chart->bpm) == 1)
+      continue;
+    else if (strlen(line) == 8 && strspn(line, "01") == 8) {
+      if (chart->num_rows == MAX_CHART_ROWS) {
+        fprintf(stderr, "Chart %s is over %d rows; the rest is left out\n",
+                path, MAX_CHART_ROWS);
+        break;
+      }
+      set_note(&chart->rows[chart->num_rows++], line);
+    }
+  }
+  fclose(file);
+
+  if (chart->bpm <= 0) {
+    fprintf(stderr, "Chart %s has a BPM of %d\n", path, chart->bpm);
+    return 1;
+  }
+  return 0;
+}
+
+int chart_row_ms(int bpm) {
+  return (int)(60000.0 / bpm / NOTES_PER_MEASURE + 0.5);
+}
+
+void chart_analyze(const note_row *rows, int num_rows, int window_rows,
+                   chart_stats *stats) {
+  int window_notes = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->window_rows = window_rows;
+
+  for (int i = 0; i < num_rows; i++) {
+    int notes = notes_in_row(rows[i]);
+
+    stats->notes += notes;
+    stats->note_rows += notes != 0;
+    stats->chords += notes > 1;
+    for (int fret = 0; fret < NUM_FRETS; fret++)
+      stats->fret_notes[fret] += (rows[i] >> fret) & 1;
+
+    // Slide the window along to end at this row
+    window_notes += notes;
+    window_notes -= i >= window_rows ? notes_in_row(rows[i - window_rows]) : 0;
+    int peak = window_notes > stats->peak_notes;
+    stats->peak_notes = peak ? window_notes : stats->peak_notes;
+    stats->peak_row = peak ? i + 1 - window_rows : stats->peak_row;
+  }
+
+  if (stats->peak_row < 0)
+    stats->peak_row = 0;
+}
+
+void chart_print_stats(const chart_stats *stats) {
+  printf("Notes: %d in %d rows (%d chords)\n", stats->notes, stats->note_rows,
+         stats->chords);
+  printf("Max combo: %d\n", stats->note_rows);
+  printf("Peak density: %d notes in %d rows, from row %d\n",
+         stats->peak_notes, stats->window_rows, stats->peak_row);
+  printf("Notes per fret: %d %d %d %d %d\n", stats->fret_notes[0],
+         stats->fret_notes[1], stats->fret_notes[2], stats->fret_notes[3],
+         stats->fret_notes[4]);
+}
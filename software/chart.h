@@ -0,0 +1,46 @@
+#ifndef CHART_H
+#define CHART_H
+
+#include "song_data.h"
+
+// Longest chart that can be loaded, in rows
+#define MAX_CHART_ROWS 4096
+#define SONG_TITLE_LENGTH 32
+
+// A chart as read from its file
+typedef struct {
+  char title[SONG_TITLE_LENGTH]; // In capitals, as the HUD draws them
+  int bpm;
+  int num_rows;
+  note_row rows[MAX_CHART_ROWS];
+} song_chart;
+
+// What a whole chart asks of the player, worked out once when it is loaded
+typedef struct {
+  int notes;     // Every note, each note of a chord counted
+  int note_rows; // Rows with anything to play: the longest possible combo
+  int chords;    // Rows with more than one note
+  // Most notes in any window_rows rows in a row, and the first of them
+  int window_rows;
+  int peak_notes, peak_row;
+  int fret_notes[NUM_FRETS]; // How often each fret comes up
+} chart_stats;
+
+// Sets note_state from a row of eight '0'/'1' characters, green last
+void set_note(note_row *note_state, const char *binary_string);
+// Reads a chart file: optional "#title TITLE" and "#bpm N" lines, then a row
+// of eight '0'/'1' characters per line; anything else is skipped. Without
+// them the title is the file name and the BPM is SONG_BPM. Returns 0 on
+// success
+int chart_load(const char *path, song_chart *chart);
+// How long each row of a chart at bpm lasts, in ms
+int chart_row_ms(int bpm);
+
+// Number of notes in a row
+int notes_in_row(note_row row);
+// Scans the chart in one pass over its rows, without branching on them
+void chart_analyze(const note_row *rows, int num_rows, int window_rows,
+                   chart_stats *stats);
+void chart_print_stats(const chart_stats *stats);
+
+#endif /* CHART_H */
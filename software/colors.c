@@ -39,4 +39,7 @@ RGB palette[COLOR_COUNT] = {[BLACK] = {0, 0, 0},
                             [DARK_BLUE] = {64, 89, 171},
                             [LIGHT_ORANGE] = {218, 86, 43},
                             [MIDDLE_ORANGE] = {139, 53, 24},
-                            [DARK_ORANGE] = {143, 55, 25}};
\ No newline at end of file
+                            [DARK_ORANGE] = {143, 55, 25},
+                            [NAVY] = {0, 0, 128},
+                            [DARK_GRAY] = {48, 48, 48},
+                            [GRAY] = {112, 112, 112}};
\ No newline at end of file
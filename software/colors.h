@@ -29,6 +29,11 @@ typedef enum {
     LIGHT_ORANGE,
     MIDDLE_ORANGE,
     DARK_ORANGE,
+    // Side panels
+    NAVY,
+    // Highway lines and the strike bar
+    DARK_GRAY,
+    GRAY,
     COLOR_COUNT // Gives number of predefined colors
 } Color;
 
@@ -0,0 +1,107 @@
+#include "damage.h"
+#include "global_consts.h"
+#include <string.h>
+
+static int overlaps(const rect *a, const rect *b) {
+  return a->x < b->x + b->width && b->x < a->x + a->width &&
+         a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+// The smallest rectangle covering both
+static rect bounding(const rect *a, const rect *b) {
+  int left = a->x < b->x ? a->x : b->x;
+  int top = a->y < b->y ? a->y : b->y;
+  int right = a->x + a->width > b->x + b->width ? a->x + a->width
+                                                : b->x + b->width;
+  int bottom = a->y + a->height > b->y + b->height ? a->y + a->height
+                                                   : b->y + b->height;
+  rect r = {left, top, right - left, bottom - top};
+  return r;
+}
+
+static long long area(const rect *r) { return (long long)r->width * r->height; }
+
+void damage_clear(damage_list *d) { d->count = 0; }
+
+void damage_all(damage_list *d) {
+  d->count = 1;
+  d->rects[0].x = d->rects[0].y = 0;
+  d->rects[0].width = screen.width;
+  d->rects[0].height = screen.height;
+}
+
+void damage_add(damage_list *d, int x, int y, int width, int height) {
+  int right = x + width, bottom = y + height;
+
+  x = x < 0 ? 0 : x;
+  y = y < 0 ? 0 : y;
+  right = right > screen.width ? screen.width : right;
+  bottom = bottom > screen.height ? screen.height : bottom;
+  if (x >= right || y >= bottom)
+    return;
+
+  rect added = {x, y, right - x, bottom - y};
+
+  // Absorb everything the rectangle overlaps, starting over each time it
+  // grows, so the list stays free of overlaps
+  for (int i = 0; i < d->count;) {
+    if (!overlaps(&added, &d->rects[i])) {
+      i++;
+      continue;
+    }
+    added = bounding(&added, &d->rects[i]);
+    d->rects[i] = d->rects[--d->count];
+    i = 0;
+  }
+
+  if (d->count < MAX_DAMAGE_RECTS) {
+    d->rects[d->count++] = added;
+    return;
+  }
+
+  // Full: fold it into the rectangle that grows least, and add that back
+  int best = 0;
+  long long best_growth = -1;
+  for (int i = 0; i < d->count; i++) {
+    rect merged = bounding(&added, &d->rects[i]);
+    long long growth = area(&merged) - area(&d->rects[i]);
+    if (best_growth < 0 || growth < best_growth) {
+      best = i;
+      best_growth = growth;
+    }
+  }
+  added = bounding(&added, &d->rects[best]);
+  d->rects[best] = d->rects[--d->count];
+  damage_add(d, added.x, added.y, added.width, added.height);
+}
+
+void damage_merge(damage_list *into, const damage_list *from) {
+  for (int i = 0; i < from->count; i++)
+    damage_add(into, from->rects[i].x, from->rects[i].y, from->rects[i].width,
+               from->rects[i].height);
+}
+
+long long damage_area(const damage_list *d) {
+  long long pixels = 0;
+
+  for (int i = 0; i < d->count; i++)
+    pixels += area(&d->rects[i]);
+  return pixels;
+}
+
+void damage_copy(const damage_list *d, unsigned char *to,
+                 const unsigned char *from) {
+  if (d == NULL) {
+    memcpy(to, from, (size_t)screen.height * SCREEN_LINE_LENGTH);
+    return;
+  }
+
+  for (int i = 0; i < d->count; i++) {
+    const rect *r = &d->rects[i];
+    size_t start = (size_t)r->y * SCREEN_LINE_LENGTH + r->x * 4;
+
+    for (int row = 0; row < r->height; row++)
+      memcpy(to + start + row * SCREEN_LINE_LENGTH,
+             from + start + row * SCREEN_LINE_LENGTH, r->width * 4);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+// A rectangle of screen pixels
+typedef struct {
+  int x, y, width, height;
+} rect;
+
+// Beyond this many rectangles, new ones are merged into whichever existing
+// one grows least
+#define MAX_DAMAGE_RECTS 64
+
+// The parts of the screen that changed since some earlier frame, as
+// rectangles that never overlap each other. Anything outside them is the
+// same as it was
+typedef struct {
+  int count;
+  rect rects[MAX_DAMAGE_RECTS];
+} damage_list;
+
+void damage_clear(damage_list *d);
+// The whole screen
+void damage_all(damage_list *d);
+// Clips the rectangle to the screen and adds it, merging it with any it
+// overlaps
+void damage_add(damage_list *d, int x, int y, int width, int height);
+void damage_merge(damage_list *into, const damage_list *from);
+// Pixels covered
+long long damage_area(const damage_list *d);
+// Copies the damaged pixels of one frame (screen.width x screen.height,
+// 4 B/pixel) to another, or all of them if d is NULL
+void damage_copy(const damage_list *d, unsigned char *to,
+                 const unsigned char *from);
+
+#endif /* DAMAGE_H */
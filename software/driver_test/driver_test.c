@@ -0,0 +1,287 @@
+/*
+ * Userspace test of vga_framebuffer.c's probe, write() and blit path
+ *
+ * Probing must have everything write() uses ready before /dev/vga_framebuffer
+ * appears, and when publishing it fails, must give back what it took without
+ * deregistering a device it never registered.
+ *
+ * The driver is built against kernel.h, with the peripheral's write pointer,
+ * packed pixel and page flip registers modelled in memory: iowrite32()
+ * moves the pointer and drops pixels into a page the way
+ * vga_framebuffer.sv does. A frame packed with packed_pixel_writedata(), as
+ * the hardware backend packs them, goes through the driver's write() in one
+ * go and in odd-sized pieces, then a few rows on their own as pwrite()
+ * would send them, and every pixel is read back out of the model. Closing a
+ * file that wrote through to the end of the frame must flip to it, and no
+ * other close may.
+ *
+ * A blit runs on in the device after its BLIT_START write, reporting busy
+ * in the status register until it is done. The model stays busy for a
+ * number of status reads; the driver must leave the last blit of a list
+ * running, and never make a write the device would hold on the bus until
+ * the blit is done.
+ *
+ * Then whole frames are written as fast as the driver takes them. That
+ * times the copy and the register writes into memory, not the bus, so it
+ * is what the driver costs on top of the bridge, not the frame rate.
+ *
+ * "make && ./driver_test"; exits nonzero if anything is wrong.
+ */
+
+#include "../vga_framebuffer.c"
+
+#include <time.h>
+
+#define WIDTH VGA_SCREEN_WIDTH
+#define HEIGHT VGA_SCREEN_HEIGHT
+#define ROW_WORDS (VGA_FRAMEBUFFER_ROW_BYTES / 4)
+
+// The peripheral: its registers, the page being drawn and what it was told
+static uint32_t registers[16];
+static unsigned char page[HEIGHT][WIDTH];
+static int pointer_row, pointer_col;
+static int flips;
+
+// The blitter: status reads until it is done, blits started, and writes
+// made while it was busy that the device would have held off
+#define BLIT_READS 100
+static int busy_reads, blits, held_writes;
+
+// The device in /dev and its interrupt: whether each is registered, whether
+// everything was ready when the device was, and what registering returns
+static int registered, irq_requested, ready_when_registered;
+static int register_error;
+
+int misc_register(struct miscdevice *misc) {
+  if (register_error)
+    return register_error;
+  ready_when_registered = dev.virtbase != NULL && dev.words != NULL &&
+                          dev.write_lock.initialised && irq_requested;
+  registered++;
+  return 0;
+}
+
+void misc_deregister(struct miscdevice *misc) { registered--; }
+
+int request_irq(unsigned int irq, irqreturn_t (*handler)(int, void *),
+                unsigned long flags, const char *name, void *dev_id) {
+  irq_requested++;
+  return 0;
+}
+
+void free_irq(unsigned int irq, void *dev_id) { irq_requested--; }
+
+void __iomem *of_iomap(struct device_node *node, int index) {
+  return registers;
+}
+
+u32 ioread32(void __iomem *addr) {
+  if (addr != STATUS(dev.virtbase) || busy_reads == 0)
+    return 0;
+  busy_reads--;
+  return STATUS_BUSY;
+}
+
+void iowrite32(u32 value, void __iomem *addr) {
+  if (busy_reads &&
+      (addr == FIRST_CHUNK(dev.virtbase) ||
+       addr == PACKED_PIXELS(dev.virtbase) || addr == PAGE_FLIP(dev.virtbase) ||
+       addr >= BLIT_DEST(dev.virtbase)))
+    held_writes++;
+
+  if (addr == BLIT_START(dev.virtbase)) {
+    busy_reads = BLIT_READS;
+    blits++;
+  } else if (addr == WRITE_POINTER(dev.virtbase)) {
+    pointer_row = value >> 16;
+    pointer_col = value >> 6 & 0x3ff;
+  } else if (addr == PACKED_PIXELS(dev.virtbase)) {
+    // [5:0] first, across the row and on to the next, wrapping at the end
+    for (int i = 0; i < PIXELS_PER_WORD; i++) {
+      page[pointer_row][pointer_col] = value >> (6 * i) & 0x3f;
+      if (++pointer_col == WIDTH) {
+        pointer_col = 0;
+        pointer_row = (pointer_row + 1) % HEIGHT;
+      }
+    }
+  } else if (addr == PAGE_FLIP(dev.virtbase)) {
+    flips++;
+  }
+}
+
+// Color indices, and the same packed as write() takes them
+static unsigned char pixels[HEIGHT][WIDTH];
+static uint32_t frame[HEIGHT][ROW_WORDS];
+
+// Neighbouring pixels, rows and words all differ
+static void make_frame(int seed) {
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++)
+      pixels[y][x] = (x * 7 + y * 3 + x / PIXELS_PER_WORD + seed) % 64;
+    for (int w = 0; w < ROW_WORDS; w++)
+      frame[y][w] = packed_pixel_writedata(&pixels[y][w * PIXELS_PER_WORD]);
+  }
+}
+
+// Counts the pixels of rows first up to end that are not what was packed
+static int check_rows(int first, int end) {
+  int wrong = 0;
+
+  for (int y = first; y < end; y++)
+    for (int x = 0; x < WIDTH; x++) {
+      if (page[y][x] == pixels[y][x])
+        continue;
+      if (wrong < 10)
+        fprintf(stderr, "driver_test: (%d, %d) is %d, expected %d\n", x, y,
+                page[y][x], pixels[y][x]);
+      wrong++;
+    }
+  return wrong;
+}
+
+static int expect(const char *what, int ok) {
+  printf("%-48s %s\n", what, ok ? "ok" : "WRONG");
+  return !ok;
+}
+
+// Writes size bytes from buf at the file's position, as write() does
+static ssize_t write_file(struct file *f, const void *buf, size_t size) {
+  return vga_framebuffer_write(f, buf, size, &f->f_pos);
+}
+
+// Writes the frame a piece at a time; returns whether every piece went
+static int write_pieces(struct file *f, size_t piece) {
+  const char *bytes = (const char *)frame;
+
+  for (size_t done = 0; done < VGA_FRAMEBUFFER_FRAME_BYTES; done += piece) {
+    size_t size = VGA_FRAMEBUFFER_FRAME_BYTES - done < piece
+                      ? VGA_FRAMEBUFFER_FRAME_BYTES - done
+                      : piece;
+    if (write_file(f, bytes + done, size) != (ssize_t)size)
+      return 0;
+  }
+  return 1;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+  struct platform_device pdev;
+  struct file f;
+  int wrong = 0;
+
+  printf("---DRIVER WRITE TEST---\n");
+
+  // Publishing the device fails: nothing is left behind
+  memset(&pdev, 0, sizeof(pdev));
+  register_error = -EBUSY;
+  wrong += expect("Probe fails when misc_register() does",
+                  vga_framebuffer_probe(&pdev) == -EBUSY);
+  wrong += expect("Failed probe: never deregisters, frees the irq",
+                  registered == 0 && irq_requested == 0);
+
+  register_error = 0;
+  memset(&dev, 0, sizeof(dev));
+  wrong += expect("Probe", vga_framebuffer_probe(&pdev) == 0);
+  wrong += expect("Ready before /dev/vga_framebuffer appears",
+                  registered == 1 && ready_when_registered);
+
+  // cat frame.bin > /dev/vga_framebuffer
+  make_frame(0);
+  memset(&f, 0, sizeof(f));
+  vga_framebuffer_open(NULL, &f);
+  wrong += expect("Whole frame in one write()",
+                  write_file(&f, frame, VGA_FRAMEBUFFER_FRAME_BYTES) ==
+                      VGA_FRAMEBUFFER_FRAME_BYTES);
+  wrong += expect("Whole frame: every pixel round-trips",
+                  check_rows(0, HEIGHT) == 0);
+  vga_framebuffer_release(NULL, &f);
+  wrong += expect("Closing after the last byte flips", flips == 1);
+
+  // The same in pieces that split rows and words' worth of rows unevenly
+  make_frame(1);
+  memset(&f, 0, sizeof(f));
+  vga_framebuffer_open(NULL, &f);
+  wrong += expect("Whole frame in 1236-byte writes", write_pieces(&f, 1236));
+  wrong += expect("In pieces: every pixel round-trips",
+                  check_rows(0, HEIGHT) == 0);
+  vga_framebuffer_release(NULL, &f);
+  wrong += expect("Closing after the last piece flips", flips == 2);
+
+  // A range of rows at its own offset, as the hardware backend sends them;
+  // pwrite() leaves the file position alone
+  make_frame(2);
+  memset(&f, 0, sizeof(f));
+  vga_framebuffer_open(NULL, &f);
+  loff_t pos = VGA_FRAMEBUFFER_OFFSET(100, 0);
+  wrong += expect("Rows 100 to 149 in one pwrite()",
+                  vga_framebuffer_write(&f, (const char *)frame[100],
+                                        50 * VGA_FRAMEBUFFER_ROW_BYTES,
+                                        &pos) == 50 * VGA_FRAMEBUFFER_ROW_BYTES);
+  wrong += expect("Those rows changed", check_rows(100, 150) == 0);
+  make_frame(1);
+  wrong += expect("The rest did not",
+                  check_rows(0, 100) == 0 && check_rows(150, HEIGHT) == 0);
+
+  // What write() turns away
+  pos = 2;
+  wrong += expect("Unaligned offset refused",
+                  vga_framebuffer_write(&f, (const char *)frame, 4, &pos) ==
+                      -EINVAL);
+  pos = VGA_FRAMEBUFFER_FRAME_BYTES;
+  wrong += expect("Writing past the end refused",
+                  vga_framebuffer_write(&f, (const char *)frame, 4, &pos) ==
+                      -ENOSPC);
+  pos = VGA_FRAMEBUFFER_FRAME_BYTES - 8;
+  wrong += expect("A write across the end stops at it",
+                  vga_framebuffer_write(&f, (const char *)frame, 16, &pos) ==
+                      8);
+  vga_framebuffer_release(NULL, &f);
+  wrong += expect("Closing short of the end does not flip", flips == 2);
+
+  // Blits, then a frame and a flip behind them
+  vga_framebuffer_blit_t list[3] = {
+      {.op = VGA_FRAMEBUFFER_BLIT_FILL, .width = WIDTH, .height = HEIGHT},
+      {.op = VGA_FRAMEBUFFER_BLIT_COPY, .row = 8, .width = 150,
+       .height = 424, .src_on_screen = 1},
+      {.op = VGA_FRAMEBUFFER_BLIT_FILL, .row = 200, .col = 250, .width = 30,
+       .height = 10, .color = 42},
+  };
+  vga_framebuffer_blits_t blit_list = {.count = 3, .blits = list};
+  wrong += expect("Three blits",
+                  vga_framebuffer_ioctl(&f, VGA_FRAMEBUFFER_BLIT,
+                                        (unsigned long)&blit_list) == 0 &&
+                      blits == 3);
+  wrong += expect("The last left running", busy_reads == BLIT_READS);
+  make_frame(3);
+  f.f_pos = 0;
+  write_file(&f, frame, VGA_FRAMEBUFFER_FRAME_BYTES);
+  vga_framebuffer_release(NULL, &f);
+  wrong += expect("Frame and flip behind them", check_rows(0, HEIGHT) == 0 &&
+                                                    flips == 3);
+  wrong += expect("Nothing held on the bus by a running blit",
+                  held_writes == 0);
+
+  // Throughput
+  const int frames = 200;
+  double start = now_s();
+  for (int i = 0; i < frames; i++) {
+    f.f_pos = 0;
+    write_file(&f, frame, VGA_FRAMEBUFFER_FRAME_BYTES);
+  }
+  double elapsed = now_s() - start;
+  printf("Whole-frame write(): %.1fus/frame, %.0f frames/s, %.0f MB/s\n",
+         elapsed / frames * 1e6, frames / elapsed,
+         frames * (double)VGA_FRAMEBUFFER_FRAME_BYTES / elapsed / 1e6);
+
+  vga_framebuffer_remove(&pdev);
+  wrong += expect("Remove gives it all back",
+                  registered == 0 && irq_requested == 0);
+  printf("Wrong: %d\n", wrong);
+  return wrong != 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Just enough of the kernel for vga_framebuffer.c to build in userspace.
+ * Every <linux/...> header the driver includes is this file (the Makefile
+ * makes them). Register access, and the calls probing makes to publish the
+ * device and claim its interrupt, go to driver_test.c; the rest does
+ * nothing, or as little as probing and the write() path need
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <asm/errno.h> // Not <errno.h>: that would come back round to here
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef long long loff_t;
+typedef unsigned int __poll_t;
+typedef int irqreturn_t;
+
+#define __iomem
+#define __user
+#define __init
+#define __exit
+#define __exit_p(x) x
+#define THIS_MODULE NULL
+#define CONFIG_OF 1
+
+#define ERESTARTSYS 512
+#define IRQ_HANDLED 1
+#define POLLIN 1
+#define POLLRDNORM 0x40
+#define GFP_KERNEL 0
+#define MISC_DYNAMIC_MINOR 255
+
+#define min_t(type, a, b) ((type)(a) < (type)(b) ? (type)(a) : (type)(b))
+#define READ_ONCE(x) (x)
+#define WRITE_ONCE(x, v) ((x) = (v))
+
+#define pr_info(...) ((void)0)
+#define pr_warn(...) ((void)0)
+#define pr_err(...) fprintf(stderr, __VA_ARGS__)
+
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_DEVICE_TABLE(type, table)
+#define of_match_ptr(x) (x)
+// Never loaded, but keeps the module's entry points from being unused
+#define module_init(fn)                                                        \
+  int (*const module_init_fn)(void) __attribute__((unused)) = fn
+#define module_exit(fn)                                                        \
+  void (*const module_exit_fn)(void) __attribute__((unused)) = fn
+
+struct inode;
+struct file {
+  loff_t f_pos;
+  void *private_data;
+};
+typedef struct poll_table_struct poll_table;
+struct file_operations {
+  void *owner;
+  int (*open)(struct inode *, struct file *);
+  int (*release)(struct inode *, struct file *);
+  loff_t (*llseek)(struct file *, loff_t, int);
+  ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+  __poll_t (*poll)(struct file *, poll_table *);
+  long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+};
+struct miscdevice {
+  int minor;
+  const char *name;
+  const struct file_operations *fops;
+};
+
+struct resource {
+  unsigned long start, end;
+};
+struct device_node;
+struct platform_device {
+  struct {
+    struct device_node *of_node;
+  } dev;
+};
+struct of_device_id {
+  const char *compatible;
+};
+struct platform_driver {
+  struct {
+    const char *name;
+    void *owner;
+    const struct of_device_id *of_match_table;
+  } driver;
+  int (*remove)(struct platform_device *);
+};
+
+struct mutex {
+  int initialised;
+};
+typedef struct {
+  int unused;
+} wait_queue_head_t;
+
+// The peripheral's registers, modelled in driver_test.c
+void iowrite32(u32 value, void __iomem *addr);
+u32 ioread32(void __iomem *addr);
+
+static inline void iowrite32_rep(void __iomem *addr, const void *words,
+                                 unsigned long count) {
+  const u32 *word = words;
+
+  while (count--)
+    iowrite32(*word++, addr);
+}
+
+// Waiting on the modelled device takes no time
+static inline void usleep_range(unsigned long min, unsigned long max) {}
+
+// Userspace pointers are plain pointers here
+static inline unsigned long copy_from_user(void *to, const void __user *from,
+                                           unsigned long n) {
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline unsigned long copy_to_user(void __user *to, const void *from,
+                                         unsigned long n) {
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline void *kvmalloc(size_t size, int flags) {
+  (void)flags;
+  return malloc(size);
+}
+
+static inline void kvfree(const void *p) { free((void *)p); }
+
+// One thread, so locks and waits have nothing to do, but locking a mutex
+// before mutex_init() is still a bug
+static inline void mutex_init(struct mutex *m) { m->initialised = 1; }
+static inline void mutex_lock(struct mutex *m) {
+  if (!m->initialised) {
+    fprintf(stderr, "kernel.h: mutex locked before mutex_init()\n");
+    abort();
+  }
+}
+static inline void mutex_unlock(struct mutex *m) { (void)m; }
+static inline void init_waitqueue_head(wait_queue_head_t *q) { (void)q; }
+static inline void wake_up_interruptible(wait_queue_head_t *q) { (void)q; }
+static inline void poll_wait(struct file *f, wait_queue_head_t *q,
+                             poll_table *p) {
+  (void)f, (void)q, (void)p;
+}
+#define wait_event_interruptible(queue, condition) ((condition) ? 0 : 0)
+
+static inline loff_t fixed_size_llseek(struct file *f, loff_t offset,
+                                       int whence, loff_t size) {
+  (void)whence, (void)size;
+  return f->f_pos = offset;
+}
+
+// Publishing the device, and its interrupt, modelled in driver_test.c
+int misc_register(struct miscdevice *misc);
+void misc_deregister(struct miscdevice *misc);
+int request_irq(unsigned int irq, irqreturn_t (*handler)(int, void *),
+                unsigned long flags, const char *name, void *dev_id);
+void free_irq(unsigned int irq, void *dev_id);
+void __iomem *of_iomap(struct device_node *node, int index);
+
+// The device tree always has the peripheral, with one interrupt
+static inline int of_address_to_resource(struct device_node *node, int index,
+                                         struct resource *res) {
+  (void)node, (void)index;
+  res->start = 0;
+  res->end = 63;
+  return 0;
+}
+static inline unsigned long resource_size(const struct resource *res) {
+  return res->end - res->start + 1;
+}
+static inline void *request_mem_region(unsigned long start, unsigned long n,
+                                       const char *name) {
+  (void)start, (void)n, (void)name;
+  return (void *)1;
+}
+static inline void release_mem_region(unsigned long start, unsigned long n) {
+  (void)start, (void)n;
+}
+static inline void iounmap(void __iomem *addr) { (void)addr; }
+static inline unsigned int irq_of_parse_and_map(struct device_node *node,
+                                                int index) {
+  (void)node, (void)index;
+  return 1;
+}
+static inline int
+platform_driver_probe(struct platform_driver *driver,
+                      int (*probe)(struct platform_device *)) {
+  (void)driver, (void)probe;
+  return -ENODEV;
+}
+static inline void platform_driver_unregister(struct platform_driver *driver) {
+  (void)driver;
+}
+
+#endif /* KERNEL_H */
@@ -1,119 +1,341 @@
+#include "backend.h"
 #include "colors.h"
 #include "global_consts.h"
-#include "guitar_reader.h"
+#include "arena.h"
+#include "audio.h"
+#include "autoplay.h"
+#include "chart.h"
 #include "guitar_state.h"
+#include "judge.h"
+#include "latency.h"
+#include "library.h"
 #include "song_data.h"
 #include "sprites.h"
-#include "vga_emulator.h"
-#include "vga_framebuffer.h"
 #include "helpers.h"
+#include "hud.h"
+#include "rasterizer.h"
+#include "realtime.h"
+#include "replay.h"
+#include "trace.h"
 
-#include <SDL2/SDL_blendmode.h>
-#include <fcntl.h>
-#include <linux/fb.h>
 #include <math.h>
-#include <ncurses.h>
-#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/stat.h>
-#include <sys/time.h>
-#include <sys/types.h>
-#include <unistd.h>
-
-int EMULATING_VGA = 0;
 
 int SCREEN_LINE_LENGTH;
-int vga_framebuffer_fd, guitar_fd;
-unsigned char *framebuffer;
-pthread_mutex_t framebuffer_mutex = PTHREAD_MUTEX_INITIALIZER,
-                controller_mutex = PTHREAD_MUTEX_INITIALIZER;
-guitar_state controller_state;
-
-struct {
-  int green;
-  int red;
-  int yellow;
-  int blue;
-  int orange;
-} color_cols_x = {15, 45, 75, 105, 135};
-
-void *update_guitar_state(void *arg) {
-  (void)arg; // Suppress unused warning
+screen_geometry screen;
 
-  while (1) {
-    char *guitar_hex = read_note(guitar_fd);
-    char *binary_string = hex_string_to_binary(guitar_hex);
+// Lane centers, from the left edge of the highway, in fret bit order
+static const int lane_x[NUM_FRETS] = {15, 45, 75, 105, 135};
 
-    guitar_state note;
-    set_note_guitar(&note, binary_string);
+// A circle for each lane, in fret bit order
+static const sprite *lane_circle(const generated_circles *circles, int fret) {
+  const sprite *lanes[NUM_FRETS] = {&circles->green, &circles->red,
+                                    &circles->yellow, &circles->blue,
+                                    &circles->orange};
+  return lanes[fret];
+}
 
-    pthread_mutex_lock(&controller_mutex);
-    controller_state = note;
-    pthread_mutex_unlock(&controller_mutex);
+// Queues the notes in a row on the highway starting at x, centered at y
+static void draw_note_row(draw_list *list, const generated_circles *circles,
+                          note_row row, int x, int y) {
+  for (int fret = 0; fret < NUM_FRETS; fret++) {
+    if (row & (1 << fret))
+      draw_list_sprite(list, lane_circle(circles, fret), x + lane_x[fret], y);
+  }
+}
 
-    usleep(16667); // 60 Hz refresh rate
+// Faults in every lane's circle, for the realtime profile. Rows are
+// B_per_row * 4 bytes apart, as sprites.c lays them out
+static void prefault_circles(const generated_circles *circles) {
+  for (int fret = 0; fret < NUM_FRETS; fret++) {
+    const sprite *circle = lane_circle(circles, fret);
+    realtime_prefault(circle->pixel_buffer,
+                      (size_t)circle->height * circle->B_per_row * 4);
   }
-  return NULL;
 }
 
-void *update_framebuffer(void *arg) {
-  (void)arg; // Suppress warning
+// Queues a player's guitar state line: each circle is held or released
+static void draw_guitar_state_line(draw_list *list,
+                                   const generated_circles *held,
+                                   const generated_circles *released,
+                                   const guitar_state *gs, int x, int y) {
+  for (int fret = 0; fret < NUM_FRETS; fret++)
+    draw_list_sprite(list,
+                     lane_circle(gs->frets & (1 << fret) ? held : released,
+                                 fret),
+                     x + lane_x[fret], y);
+}
 
-  while (1) {
-    pthread_mutex_lock(&framebuffer_mutex);
-    for (int pixel_row = 0; pixel_row < WINDOW_HEIGHT; pixel_row++) {
-      for (int pixel_col = 0; pixel_col < WINDOW_WIDTH; pixel_col++) {
-        unsigned char *pixel =
-            framebuffer + (pixel_row * WINDOW_WIDTH + pixel_col) * 4;
-        RGB pixel_rgb = {pixel[2], pixel[1], pixel[0]};
-
-        vga_framebuffer_arg_t vfba;
-        vfba.pixel_writedata = pixel_writedata(get_color_from_rgb(pixel_rgb),
-                                               pixel_row, pixel_col);
-        ;
-
-        if (ioctl(vga_framebuffer_fd, VGA_FRAMEBUFFER_UPDATE, &vfba)) {
-          perror("ioctl(VGA_FRAMEBUFFER_UPDATE) failed");
-        }
-      }
-    }
-    pthread_mutex_unlock(&framebuffer_mutex);
+// Queues what goes under a player's notes: lines between the lanes, a line
+// across the highway every beat, brighter at the start of each measure, and
+// the strike bar behind the guitar state line. Beat n is drawn where row
+// n * NOTES_PER_MEASURE is, beat_px apart
+static void draw_highway(draw_list *list, int x, int scroll_px, double beat_px,
+                         int strike_y) {
+  for (int lane = 0; lane <= 5; lane++)
+    draw_list_vline(list, x + lane * 30 - (lane == 5), 0, screen.height,
+                    DARK_GRAY);
+
+  int first_beat = floor((scroll_px - screen.height) / beat_px) + 1;
+  for (int beat = first_beat < 0 ? 0 : first_beat;; beat++) {
+    int y = scroll_px - (int)lround(beat * beat_px);
+    if (y < 0)
+      break;
+    draw_list_hline(list, x, y, HIGHWAY_WIDTH,
+                    beat % BEATS_PER_MEASURE ? DARK_GRAY : GRAY);
   }
-  return NULL;
+
+  draw_list_fill(list, x, strike_y - 2, HIGHWAY_WIDTH, 4, GRAY);
+}
+
+// Puts each player's highway side by side, centered, HIGHWAY_GAP apart when
+// there is room. Everything starts on a multiple of 5 px so the VGA
+// framebuffer can write it in packed words
+static void layout_highways(int players) {
+  int spare = screen.width - players * HIGHWAY_WIDTH;
+  int gap = spare / (players + 1) < HIGHWAY_GAP ? spare / (players + 1)
+                                                : HIGHWAY_GAP;
+  gap -= gap % 5;
+  int margin = (spare - (players - 1) * gap) / 2;
+  margin -= margin % 5;
+
+  screen.players = players;
+  for (int p = 0; p < players; p++)
+    screen.highway_x[p] = margin + p * (HIGHWAY_WIDTH + gap);
 }
 
-void set_note(note_row *note_state, const char *binary_string) {
-  if (note_state == NULL || binary_string == NULL) {
-    return; // Error handling: Ensure note_state and binary_string are not NULL
+// What the command line asked for
+typedef struct {
+  const char *backend_name;
+  int calibrating;
+  const char *audio_path; // Song audio to play and keep time by, if any
+  char audio_sink_name[16];
+  const char *audio_sink_arg; // What came after the ':' in the sink name
+  int screen_width, screen_height;
+  int render_threads; // 0 for one per CPU
+  int players;
+  const char *input_paths[MAX_PLAYERS]; // NULL for the player's own device
+  const char *trace_path; // Where to write a timeline of the game, if at all
+  const char *replay_path; // Input for the sim backend to play back
+  long long frame_us;      // The sim backend's time step; 0 for 60 Hz
+  const char *record_path; // Where to save everyone's input, if at all
+  int autoplay;            // Whether the game plays itself
+  int autoplay_offset_ms;  // How late it strums; 0 plays perfectly
+  realtime_profile realtime;
+  const char *songs_dir; // The song library, if any
+  const char *song;      // Which of its songs to play; NULL for the first
+  int list_songs;        // Just list the library
+  int latency;           // Whether to measure input to display latency
+  long long latency_limit_us; // Fail if p99 is over this; 0 for no limit
+  int hud_cache;              // Whether the HUD keeps its rendered text
+} game_options;
+
+// Everything one player did, kept as it is judged so it can be saved as a
+// replay. Only ever touched from that player's input thread until the
+// backend is gone
+#define MAX_RECORDED_CHANGES 16384
+typedef struct {
+  judge *j;
+  int player;
+  int count;
+  replay_event events[MAX_RECORDED_CHANGES];
+} input_recorder;
+
+static void record_input(void *arg, const guitar_state *gs, long long time_us) {
+  input_recorder *r = (input_recorder *)arg;
+
+  if (r->count < MAX_RECORDED_CHANGES) {
+    replay_event *event = &r->events[r->count++];
+
+    event->song_us = judge_song_time_us(r->j, time_us);
+    event->player = r->player;
+    event->gs = *gs;
   }
+  judge_input(r->j, gs, time_us);
+}
+
+// Stamps each player's input with when it reached the game, on its way to
+// the rest of the listeners
+typedef struct {
+  guitar_listener listener;
+  void *listener_arg;
+  int player;
+  backend *display;
+} latency_listener;
+
+static void measure_input(void *arg, const guitar_state *gs,
+                          long long time_us) {
+  latency_listener *l = (latency_listener *)arg;
+
+  latency_input(l->player, time_us, backend_time_us(l->display));
+  l->listener(l->listener_arg, gs, time_us);
+}
+
+// Merges every player's changes into song order and saves them
+static void save_recording(const char *path, const input_recorder *recorders,
+                           int players) {
+  int next[MAX_PLAYERS] = {0}, total = 0;
+  replay_event *events;
+
+  for (int p = 0; p < players; p++)
+    total += recorders[p].count;
+  if ((events = malloc((total ? total : 1) * sizeof(*events))) == NULL) {
+    perror("Error allocating the recording");
+    return;
+  }
+
+  for (int i = 0; i < total; i++) {
+    int first = -1;
+
+    for (int p = 0; p < players; p++) {
+      if (next[p] < recorders[p].count &&
+          (first < 0 || recorders[p].events[next[p]].song_us <
+                            recorders[first].events[next[first]].song_us))
+        first = p;
+    }
+    events[i] = recorders[first].events[next[first]++];
+  }
+
+  if (replay_save(path, events, total) == 0)
+    printf("Saved %d input changes to %s\n", total, path);
+  free(events);
+}
 
-  // Convert the binary string to integer values
-  int green = binary_string[7] - '0';
-  int red = binary_string[6] - '0';
-  int yellow = binary_string[5] - '0';
-  int blue = binary_string[4] - '0';
-  int orange = binary_string[3] - '0';
-
-  // Assign the values to the struct fields
-  note_state->green = green;
-  note_state->red = red;
-  note_state->yellow = yellow;
-  note_state->blue = blue;
-  note_state->orange = orange;
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [backend] [--calibrate] [--audio song.wav]\n"
+          "          [--audio-sink sdl|null|file:out.wav]\n"
+          "          [--screen WIDTHxHEIGHT] [--render-threads N]\n"
+          "          [--players N] [--input PLAYER:/dev/or/fifo]...\n"
+          "          [--trace trace.json] [--record replay.txt]\n"
+          "          [--replay replay.txt] (sim and headless backends)\n"
+          "          [--frame-us N] (sim backend)\n"
+          "          [--autoplay OFFSET_MS] (hardware and cosim backends)\n"
+          "          [--realtime] [--rt-priority N]\n"
+          "          [--cpus INPUT,RENDER,PUSH] (-1 for any)\n"
+          "          [--songs DIR [--song NAME|NUMBER] [--list-songs]]\n"
+          "          [--latency LIMIT_US] (0 to only measure)\n"
+          "          [--no-hud-cache]\n"
+          "Backends: ",
+          program);
+  print_backend_names(stderr);
+  fprintf(stderr, "\n");
 }
 
-int hit_notes(guitar_state controller_state, note_row notes) {
-  return controller_state.green == notes.green &&
-         controller_state.red == notes.red &&
-         controller_state.yellow == notes.yellow &&
-         controller_state.blue == notes.blue &&
-         controller_state.orange == notes.orange;
+// Returns 0 if the options make sense
+static int parse_options(int argc, char **argv, game_options *options) {
+  const char *sink = "sdl";
+
+  options->backend_name = "hardware"; // The real hardware by default
+  options->calibrating = 0;
+  options->audio_path = NULL;
+  options->screen_width = VGA_SCREEN_WIDTH;
+  options->screen_height = VGA_SCREEN_HEIGHT;
+  options->render_threads = 0;
+  options->players = 1;
+  options->trace_path = NULL;
+  options->replay_path = NULL;
+  options->frame_us = 0;
+  options->record_path = NULL;
+  options->autoplay = 0;
+  options->autoplay_offset_ms = 0;
+  options->realtime.enabled = 0;
+  options->realtime.input_priority = DEFAULT_INPUT_PRIORITY;
+  for (int role = 0; role < NUM_REALTIME_ROLES; role++)
+    options->realtime.cpus[role] = -1;
+  memset(options->input_paths, 0, sizeof(options->input_paths));
+  options->songs_dir = NULL;
+  options->song = NULL;
+  options->list_songs = 0;
+  options->latency = 0;
+  options->latency_limit_us = 0;
+  options->hud_cache = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--calibrate") == 0)
+      options->calibrating = 1;
+    else if (strcmp(argv[i], "--audio") == 0 && i + 1 < argc)
+      options->audio_path = argv[++i];
+    else if (strcmp(argv[i], "--audio-sink") == 0 && i + 1 < argc)
+      sink = argv[++i];
+    else if (strcmp(argv[i], "--screen") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &options->screen_width,
+                 &options->screen_height) != 2)
+        return 1;
+    } else if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc)
+      options->render_threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      options->trace_path = argv[++i];
+    else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+      options->replay_path = argv[++i];
+    else if (strcmp(argv[i], "--frame-us") == 0 && i + 1 < argc)
+      options->frame_us = atoll(argv[++i]);
+    else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+      options->record_path = argv[++i];
+    else if (strcmp(argv[i], "--autoplay") == 0 && i + 1 < argc) {
+      options->autoplay = 1;
+      options->autoplay_offset_ms = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--realtime") == 0)
+      options->realtime.enabled = 1;
+    else if (strcmp(argv[i], "--rt-priority") == 0 && i + 1 < argc)
+      options->realtime.input_priority = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+      int *cpus = options->realtime.cpus;
+      if (sscanf(argv[++i], "%d,%d,%d", &cpus[REALTIME_INPUT],
+                 &cpus[REALTIME_RENDER], &cpus[REALTIME_PUSH]) != 3)
+        return 1;
+    } else if (strcmp(argv[i], "--songs") == 0 && i + 1 < argc)
+      options->songs_dir = argv[++i];
+    else if (strcmp(argv[i], "--song") == 0 && i + 1 < argc)
+      options->song = argv[++i];
+    else if (strcmp(argv[i], "--list-songs") == 0)
+      options->list_songs = 1;
+    else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+      options->latency = 1;
+      options->latency_limit_us = atoll(argv[++i]);
+    } else if (strcmp(argv[i], "--no-hud-cache") == 0)
+      options->hud_cache = 0;
+    else if (strcmp(argv[i], "--players") == 0 && i + 1 < argc)
+      options->players = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+      // e.g. "2:/tmp/guitar2" reads player 2's input from a FIFO
+      char *path;
+      long player = strtol(argv[++i], &path, 10);
+      if (*path != ':' || player < 1 || player > MAX_PLAYERS)
+        return 1;
+      options->input_paths[player - 1] = path + 1;
+    } else if (argv[i][0] != '-')
+      options->backend_name = argv[i];
+    else
+      return 1;
+  }
+
+  // The highways and the HUD around their bottoms need the room
+  if (options->players < 1 || options->players > MAX_PLAYERS ||
+      options->screen_width < options->players * HIGHWAY_WIDTH ||
+      options->screen_width > VGA_SCREEN_WIDTH ||
+      options->screen_height < 96 ||
+      options->screen_height > VGA_SCREEN_HEIGHT || options->frame_us < 0 ||
+      options->latency_limit_us < 0)
+    return 1;
+  if ((options->song || options->list_songs) && options->songs_dir == NULL)
+    return 1;
+
+  // e.g. "file:out.wav" is the file sink, writing to out.wav
+  const char *colon = strchr(sink, ':');
+  size_t name_length = colon ? (size_t)(colon - sink) : strlen(sink);
+  if (name_length >= sizeof(options->audio_sink_name))
+    return 1;
+  memcpy(options->audio_sink_name, sink, name_length);
+  options->audio_sink_name[name_length] = '\0';
+  options->audio_sink_arg = colon ? colon + 1 : NULL;
+
+  return 0;
 }
 
-int main() {
+int main(int argc, char **argv) {
   // Color definitions (hardcoded).
   // Inspired by https://oaksstudio.itch.io/guitarheroui, recreated from scratch
   circle_colors green_colors = {.white = palette[WHITE],
@@ -142,29 +364,85 @@ int main() {
                                  .dark_gray = palette[DARK_ORANGE]};
   // 32 bits/pixel = 4 B/pixel
   unsigned char *next_frame;
-  pthread_t fb_update_thread, guitar_thread;
-  VGAEmulator emulator;
+  guitar_state controller_state[MAX_PLAYERS];
 
-  init_guitar_state(&controller_state);
+  game_options options;
+  if (parse_options(argc, argv, &options)) {
+    print_usage(argv[0]);
+    return 1;
+  }
 
-  if (EMULATING_VGA) {
-    printf("Running in VGA EMULATION MODE\n");
+  // Before any threads start, so they can all be traced
+  trace_init(options.trace_path);
+  trace_thread("game loop");
+  // Before anything is allocated, so it is all locked in
+  realtime_init(&options.realtime);
+  // Everything the game keeps while it plays comes out of the arena
+  if (arena_init(ARENA_BYTES))
+    return 1;
+  arena_guard_thread();
+
+  // The library's index is all it takes to list the songs. The chosen one
+  // loads in the background while everything else is set up
+  static song_library library;
+  int song_index = -1;
+  if (options.songs_dir) {
+    if (library_open(&library, options.songs_dir))
+      return 1;
+    if (options.list_songs) {
+      library_print(&library);
+      library_print_stats(&library);
+      library_close(&library);
+      return 0;
+    }
+    song_index = options.song ? library_find(&library, options.song) : 0;
+    if (song_index < 0 || song_index >= library.count) {
+      fprintf(stderr, "No song %s in %s\n", options.song ? options.song : "",
+              options.songs_dir);
+      return 1;
+    }
+    library_preload(&library, song_index);
+  }
+
+  // Where frames go and input comes from
+  backend *display = find_backend(options.backend_name);
+  if (display == NULL) {
+    fprintf(stderr, "Unknown backend %s\n", options.backend_name);
+    print_usage(argv[0]);
+    return 1;
+  }
+  // Audio plays in real time, so it cannot keep time for a backend with a
+  // clock of its own
+  if (display->now_us && options.audio_path) {
+    fprintf(stderr, "The %s backend cannot play audio\n", display->name);
+    return 1;
+  }
+  // The autoplayer plays in real time too; a recording of it can be
+  // replayed instead
+  if (display->now_us && options.autoplay) {
+    fprintf(stderr, "The %s backend cannot autoplay; use --replay\n",
+            display->name);
+    return 1;
   }
 
-  if ((framebuffer = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * 4)) == NULL) {
-    perror("Error allocating framebuffer!\n");
+  audio_sink *sink = find_audio_sink(options.audio_sink_name);
+  if (sink == NULL) {
+    fprintf(stderr, "Unknown audio sink %s\n", options.audio_sink_name);
+    print_usage(argv[0]);
     return 1;
   }
 
-  SCREEN_LINE_LENGTH = WINDOW_WIDTH * 4;
+  // The highways down the middle, panels either side
+  screen.width = options.screen_width;
+  screen.height = options.screen_height;
+  layout_highways(options.players);
+  SCREEN_LINE_LENGTH = screen.width * 4;
 
-  if ((next_frame = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * 4)) == NULL) {
+  if ((next_frame = arena_alloc(screen.width * screen.height * 4)) == NULL) {
     perror("Error allocating next_frame!\n");
     return 1;
   }
 
-  // Set black background by default
-  memset(framebuffer, 0, WINDOW_WIDTH * WINDOW_HEIGHT * 4);
   // Load necessary sprites into memory
   sprite GH_circle_base = load_sprite("sprites/GH-Circle.png");
   // Generate the sprites for the notes
@@ -189,174 +467,368 @@ int main() {
       generate_circles(GH_circle_base, green_colors, red_colors, yellow_colors,
                        blue_colors, orange_colors);
 
-  // Set up VGA emulator. Requires libsdl2-dev
-  if (EMULATING_VGA) {
-    if (VGAEmulator_init(&emulator, framebuffer, &controller_state))
-      return 1;
-  } else {
-    // Set up VGA framebuffer connection
-    if ((vga_framebuffer_fd = open("/dev/vga_framebuffer", O_WRONLY)) == -1) {
-      perror("could not open /dev/vga_framebuffer\n");
-      return -1;
-    }
-
-    if ((guitar_fd = open("/dev/note_reader", O_RDONLY)) == -1) {
-      perror("could not open /dev/note_reader\n");
-      return -1;
-    }
+  // What every frame draws from and into
+  realtime_prefault(next_frame, screen.width * screen.height * 4);
+  prefault_circles(&note_circles);
+  prefault_circles(&play_circles_released);
+  prefault_circles(&play_circles_held);
+
+  // The chart, from the library or else the built-in one in the working
+  // directory, of which only the start is played
+  static song_chart song;
+  if (song_index >= 0 ? library_load(&library, song_index, &song)
+                      : chart_load(BUILTIN_CHART, &song))
+    return 1;
+  const note_row *song_rows = song.rows;
+  int num_note_rows = song.num_rows;
+  if (song_index < 0 && num_note_rows > BUILTIN_CHART_ROWS)
+    num_note_rows = BUILTIN_CHART_ROWS;
+  int note_duration = chart_row_ms(song.bpm);
 
-    if (pthread_create(&fb_update_thread, NULL, &update_framebuffer, NULL) !=
-        0) {
-      perror("pthread_create(fb_update_thread) failed\n");
+  // The Y coordinate of the middle of the guitar state line
+  int guitar_state_line_Y = screen.height - 24;
+  // How many pixels of "margin" (top and bottom) to apply to each note
+  int note_row_veritcal_padding = 8;
+  // THe total height including the 24x24 px sprite and the margin
+  int note_height_px = 24 + 2 * note_row_veritcal_padding;
+  // How many pixels each note row has to move down the screen in one ms
+  double note_row_pixels_per_ms = (double)(note_height_px) / note_duration;
+  // How far apart the beat lines on the highway are
+  double beat_px = NOTES_PER_MEASURE * note_height_px;
+
+  // The highway scrolls at a steady rate from the top of the screen, so each
+  // row reaches the guitar state line one note_duration after the last
+  long long first_note_us =
+      llround(guitar_state_line_Y / note_row_pixels_per_ms * 1000);
+
+  // Calibration mode plays the song with wide windows and no offsets, then
+  // works the offsets out from where the strums landed
+  int calibrating = options.calibrating;
+  judge_windows windows = DEFAULT_JUDGE_WINDOWS,
+                calibration_windows = CALIBRATION_JUDGE_WINDOWS;
+  judge_calibration calibration = {0, 0};
+  if (calibrating)
+    windows = calibration_windows;
+  else
+    load_calibration(CALIBRATION_FILE, &calibration);
+
+  // Every player plays the same chart and is scored on their own
+  int players = screen.players;
+  judge judges[MAX_PLAYERS];
+  for (int p = 0; p < players; p++) {
+    if (judge_init(&judges[p], song_rows, num_note_rows, first_note_us,
+                   note_duration * 1000LL, windows, calibration))
       return 1;
-    }
+  }
 
-    if (pthread_create(&guitar_thread, NULL, update_guitar_state, NULL) != 0) {
-      perror("pthread_create(fb_update_thread) failed\n");
+  // With audio, the music keeps time for everything: the highway and the
+  // judge both follow where the song is being heard
+  audio_engine song_audio;
+  int playing_audio = options.audio_path != NULL;
+  if (playing_audio) {
+    if (audio_init(&song_audio, options.audio_path, sink,
+                   options.audio_sink_arg))
       return 1;
+    for (int p = 0; p < players; p++) {
+      judges[p].song_clock = audio_song_clock;
+      judges[p].song_clock_arg = &song_audio;
     }
   }
 
-  note_row song_rows[NUM_NOTE_ROWS];
-
-  char line[9]; // Buffer to store each line (8 characters + null terminator)
-  FILE *file = fopen("single_note_comaless.txt", "r");
+  // Strums are judged on each player's input thread as they arrive, with the
+  // time they happened, rather than once a frame here
+  display->listener = judge_input;
+  for (int p = 0; p < players; p++) {
+    display->listener_args[p] = &judges[p];
+    display->input_paths[p] = options.input_paths[p];
+  }
+  display->replay_path = options.replay_path;
+  display->frame_us = options.frame_us;
+
+  // Recording keeps each player's input on its way to their judge
+  static input_recorder recorders[MAX_PLAYERS];
+  if (options.record_path) {
+    display->listener = record_input;
+    for (int p = 0; p < players; p++) {
+      recorders[p].j = &judges[p];
+      recorders[p].player = p;
+      recorders[p].count = 0;
+      display->listener_args[p] = &recorders[p];
+    }
+  }
 
-  int i = 0;
-  while (fgets(line, sizeof(line), file) != NULL) {
-    // Remove the newline character if present
-    if (line[strlen(line) - 1] == '\n') {
-      line[strlen(line) - 1] = '\0';
+  // The autoplayer feeds each player's input path, and times the input on
+  // its way to the judge (or the recorder)
+  static autoplayer autoplayers[MAX_PLAYERS];
+  if (options.autoplay) {
+    for (int p = 0; p < players; p++) {
+      if (autoplay_init(&autoplayers[p], &judges[p], p,
+                        options.autoplay_offset_ms * 1000LL))
+        return 1;
+      autoplayers[p].listener = display->listener;
+      autoplayers[p].listener_arg = display->listener_args[p];
+      display->listener_args[p] = &autoplayers[p];
+      display->input_paths[p] = autoplayers[p].input_path;
     }
-    if (strlen(line) == 8) {
-      // printf("note: %s\n", line);
-      note_row note_row;
-      set_note(&note_row, line);
-      song_rows[i++] = note_row;
+    display->listener = autoplay_input;
+  }
+
+  // Latency is measured from when input reaches the game, before anything
+  // else hears about it
+  static latency_listener latency_listeners[MAX_PLAYERS];
+  if (options.latency) {
+    latency_enable();
+    for (int p = 0; p < players; p++) {
+      latency_listeners[p].listener = display->listener;
+      latency_listeners[p].listener_arg = display->listener_args[p];
+      latency_listeners[p].player = p;
+      latency_listeners[p].display = display;
+      display->listener_args[p] = &latency_listeners[p];
     }
+    display->listener = measure_input;
   }
 
-  fclose(file);
+  // Density is counted per measure of rows
+  chart_stats chart;
+  chart_analyze(song_rows, num_note_rows,
+                (int)(NOTES_PER_MEASURE * BEATS_PER_MEASURE), &chart);
 
-  int current_bottom_row_idx = 0, num_note_rows = 100;
-  double current_bottom_row_Y = 0;
-  int note_duration = round((60.0 / SONG_BPM) / NOTES_PER_MEASURE * 1000);
+  // Score, combo and progress around each guitar state line, and the side
+  // panels
+  hud song_hud;
+  if (hud_init(&song_hud, song.title, song.bpm, chart.notes,
+               options.hud_cache))
+    return 1;
+  long long song_length_ms =
+      first_note_us / 1000 + num_note_rows * note_duration;
+
+  // Frames are put together as a list of things to draw, then drawn in bands
+  // in parallel. The list from the frame before is kept, so only where the
+  // two differ is drawn again and sent to the display
+  static draw_list frame_lists[2];
+  draw_list *frame_list = &frame_lists[0], *last_list = &frame_lists[1];
+  static damage_list frame_damage;
+  int first_frame = 1;
+  rasterizer raster;
+  if (rasterizer_init(&raster, options.render_threads))
+    return 1;
 
-  // The Y coordinate of the middle of the guitar state line
-  int guitar_state_line_Y = WINDOW_HEIGHT - 24;
-  // How many pixels of "margin" (top and bottom) to apply to each note
-  int note_row_veritcal_padding = 8;
-  // THe total height including the 24x24 px sprite and the margin
-  int note_height_px = 24 + 2 * note_row_veritcal_padding;
-  // How many pixels each note row has to move down the screen in one ms
-  double note_row_pixels_per_ms = (double)(note_height_px) / note_duration;
+  if (display->init(display))
+    return 1;
 
   printf("---SONG INFORMATION---\n");
-  printf("BPM: %d\n", SONG_BPM);
+  printf("Players: %d\n", players);
+  printf("Title: %s\n", song.title);
+  printf("BPM: %d\n", song.bpm);
   printf("Beat duration: %dms\n", note_duration);
   printf("Note row pixels/ms: %f\n", note_row_pixels_per_ms);
+  chart_print_stats(&chart);
+  printf("Calibration: input %+dms, display %+dms\n",
+         calibration.input_offset_ms, calibration.display_offset_ms);
+  if (calibrating)
+    printf("CALIBRATING: strum each note as it crosses the line\n");
 
   // TODO: any start menu here
 
-  long long song_start_time = current_time_in_ms();
-  long long last_draw_time = song_start_time;
+  // Everything runs by the backend's clock, which for the sim backend is
+  // virtual time
+  long long song_start_time = backend_time_us(display);
+  for (int p = 0; p < players; p++)
+    judge_start(&judges[p], song_start_time);
+  if (playing_audio && audio_start(&song_audio))
+    return 1;
+  for (int p = 0; options.autoplay && p < players; p++) {
+    if (autoplay_start(&autoplayers[p]))
+      return 1;
+  }
+  // Every other thread has started, so they do not inherit this one's place
+  realtime_thread(REALTIME_RENDER, 0);
+  realtime_start();
+  arena_play_start();
 
   while (1) {
     // Fresh start
-    memset(next_frame, 0, WINDOW_WIDTH * WINDOW_HEIGHT * 4);
-
-    long long time_delta = current_time_in_ms() - last_draw_time;
-    last_draw_time = current_time_in_ms();
-
-    for (int row_on_screen = 0;
-         row_on_screen < WINDOW_HEIGHT / note_height_px + 1; row_on_screen++) {
-      if (current_bottom_row_idx + row_on_screen >= num_note_rows)
-        break; // We've run out of notes
-
-      note_row row = song_rows[current_bottom_row_idx + row_on_screen];
-
-      int row_y = round(current_bottom_row_Y - note_height_px * row_on_screen);
-
-      if (row.green)
-        draw_sprite(note_circles.green, next_frame, color_cols_x.green, row_y);
-      if (row.red)
-        draw_sprite(note_circles.red, next_frame, color_cols_x.red, row_y);
-      if (row.yellow)
-        draw_sprite(note_circles.yellow, next_frame, color_cols_x.yellow,
-                    row_y);
-      if (row.blue)
-        draw_sprite(note_circles.blue, next_frame, color_cols_x.blue, row_y);
-      if (row.orange)
-        draw_sprite(note_circles.orange, next_frame, color_cols_x.orange,
-                    row_y);
+    draw_list_clear(frame_list, BLACK);
+
+    double song_time_ms =
+        judge_song_time_us(&judges[0], backend_time_us(display)) / 1000.0;
+    // How far the note highway has scrolled since the song started. Row i is
+    // drawn at frame_scroll_px - i * note_height_px
+    int frame_scroll_px = round(song_time_ms * note_row_pixels_per_ms);
+
+    // Rows that have gone off the bottom of the screen are done with
+    int gone_px = frame_scroll_px - (screen.height + 8);
+    int bottom_row_idx = gone_px < 0 ? 0 : gone_px / note_height_px + 1;
+    if (bottom_row_idx >= num_note_rows) {
+      // We are done with the game
+      break;
     }
-
-    current_bottom_row_Y += note_row_pixels_per_ms * time_delta;
-
-    pthread_mutex_lock(&controller_mutex);
-    if (controller_state.strum) {
-      // Is the bottom note in a playable range, and did we try?
-      if (current_bottom_row_Y <= guitar_state_line_Y + 12 &&
-          current_bottom_row_Y >= guitar_state_line_Y - 12) {
-        if (hit_notes(controller_state, song_rows[current_bottom_row_idx])) {
-          // We hit the note!
-          current_bottom_row_idx++;
-          current_bottom_row_Y -= (24 + 2 * note_row_veritcal_padding);
-        } else
-          printf("MISS\n");
-      } else {
-        printf("MISS (None to hit)\n");
+    trace_begin("frame");
+
+    // Every highway goes into the same frame, drawn in one pass
+    trace_begin("highways");
+    int quit = 0;
+    latency_tag frame_latency = {0};
+    for (int p = 0; p < players; p++) {
+      int x = screen.highway_x[p];
+
+      draw_highway(frame_list, x, frame_scroll_px, beat_px,
+                   guitar_state_line_Y);
+
+      // Rows that went by unstrummed are missed now, not at the next strum
+      judge_sweep(&judges[p], backend_time_us(display));
+
+      for (int row_on_screen = 0;
+           row_on_screen < screen.height / note_height_px + 1;
+           row_on_screen++) {
+        int row_idx = bottom_row_idx + row_on_screen;
+        if (row_idx >= num_note_rows)
+          break; // We've run out of notes
+
+        // Notes that have been hit disappear
+        int result = judges[p].results[row_idx];
+        if (result != JUDGMENT_NONE && result != JUDGMENT_MISS)
+          continue;
+
+        int row_y = frame_scroll_px - note_height_px * row_idx;
+        draw_note_row(frame_list, &note_circles, song_rows[row_idx], x,
+                      row_y);
       }
-    }
 
-    // Draw the Guitar state line
-    draw_sprite(controller_state.green ? play_circles_held.green
-                                       : play_circles_released.green,
-                next_frame, color_cols_x.green, guitar_state_line_Y);
-    draw_sprite(controller_state.red ? play_circles_held.red
-                                     : play_circles_released.red,
-                next_frame, color_cols_x.red, guitar_state_line_Y);
-    draw_sprite(controller_state.yellow ? play_circles_held.yellow
-                                        : play_circles_released.yellow,
-                next_frame, color_cols_x.yellow, guitar_state_line_Y);
-    draw_sprite(controller_state.blue ? play_circles_held.blue
-                                      : play_circles_released.blue,
-                next_frame, color_cols_x.blue, guitar_state_line_Y);
-    draw_sprite(controller_state.orange ? play_circles_held.orange
-                                        : play_circles_released.orange,
-                next_frame, color_cols_x.orange, guitar_state_line_Y);
-    pthread_mutex_unlock(&controller_mutex);
-
-    // Is it time to shift the buffer because a note has gone off-screen?
-    if (round(current_bottom_row_Y) >= WINDOW_HEIGHT + 8) {
-      // The bottom row is off screen
-      current_bottom_row_idx++;
-      current_bottom_row_Y -= (24 + 2 * note_row_veritcal_padding);
-
-      if (current_bottom_row_idx >= num_note_rows) {
-        // We are done with the game
-        break;
+      if (display->poll_input(display, p, &controller_state[p]))
+        quit = 1; // The player quit
+      latency_poll(p, backend_time_us(display), &frame_latency);
+
+      // Draw the Guitar state line
+      draw_guitar_state_line(frame_list, &play_circles_held,
+                             &play_circles_released, &controller_state[p], x,
+                             guitar_state_line_Y);
+
+      // A row that was hit lights its circles up while it passes the line
+      int line_row_idx =
+          (frame_scroll_px - guitar_state_line_Y + note_height_px / 2) /
+          note_height_px;
+      if (line_row_idx >= 0 && line_row_idx < num_note_rows) {
+        int result = judges[p].results[line_row_idx];
+        if (result != JUDGMENT_NONE && result != JUDGMENT_MISS)
+          draw_note_row(frame_list, &note_circles, song_rows[line_row_idx],
+                        x, guitar_state_line_Y);
       }
     }
+    trace_end("highways");
+    if (quit) {
+      trace_end("frame");
+      break;
+    }
 
-    // Push next frame to buffer
-    pthread_mutex_lock(&framebuffer_mutex);
-    memcpy(framebuffer, next_frame, WINDOW_WIDTH * WINDOW_HEIGHT * 4);
-    pthread_mutex_unlock(&framebuffer_mutex);
+    trace_begin("hud");
+    hud_update(&song_hud, judges, song_time_ms, song_length_ms);
+    hud_draw(&song_hud, frame_list);
+    trace_end("hud");
+
+    // next_frame still holds the last frame, so only the damage is redrawn
+    trace_begin("rasterize");
+    if (first_frame)
+      damage_all(&frame_damage);
+    else
+      draw_list_damage(last_list, frame_list, &frame_damage);
+    rasterize(&raster, frame_list, &frame_damage, next_frame);
+    trace_end("rasterize");
+    draw_list *drawn = frame_list;
+    frame_list = last_list;
+    last_list = drawn;
+    first_frame = 0;
+
+    // Push next frame to the display
+    frame f = {.pixels = next_frame,
+               .scroll_px = frame_scroll_px,
+               .damage = &frame_damage,
+               .latency = frame_latency};
+    latency_submitted(&f.latency, backend_time_us(display));
+    trace_begin("submit");
+    display->submit_frame(display, &f);
+    trace_end("submit");
+    trace_begin("wait vsync");
+    display->wait_vsync(display);
+    trace_end("wait vsync");
+    trace_end("frame");
   }
 
+  arena_play_end();
+
   // TODO: game end
 
-  if (EMULATING_VGA)
-    VGAEmulator_destroy(&emulator);
-  // Clear sprites
-  unload_sprite(GH_circle_base);
-  unload_sprites(note_circles);
-  unload_sprites(play_circles_released);
-  unload_sprites(play_circles_held);
+  backend_stats stats;
+  display->stats(display, &stats);
+  print_backend_stats(display);
+  realtime_print_stats();
+  display->destroy(display);
+  for (int p = 0; options.autoplay && p < players; p++)
+    autoplay_destroy(&autoplayers[p]);
+  if (options.record_path)
+    save_recording(options.record_path, recorders, players);
+  if (playing_audio) {
+    audio_print_stats(&song_audio);
+    audio_destroy(&song_audio);
+  }
 
-  if (EMULATING_VGA)
-    free(framebuffer);
+  // The input threads are gone, so the judges are ours now
+  for (int p = 0; p < players; p++) {
+    judge_finish(&judges[p]);
+    if (players > 1)
+      printf("Player %d:\n", p + 1);
+    judge_print_stats(&judges[p]);
+    if (options.autoplay)
+      autoplay_print_stats(&autoplayers[p]);
+  }
+  hud_print_stats(&song_hud);
+  rasterizer_print_stats(&raster);
+  rasterizer_destroy(&raster);
+
+  // Backends that cannot see their frames on screen are held to when the
+  // push completed instead
+  int too_slow = 0;
+  latency_print_stats();
+  if (options.latency_limit_us) {
+    latency_hop end_to_end = latency_count(LATENCY_TO_SCREEN)
+                                 ? LATENCY_TO_SCREEN
+                                 : LATENCY_TO_DEVICE;
+    long long p99 = latency_percentile(end_to_end, 0.99);
+
+    if (p99 > options.latency_limit_us) {
+      printf("LATENCY OVER LIMIT: p99 %lldus, limit %lldus\n", p99,
+             options.latency_limit_us);
+      too_slow = 1;
+    }
+  }
+  if (song_index >= 0) {
+    library_print_stats(&library);
+    library_close(&library);
+  }
+  // Every other thread has been joined by now
+  trace_finish();
+
+  // Calibration is for the first player's guitar
+  if (calibrating) {
+    if (judges[0].num_errors < 8) {
+      printf("Too few notes hit to calibrate\n");
+    } else {
+      // Backends that can see when frames reach the screen give the display
+      // part directly; the strums make up the rest
+      calibration.display_offset_ms =
+          stats.frames_shown ? stats.present_us / stats.frames_shown / 1000
+                             : 0;
+      calibration.input_offset_ms = judge_median_error_us(&judges[0]) / 1000 -
+                                    calibration.display_offset_ms;
+      if (save_calibration(CALIBRATION_FILE, &calibration) == 0)
+        printf("Saved calibration: input %+dms, display %+dms\n",
+               calibration.input_offset_ms, calibration.display_offset_ms);
+    }
+  }
 
-  return 0;
+  // The frames, sprites, HUD and judges all go at once
+  arena_print_stats();
+  arena_destroy();
+
+  return too_slow;
 }
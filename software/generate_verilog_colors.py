@@ -11,7 +11,9 @@ if __name__ == "__main__":
                 break  # Stop reading when you reach the line containing palette[COLOR_COUNT]
         
         palette_start_line = i
-        print("case (pixel_data)")
+        # The power-on contents of vga_framebuffer.sv's palette RAM
+        print("initial begin")
+        print("  for (int i = 0; i < 64; i++) palette[i] = 24'hffffff;  // Default to white")
 
         # Extract {R, G, B} values from each line
         for i in range(palette_start_line, len(lines)):
@@ -22,7 +24,6 @@ if __name__ == "__main__":
                 rgb_values = (int(match.group(2)), int(match.group(3)), int(match.group(4)))
                 rgb_values = ['{:02x}'.format(x) for x in rgb_values]
                 color_index = i - palette_start_line
-                print(f"  6'd{color_index}: " + "{VGA_R, VGA_G, VGA_B} = " + f"24'h{rgb_values[0]}{rgb_values[1]}{rgb_values[2]}; // {color_name.capitalize()}")
-        
-        print("  default: {VGA_R, VGA_G, VGA_B} = 24'hffffff; // Default to white")
-        print("endcase")
\ No newline at end of file
+                print(f"  palette[{color_index}] = " + f"24'h{rgb_values[0]}{rgb_values[1]}{rgb_values[2]};  // {color_name.capitalize()}")
+
+        print("end")
\ No newline at end of file
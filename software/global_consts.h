@@ -1,9 +1,28 @@
 #ifndef GLOBAL_CONSTS_H
 #define GLOBAL_CONSTS_H
 
-#define WINDOW_WIDTH 150
-#define WINDOW_HEIGHT 480
+// The screen the VGA peripheral drives. Other backends can show anything up
+// to this size
+#define VGA_SCREEN_WIDTH 640
+#define VGA_SCREEN_HEIGHT 480
 
+// The note highway: five 30 px lanes
+#define HIGHWAY_WIDTH 150
+// Each player has their own highway, side by side with this much between
+// them when there is room
+#define MAX_PLAYERS 4
+#define HIGHWAY_GAP 20
+
+// Where everything goes on screen, set up once at startup from the command
+// line and read-only after that
+typedef struct {
+  int width, height; // Of every frame, in pixels
+  int players;
+  // Left edge of each player's note highway; panels fill the sides
+  int highway_x[MAX_PLAYERS];
+} screen_geometry;
+
+extern screen_geometry screen;
 extern int SCREEN_LINE_LENGTH;
 
 #endif /* GLOBAL_CONSTS_H */
@@ -28,30 +28,137 @@
 #include <linux/io.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
+#include <linux/of_irq.h>
+#include <linux/interrupt.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
 #include <linux/uaccess.h>
 #include "guitar_reader.h"
 
 #define DRIVER_NAME "note_reader"
 
-/* Device registers */
-#define FIRST_CHUNK(x) (x)
+/* Device registers, from the word addresses in guitar_reader.h */
+#define REGISTER(x, reg) ((x) + 4 * GUITAR_READER_REG_##reg)
+#define FIRST_CHUNK(x) REGISTER(x, STATE)
+#define FIFO_COUNT(x) REGISTER(x, FIFO_COUNT)
+#define EVENT_STATE(x) REGISTER(x, EVENT_STATE)
+#define EVENT_TIME(x) REGISTER(x, EVENT_TIME)
+#define CYCLE_COUNT(x) REGISTER(x, CYCLE_COUNT)
+#define IRQ_CONTROL(x) REGISTER(x, IRQ_CONTROL)
+
+#define FIFO_OVERFLOW GUITAR_READER_FIFO_OVERFLOW
+#define FIFO_COUNT_MASK GUITAR_READER_FIFO_COUNT_MASK
+#define IRQ_ENABLE GUITAR_READER_IRQ_ENABLE
+
+/* The device counts cycles of the 50 MHz system clock */
+#define NS_PER_CYCLE 20
 
 /*
- * Information about our device
+ * Information about one of our devices: there is one per guitar, each with
+ * its own registers and its own /dev node
  */
 struct guitar_reader_dev {
 	struct resource res; /* Resource: our registers */
 	void __iomem *virtbase; /* Where registers can be accessed in memory */
-} dev;
+	struct miscdevice misc;
+	char name[16]; /* note_reader, then note_reader1, note_reader2, ... */
+	unsigned int irq; /* FIFO not empty, or 0 if there is none to poll() */
+	wait_queue_head_t event_wait;
+	int events_ready; /* Set by the interrupt, cleared by read() */
+};
 
+/* Devices probed so far, for naming the next one */
+static int num_readers;
+
+/* The misc framework points private_data at our miscdevice on open() */
+static struct guitar_reader_dev *file_dev(struct file *f)
+{
+	return container_of(f->private_data, struct guitar_reader_dev, misc);
+}
 
 /*
 * Reads the guitar state
 */
-int read_guitar_state(void)
+static int read_guitar_state(struct guitar_reader_dev *dev)
 {
-	return ioread8(dev.virtbase);
+	return ioread32(FIRST_CHUNK(dev->virtbase));
+}
+
+/*
+ * Drain the device's event FIFO into userspace in one go.
+ * Returns the number of bytes read; 0 if no inputs have changed
+ */
+static ssize_t guitar_reader_read(struct file *f, char __user *buf,
+				  size_t len, loff_t *offset)
+{
+	struct guitar_reader_dev *dev = file_dev(f);
+	guitar_reader_event_t events[GUITAR_READER_FIFO_DEPTH];
+	u32 count, now_cycle;
+	u64 now_ns;
+	int i;
+
+	if (len < sizeof(guitar_reader_event_t))
+		return -EINVAL;
+
+	/* Every event counted here is older than now_cycle */
+	count = ioread32(FIFO_COUNT(dev->virtbase));
+	now_cycle = ioread32(CYCLE_COUNT(dev->virtbase));
+	now_ns = ktime_get_ns();
+
+	if (count & FIFO_OVERFLOW)
+		pr_warn("%s: event FIFO overflowed\n", dev->name);
+
+	count = min_t(u32, count & FIFO_COUNT_MASK,
+		      len / sizeof(guitar_reader_event_t));
+	count = min_t(u32, count, GUITAR_READER_FIFO_DEPTH);
+
+	for (i = 0; i < count; i++) {
+		events[i].state = ioread32(EVENT_STATE(dev->virtbase));
+		events[i].cycle = ioread32(EVENT_TIME(dev->virtbase)); /* Pops */
+		events[i].time_ns = now_ns -
+			(u64)(u32)(now_cycle - events[i].cycle) * NS_PER_CYCLE;
+	}
+
+	/*
+	 * Rearm the interrupt. It is held while the FIFO is not empty, so
+	 * anything still queued, or queued since, raises it again at once
+	 */
+	if (dev->irq) {
+		WRITE_ONCE(dev->events_ready, 0);
+		iowrite32(IRQ_ENABLE, IRQ_CONTROL(dev->virtbase));
+	}
+
+	if (copy_to_user(buf, events, count * sizeof(guitar_reader_event_t)))
+		return -EFAULT;
+
+	return count * sizeof(guitar_reader_event_t);
+}
+
+/* Readable once the interrupt has said there are events */
+static __poll_t guitar_reader_poll(struct file *f, poll_table *wait)
+{
+	struct guitar_reader_dev *dev = file_dev(f);
+
+	poll_wait(f, &dev->event_wait, wait);
+	if (READ_ONCE(dev->events_ready))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+/*
+ * The FIFO has events. The interrupt would stay raised until they are
+ * read, so mask it until read() has had them
+ */
+static irqreturn_t guitar_reader_irq(int irq, void *dev_id)
+{
+	struct guitar_reader_dev *dev = dev_id;
+
+	iowrite32(0, IRQ_CONTROL(dev->virtbase));
+	WRITE_ONCE(dev->events_ready, 1);
+	wake_up_interruptible(&dev->event_wait);
+	return IRQ_HANDLED;
 }
 
 /*
@@ -62,7 +169,7 @@ int read_guitar_state(void)
 static long guitar_reader_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 {
 	// int chunk = write_background();
-	int chunk = read_guitar_state();
+	int chunk = read_guitar_state(file_dev(f));
 	
 
 	switch (cmd) {
@@ -82,14 +189,19 @@ static long guitar_reader_ioctl(struct file *f, unsigned int cmd, unsigned long
 /* The operations our device knows how to do */
 static const struct file_operations guitar_reader_fops = {
 	.owner		= THIS_MODULE,
+	.read		= guitar_reader_read,
+	.poll		= guitar_reader_poll,
 	.unlocked_ioctl = guitar_reader_ioctl,
 };
 
-/* Information about our device for the "misc" framework -- like a char dev */
-static struct miscdevice guitar_reader_misc_device = {
-	.minor		= MISC_DYNAMIC_MINOR,
-	.name		= DRIVER_NAME,
-	.fops		= &guitar_reader_fops,
+/*
+ * Without the interrupt there is nothing to wake poll() with, so there is
+ * no poll(): epoll refuses the device and userspace reads it on a timer
+ */
+static const struct file_operations guitar_reader_unpolled_fops = {
+	.owner		= THIS_MODULE,
+	.read		= guitar_reader_read,
+	.unlocked_ioctl = guitar_reader_ioctl,
 };
 
 /*
@@ -98,47 +210,90 @@ static struct miscdevice guitar_reader_misc_device = {
  */
 static int __init guitar_reader_probe(struct platform_device *pdev)
 {
+	struct guitar_reader_dev *dev;
 	int ret;
 
-	/* Register ourselves as a misc device: creates /dev/guitar_reader */
-	ret = misc_register(&guitar_reader_misc_device);
+	dev = devm_kzalloc(&pdev->dev, sizeof(*dev), GFP_KERNEL);
+	if (dev == NULL)
+		return -ENOMEM;
 
 	/* Get the address of our registers from the device tree */
-	ret = of_address_to_resource(pdev->dev.of_node, 0, &dev.res);
-	if (ret) {
-		ret = -ENOENT;
-		goto out_deregister;
-	}
+	ret = of_address_to_resource(pdev->dev.of_node, 0, &dev->res);
+	if (ret)
+		return -ENOENT;
 
 	/* Make sure we can use these registers */
-	if (request_mem_region(dev.res.start, resource_size(&dev.res),
-			       DRIVER_NAME) == NULL) {
-		ret = -EBUSY;
-		goto out_deregister;
-	}
+	if (request_mem_region(dev->res.start, resource_size(&dev->res),
+			       DRIVER_NAME) == NULL)
+		return -EBUSY;
 
 	/* Arrange access to our registers */
-	dev.virtbase = of_iomap(pdev->dev.of_node, 0);
-	if (dev.virtbase == NULL) {
+	dev->virtbase = of_iomap(pdev->dev.of_node, 0);
+	if (dev->virtbase == NULL) {
 		ret = -ENOMEM;
 		goto out_release_mem_region;
 	}
-        
+
+	/* note_reader for the first guitar and note_readerN for the rest */
+	if (num_readers == 0)
+		snprintf(dev->name, sizeof(dev->name), DRIVER_NAME);
+	else
+		snprintf(dev->name, sizeof(dev->name), DRIVER_NAME "%d",
+			 num_readers);
+
+	/*
+	 * The FIFO interrupt lets poll() sleep until there are events. A
+	 * bitstream without it still works, read on a timer
+	 */
+	init_waitqueue_head(&dev->event_wait);
+	dev->irq = irq_of_parse_and_map(pdev->dev.of_node, 0);
+	if (dev->irq) {
+		ret = request_irq(dev->irq, guitar_reader_irq, 0, dev->name,
+				  dev);
+		if (ret)
+			goto out_unmap;
+		iowrite32(IRQ_ENABLE, IRQ_CONTROL(dev->virtbase));
+	} else {
+		pr_warn("%s: no interrupt, so no poll()\n", dev->name);
+	}
+
+	/* Register ourselves as a misc device: creates /dev/<name> */
+	dev->misc.minor = MISC_DYNAMIC_MINOR;
+	dev->misc.name = dev->name;
+	dev->misc.fops = dev->irq ? &guitar_reader_fops :
+		&guitar_reader_unpolled_fops;
+	ret = misc_register(&dev->misc);
+	if (ret)
+		goto out_free_irq;
+
+	num_readers++;
+	platform_set_drvdata(pdev, dev);
 	return 0;
 
+out_free_irq:
+	if (dev->irq) {
+		iowrite32(0, IRQ_CONTROL(dev->virtbase));
+		free_irq(dev->irq, dev);
+	}
+out_unmap:
+	iounmap(dev->virtbase);
 out_release_mem_region:
-	release_mem_region(dev.res.start, resource_size(&dev.res));
-out_deregister:
-	misc_deregister(&guitar_reader_misc_device);
+	release_mem_region(dev->res.start, resource_size(&dev->res));
 	return ret;
 }
 
 /* Clean-up code: release resources */
 static int guitar_reader_remove(struct platform_device *pdev)
 {
-	iounmap(dev.virtbase);
-	release_mem_region(dev.res.start, resource_size(&dev.res));
-	misc_deregister(&guitar_reader_misc_device);
+	struct guitar_reader_dev *dev = platform_get_drvdata(pdev);
+
+	misc_deregister(&dev->misc);
+	if (dev->irq) {
+		iowrite32(0, IRQ_CONTROL(dev->virtbase));
+		free_irq(dev->irq, dev);
+	}
+	iounmap(dev->virtbase);
+	release_mem_region(dev->res.start, resource_size(&dev->res));
 	return 0;
 }
 
@@ -2,6 +2,41 @@
 #define _GUITAR_READER_H
 
 #include <linux/ioctl.h>
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+/* Events the device can hold before it starts dropping them */
+#define GUITAR_READER_FIFO_DEPTH 16
+
+/*
+ * The peripheral's registers (note_reader.sv), by word address. The
+ * driver, the co-simulation harness and the testbench all use these
+ */
+#define GUITAR_READER_REG_STATE 0
+#define GUITAR_READER_REG_FIFO_COUNT 1
+#define GUITAR_READER_REG_EVENT_STATE 2
+#define GUITAR_READER_REG_EVENT_TIME 3 /* Reading it pops the event */
+#define GUITAR_READER_REG_CYCLE_COUNT 4
+#define GUITAR_READER_REG_IRQ_CONTROL 5
+
+/* FIFO count: events waiting, and whether any were dropped since last read */
+#define GUITAR_READER_FIFO_OVERFLOW 0x80000000
+#define GUITAR_READER_FIFO_COUNT_MASK 0x1f
+/* Irq control: raise irq while the FIFO holds events */
+#define GUITAR_READER_IRQ_ENABLE 1
+
+/*
+ * One change of the debounced inputs, as returned by read(). time_ns is on
+ * the CLOCK_MONOTONIC timeline, so userspace can compare it to its own clock
+ */
+typedef struct {
+	uint64_t time_ns; /* When the inputs settled */
+	uint32_t cycle;   /* Device cycle count at that time */
+	uint32_t state;   /* Inputs after the change, as GUITAR_READER_READ */
+} guitar_reader_event_t;
 
 #define GUITAR_READER_MAGIC 'q'
 
@@ -1,20 +1,17 @@
 #include "guitar_state.h"
 #include "guitar_reader.h"
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
 
 pthread_t keyboard_thread;
 int RUNNING = 1;
 
 void init_guitar_state(guitar_state *gs) {
-  gs->green = 0;
-  gs->red = 0;
-  gs->yellow = 0;
-  gs->blue = 0;
-  gs->orange = 0;
+  gs->frets = 0;
   gs->strum = 0;
 }
 
@@ -34,6 +31,20 @@ char *read_note(int guitar_fd) {
   return result_string;
 }
 
+int read_guitar_events(int guitar_fd, guitar_reader_event_t *events, int max) {
+  ssize_t bytes = read(guitar_fd, events, max * sizeof(guitar_reader_event_t));
+
+  if (bytes < 0) {
+    // An empty FIFO opened O_NONBLOCK just has nothing yet
+    if (errno == EAGAIN)
+      return 0;
+    perror("read(/dev/note_reader) failed");
+    return 0;
+  }
+
+  return bytes / sizeof(guitar_reader_event_t);
+}
+
 char *hex_to_binary(char hex) {
   switch (hex) {
   case '0':
@@ -74,28 +85,22 @@ char *hex_to_binary(char hex) {
 }
 
 // Function to convert a hexadecimal string to its binary representation
-char *hex_string_to_binary(const char *hex_string) {
+char *hex_string_to_binary(const char *hex_string, char *binary_string,
+                           size_t size) {
   size_t length = strlen(hex_string);
   size_t binary_length =
       length * 4; // Each hexadecimal character represents 4 bits
-  char *binary_string =
-      (char *)malloc(binary_length + 1); // +1 for null terminator
 
-  if (binary_string == NULL) {
-    fprintf(stderr, "Memory allocation error\n");
+  if (binary_length + 1 > size) // +1 for null terminator
     return NULL;
-  }
-
-  binary_string[binary_length] = '\0'; // Null terminate the binary string
 
   for (size_t i = 0; i < length; i++) {
     char *binary_digit = hex_to_binary(hex_string[i]);
-    if (binary_digit == NULL) {
-      free(binary_string);
+    if (binary_digit == NULL)
       return NULL;
-    }
-    strcat(binary_string, binary_digit);
+    memcpy(binary_string + i * 4, binary_digit, 4);
   }
+  binary_string[binary_length] = '\0'; // Null terminate the binary string
 
   return binary_string;
 }
@@ -105,19 +110,20 @@ void set_note_guitar(guitar_state *guitar_state, const char *binary_string) {
     return; // Error handling: Ensure note_state and binary_string are not NULL
   }
 
-  // Convert the binary string to integer values
-  int green = binary_string[7] - '0';
-  int red = binary_string[6] - '0';
-  int yellow = binary_string[5] - '0';
-  int blue = binary_string[4] - '0';
-  int orange = binary_string[3] - '0';
-  int strum = binary_string[2] - '0';
-
-  // Assign the values to the struct fields
-  guitar_state->green = !green;
-  guitar_state->red = !red;
-  guitar_state->yellow = !yellow;
-  guitar_state->blue = !blue;
-  guitar_state->orange = !orange;
-  guitar_state->strum = strum;
-}
\ No newline at end of file
+  // The last character is green, the one before it red, and so on. The
+  // frets read 0 while held
+  guitar_state->frets = 0;
+  for (int fret = 0; fret < NUM_FRETS; fret++)
+    guitar_state->frets |= (binary_string[7 - fret] == '0') << fret;
+  guitar_state->strum = binary_string[2] - '0';
+}
+
+void set_guitar_state_bits(guitar_state *guitar_state, unsigned int bits) {
+  if (guitar_state == NULL) {
+    return;
+  }
+
+  // The device has the frets in the same order, reading 0 while held
+  guitar_state->frets = ~bits & ALL_FRETS;
+  guitar_state->strum = !!(bits & 0x20);
+}
@@ -1,19 +1,44 @@
 #ifndef GUITAR_STATE_H
 #define GUITAR_STATE_H
 
+#include "guitar_reader.h"
+#include <stddef.h>
+
+// One bit per fret, in lane order from the left. Chart rows use the same
+// bits, so matching a chord is a single compare
+#define FRET_GREEN 0x01
+#define FRET_RED 0x02
+#define FRET_YELLOW 0x04
+#define FRET_BLUE 0x08
+#define FRET_ORANGE 0x10
+#define NUM_FRETS 5
+#define ALL_FRETS 0x1F
+
 typedef struct {
-  int green;
-  int red;
-  int yellow;
-  int blue;
-  int orange;
-  int strum;
+  unsigned char frets; // FRET_* bits of the frets held down
+  unsigned char strum;
 } guitar_state;
 
+// Told about each change of controller state as it happens, with when it
+// happened on the current_time_in_us() clock. strum is only set on the
+// change that strummed
+typedef void (*guitar_listener)(void *arg, const guitar_state *gs,
+                                long long time_us);
+
 void init_guitar_state(guitar_state *gs);
 
 char *read_note(int guitar_fd);
 char *hex_to_binary(char hex);
-char *hex_string_to_binary(const char *hex_string);
+// Writes hex_string's bits, 4 characters a digit, into binary_string, which
+// holds size bytes. Returns binary_string, or NULL if a digit is not hex or
+// the bits do not fit
+char *hex_string_to_binary(const char *hex_string, char *binary_string,
+                           size_t size);
 void set_note_guitar(guitar_state *guitar_state, const char *binary_string);
+
+// Reads up to max queued input changes from the device, or from a FIFO of
+// the same events; returns how many were read
+int read_guitar_events(int guitar_fd, guitar_reader_event_t *events, int max);
+// Sets guitar_state from the device's input bits, as set_note_guitar does
+void set_guitar_state_bits(guitar_state *guitar_state, unsigned int bits);
 #endif
@@ -0,0 +1,589 @@
+#include "backend.h"
+#include "arena.h"
+#include "colors.h"
+#include "global_consts.h"
+#include "guitar_reader.h"
+#include "guitar_state.h"
+#include "helpers.h"
+#include "latency.h"
+#include "reactor.h"
+#include "realtime.h"
+#include "trace.h"
+#include "vga_framebuffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// First screen row of the non-scrolling region holding the guitar state line.
+// Only the highway's columns scroll; the side panels stay put
+#define SCROLL_FIXED_START (VGA_SCREEN_HEIGHT - 48)
+// Marks a pixel whose contents on the device are unknown
+#define PIXEL_UNKNOWN 0xFF
+// A push that takes longer than a 60 Hz frame has made the display skip one
+#define FRAME_US 16667
+// How often inputs that cannot be waited on are read: a guitar whose
+// note_reader has no interrupt, so its device has no poll(). Events carry
+// their own timestamps, so this only delays them, it does not move them
+#define DEVICE_POLL_US 2000
+
+// What the device holds in one of its two pages
+typedef struct {
+  // Color index per pixel
+  unsigned char shown[VGA_SCREEN_HEIGHT][VGA_SCREEN_WIDTH];
+  int scroll_px; // framebuffer_scroll_px the page was last drawn for
+  int offset;    // Scroll offset the page is shown with
+  int cleared;   // Whether the blitter has cleared it yet
+} device_page;
+
+// One player's input: their own device or FIFO, and lock, so players never
+// wait on each other. All of them are read on the input reactor's thread
+typedef struct {
+  backend *self;
+  int player;
+  int fd;
+  int polled; // Read from the device timer rather than when ready
+  int strum_was_down;
+  pthread_mutex_t mutex;
+  guitar_state state; // Protected by mutex
+} player_input;
+
+static int vga_framebuffer_fd;
+static pthread_t fb_update_thread;
+static player_input inputs[MAX_PLAYERS];
+static reactor input_reactor;
+static volatile int running;
+
+static unsigned char *framebuffer;
+// How far the note highway in framebuffer has scrolled since the song started
+static int framebuffer_scroll_px;
+// Frames put in framebuffer so far, and how many of those the display has
+// flipped to. Signalled through vsync_cond each vblank
+static long long framebuffer_seq, displayed_seq;
+static long long framebuffer_submit_us; // When framebuffer was last filled
+// The earliest input framebuffer shows that no push has taken yet
+static latency_tag framebuffer_latency;
+// What has changed in framebuffer since each page was last drawn
+static damage_list pending_damage[2];
+static pthread_mutex_t framebuffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vsync_cond = PTHREAD_COND_INITIALIZER;
+static backend_stats stats; // Protected by framebuffer_mutex
+
+// Reads everything the player's input has queued. The device queues every
+// debounced change, so nothing is lost between reads; replay them in order
+static void read_player_input(void *arg, int fd) {
+  player_input *input = (player_input *)arg;
+  backend *self = input->self;
+  guitar_reader_event_t events[GUITAR_READER_FIFO_DEPTH];
+  int num_events;
+  (void)fd;
+
+  while ((num_events = read_guitar_events(input->fd, events,
+                                          GUITAR_READER_FIFO_DEPTH)) > 0) {
+    trace_lock(&input->mutex, "wait input mutex");
+    for (int i = 0; i < num_events; i++) {
+      guitar_state note;
+      set_guitar_state_bits(&note, events[i].state);
+
+      // Listeners hear about the strum once, when it happened
+      int strum_down = note.strum;
+      note.strum = strum_down && !input->strum_was_down;
+      input->strum_was_down = strum_down;
+      if (self->listener) {
+        trace_begin("judge input");
+        self->listener(self->listener_args[input->player], &note,
+                       events[i].time_ns / 1000);
+        trace_end("judge input");
+      }
+
+      // A strum stays latched until the game loop has picked it up
+      note.strum = note.strum || input->state.strum;
+
+      input->state = note;
+    }
+    pthread_mutex_unlock(&input->mutex);
+  }
+}
+
+// Reads the inputs the reactor cannot wait on
+static void poll_player_inputs(void *arg, int fd) {
+  (void)arg;
+  (void)fd;
+
+  for (int p = 0; p < screen.players; p++) {
+    if (inputs[p].polled)
+      read_player_input(&inputs[p], inputs[p].fd);
+  }
+}
+
+// Opens where a player's input comes from: their own guitar's device unless
+// told otherwise. Non-blocking, so a FIFO opens before anything writes to it
+static int open_player_input(backend *self, player_input *input, int player) {
+  const char *path = self->input_paths[player];
+  char device[32];
+
+  // The first guitar is /dev/note_reader, the rest are numbered
+  if (path == NULL) {
+    if (player == 0)
+      snprintf(device, sizeof(device), "/dev/note_reader");
+    else
+      snprintf(device, sizeof(device), "/dev/note_reader%d", player);
+    path = device;
+  }
+
+  input->self = self;
+  input->player = player;
+  input->polled = 0;
+  input->strum_was_down = 0;
+  init_guitar_state(&input->state);
+  pthread_mutex_init(&input->mutex, NULL);
+  if ((input->fd = open(path, O_RDONLY | O_NONBLOCK)) == -1) {
+    fprintf(stderr, "could not open %s for player %d\n", path, player + 1);
+    return -1;
+  }
+
+  return 0;
+}
+
+// A run of packed words bound for consecutive buffer positions
+typedef struct {
+  off_t offset; // Where it starts, as a VGA_FRAMEBUFFER_OFFSET()
+  size_t count; // Number of words
+  const uint32_t *words;
+} packed_run;
+
+// Sends the queued packed run with a single pwrite() and starts a new one
+// after it
+static void write_packed_run(packed_run *run) {
+  if (run->count == 0)
+    return;
+
+  size_t bytes = run->count * sizeof(uint32_t);
+  if (pwrite(vga_framebuffer_fd, run->words, bytes, run->offset) !=
+      (ssize_t)bytes) {
+    perror("pwrite(/dev/vga_framebuffer) failed");
+  }
+  stats.transfers++;
+  run->words += run->count;
+  run->count = 0;
+}
+
+// Where the packed words for the next changed span go
+typedef struct {
+  packed_run run;
+  uint32_t *next_word;
+  int run_end; // Buffer pixel number just past the queued run
+} packed_queue;
+
+// Queues the pixels of one screen row, from column first_col up to end_col,
+// that differ from what the page shows. They live on buffer_row
+static void queue_changed_span(packed_queue *queue, device_page *page,
+                               const unsigned char *colors, int pixel_row,
+                               int buffer_row, int first_col, int end_col) {
+  int first = -1, last = -1;
+
+  for (int col = first_col; col < end_col; col++) {
+    if (page->shown[pixel_row][col] != colors[col]) {
+      if (first < 0)
+        first = col;
+      last = col;
+    }
+  }
+
+  if (first < 0)
+    return;
+
+  // Packed writes cover whole, aligned words, so widen the span to them
+  first -= first % PIXELS_PER_WORD;
+  int span =
+      (last - first) / PIXELS_PER_WORD * PIXELS_PER_WORD + PIXELS_PER_WORD;
+
+  int start = buffer_row * VGA_SCREEN_WIDTH + first;
+  if (start != queue->run_end) {
+    write_packed_run(&queue->run);
+    queue->run.offset = VGA_FRAMEBUFFER_OFFSET(buffer_row, first);
+  }
+  for (int col = first; col < first + span; col += PIXELS_PER_WORD) {
+    *queue->next_word++ = packed_pixel_writedata(&colors[col]);
+    queue->run.count++;
+  }
+  memcpy(&page->shown[pixel_row][first], &colors[first], span);
+  queue->run_end = start + span;
+}
+
+// The columns of one screen row that are damaged, widened to whole packed
+// words, in order. Returns how many spans there are
+static int damaged_spans(const damage_list *damage, int row, int *starts,
+                         int *ends) {
+  int spans = 0;
+
+  for (int i = 0; i < damage->count; i++) {
+    const rect *r = &damage->rects[i];
+    if (row < r->y || row >= r->y + r->height)
+      continue;
+
+    int start = r->x - r->x % PIXELS_PER_WORD;
+    int end = (r->x + r->width + PIXELS_PER_WORD - 1) / PIXELS_PER_WORD *
+              PIXELS_PER_WORD;
+    int at = spans++;
+    for (; at > 0 && starts[at - 1] > start; at--) {
+      starts[at] = starts[at - 1];
+      ends[at] = ends[at - 1];
+    }
+    starts[at] = start;
+    ends[at] = end;
+  }
+  return spans;
+}
+
+// Looks up the colors of framebuffer pixels first_col up to end_col on one
+// row, into the same columns of colors
+static void color_span(int pixel_row, int first_col, int end_col,
+                       unsigned char *colors) {
+  const unsigned char *pixel =
+      framebuffer + pixel_row * SCREEN_LINE_LENGTH + first_col * 4;
+  RGB last_rgb = {0, 0, 0};
+  int last_color = get_color_from_rgb(last_rgb) & 0x3F;
+
+  // Neighbouring pixels are mostly the same color, so only look up the ones
+  // that differ from the pixel before
+  for (int pixel_col = first_col; pixel_col < end_col;
+       pixel_col++, pixel += 4) {
+    RGB pixel_rgb = {pixel[2], pixel[1], pixel[0]};
+    if (pixel_rgb.R != last_rgb.R || pixel_rgb.G != last_rgb.G ||
+        pixel_rgb.B != last_rgb.B) {
+      last_rgb = pixel_rgb;
+      last_color = get_color_from_rgb(pixel_rgb) & 0x3F;
+    }
+    colors[pixel_col] = last_color;
+  }
+}
+
+// Clears a page that has never been drawn with one blitter fill, so its
+// first frame only sends what is not background
+static void clear_page(device_page *page) {
+  RGB black = {0, 0, 0};
+  vga_framebuffer_blit_t fill = {.op = VGA_FRAMEBUFFER_BLIT_FILL,
+                                 .width = VGA_SCREEN_WIDTH,
+                                 .height = VGA_SCREEN_HEIGHT,
+                                 .color = get_color_from_rgb(black) & 0x3F};
+  vga_framebuffer_blits_t blits = {.count = 1, .blits = &fill};
+
+  page->cleared = 1; // Either way; a failed clear just leaves it unknown
+  if (ioctl(vga_framebuffer_fd, VGA_FRAMEBUFFER_BLIT, &blits)) {
+    perror("ioctl(VGA_FRAMEBUFFER_BLIT) failed");
+    return;
+  }
+  memset(page->shown, fill.color, sizeof(page->shown));
+}
+
+static void *update_framebuffer(void *arg) {
+  (void)arg; // Suppress warning
+
+  static device_page pages[2];
+  static uint32_t
+      packed_words[VGA_SCREEN_WIDTH * VGA_SCREEN_HEIGHT / PIXELS_PER_WORD];
+  int back = 1; // The page not on screen, which all writes go to
+  // One scrolled window covers every highway and the gaps between them
+  int highway_start = screen.highway_x[0];
+  int highway_end = screen.highway_x[screen.players - 1] + HIGHWAY_WIDTH;
+  int highway_width = highway_end - highway_start;
+  vga_framebuffer_scroll_t scroll = {.offset = 0,
+                                     .fixed_start = SCROLL_FIXED_START,
+                                     .first_column = highway_start,
+                                     .end_column = highway_end};
+
+  trace_thread("framebuffer push");
+  realtime_thread(REALTIME_PUSH, 0);
+  arena_guard_thread();
+  memset(pages, 0, sizeof(pages));
+  memset(pages[0].shown, PIXEL_UNKNOWN, sizeof(pages[0].shown));
+  memset(pages[1].shown, PIXEL_UNKNOWN, sizeof(pages[1].shown));
+  if (ioctl(vga_framebuffer_fd, VGA_FRAMEBUFFER_SET_SCROLL, &scroll)) {
+    perror("ioctl(VGA_FRAMEBUFFER_SET_SCROLL) failed");
+  }
+
+  while (running) {
+    device_page *page = &pages[back];
+
+    trace_lock(&framebuffer_mutex, "wait framebuffer_mutex");
+    trace_begin("push");
+    long long seq = framebuffer_seq, submit_us = framebuffer_submit_us;
+    long long push_start = current_time_in_us();
+    latency_tag latency = framebuffer_latency;
+    framebuffer_latency.tagged = 0;
+
+    // The hardware scrolls what the page already has in the highways; only
+    // the rows that scrolled into view and pixels that actually changed need
+    // to be written
+    int delta = framebuffer_scroll_px - page->scroll_px;
+    for (int row = SCROLL_FIXED_START - 1; delta != 0 && row >= 0; row--) {
+      unsigned char *shown = &page->shown[row][highway_start];
+
+      if (delta > 0 && row >= delta && delta < SCROLL_FIXED_START)
+        memcpy(shown, &page->shown[row - delta][highway_start],
+               highway_width);
+      else
+        memset(shown, PIXEL_UNKNOWN, highway_width);
+    }
+    page->scroll_px = framebuffer_scroll_px;
+    page->offset =
+        (page->offset - delta % SCROLL_FIXED_START + SCROLL_FIXED_START) %
+        SCROLL_FIXED_START;
+    if (!page->cleared)
+      clear_page(page);
+
+    // Only what changed since the page was last drawn is looked at. When
+    // the page scrolls, what the hardware moved in the highways has to be
+    // checked too, so they count as changed
+    damage_list *damage = &pending_damage[back];
+    if (delta != 0)
+      damage_add(damage, highway_start, 0, highway_width, SCROLL_FIXED_START);
+
+    // Changed spans go out as packed runs; spans that continue where the
+    // previous one ended share a single run, so a full redraw is one write
+    packed_queue queue = {.run = {.count = 0, .words = packed_words},
+                          .next_word = packed_words,
+                          .run_end = -1};
+
+    for (int pixel_row = 0; pixel_row < VGA_SCREEN_HEIGHT; pixel_row++) {
+      int starts[MAX_DAMAGE_RECTS], ends[MAX_DAMAGE_RECTS];
+      int spans = damaged_spans(damage, pixel_row, starts, ends);
+
+      for (int i = 0; i < spans; i++) {
+        unsigned char colors[VGA_SCREEN_WIDTH];
+
+        color_span(pixel_row, starts[i], ends[i], colors);
+        if (pixel_row >= SCROLL_FIXED_START) {
+          queue_changed_span(&queue, page, colors, pixel_row, pixel_row,
+                             starts[i], ends[i]);
+          continue;
+        }
+
+        // Left panel, highways and right panel, each with its own buffer
+        // row
+        int highway_row = (pixel_row + page->offset) % SCROLL_FIXED_START;
+        queue_changed_span(&queue, page, colors, pixel_row, pixel_row,
+                           starts[i],
+                           ends[i] < highway_start ? ends[i] : highway_start);
+        queue_changed_span(
+            &queue, page, colors, pixel_row, highway_row,
+            starts[i] > highway_start ? starts[i] : highway_start,
+            ends[i] < highway_end ? ends[i] : highway_end);
+        queue_changed_span(&queue, page, colors, pixel_row, pixel_row,
+                           starts[i] > highway_end ? starts[i] : highway_end,
+                           ends[i]);
+      }
+    }
+    write_packed_run(&queue.run);
+    damage_clear(damage);
+    long long push_end = current_time_in_us();
+    long long push_us = push_end - push_start;
+    latency_pushed(&latency, push_end);
+    stats.transfer_us += push_us;
+    trace_end("push");
+    if (push_us > FRAME_US)
+      trace_instant("push overran frame");
+    pthread_mutex_unlock(&framebuffer_mutex);
+
+    // Show the finished page from the next vblank on
+    uint32_t offset = page->offset, vblank_count;
+    if (ioctl(vga_framebuffer_fd, VGA_FRAMEBUFFER_FLIP, &offset)) {
+      perror("ioctl(VGA_FRAMEBUFFER_FLIP) failed");
+    }
+    // Until the vblank has latched the flip, the other page is still on
+    // screen and must not be written, so a wait cut short is waited again
+    trace_begin("wait vblank");
+    while (ioctl(vga_framebuffer_fd, VGA_FRAMEBUFFER_WAIT_VBLANK,
+                 &vblank_count)) {
+      if (errno != EINTR) {
+        perror("ioctl(VGA_FRAMEBUFFER_WAIT_VBLANK) failed");
+        break;
+      }
+    }
+    latency_shown(&latency, current_time_in_us());
+    trace_end("wait vblank");
+    back ^= 1;
+
+    trace_lock(&framebuffer_mutex, "wait framebuffer_mutex");
+    if (seq != displayed_seq) {
+      stats.frames_shown++;
+      stats.present_us += current_time_in_us() - submit_us;
+    }
+    displayed_seq = seq;
+    pthread_cond_broadcast(&vsync_cond);
+    pthread_mutex_unlock(&framebuffer_mutex);
+  }
+  return NULL;
+}
+
+// The device's palette comes up with the colors it was built with; make it
+// match palette[] as it is now
+static int upload_palette(void) {
+  uint32_t colors[COLOR_COUNT];
+  vga_framebuffer_palette_t upload = {
+      .first = 0, .count = COLOR_COUNT, .colors = colors};
+
+  for (int i = 0; i < COLOR_COUNT; i++)
+    colors[i] = palette[i].R << 16 | palette[i].G << 8 | palette[i].B;
+  if (ioctl(vga_framebuffer_fd, VGA_FRAMEBUFFER_SET_PALETTE, &upload)) {
+    perror("ioctl(VGA_FRAMEBUFFER_SET_PALETTE) failed");
+    return 1;
+  }
+  return 0;
+}
+
+static int hardware_init(backend *self) {
+  // The device always shows the whole screen, and packed writes need the
+  // highways to start and end on word boundaries
+  if (screen.width != VGA_SCREEN_WIDTH || screen.height != VGA_SCREEN_HEIGHT ||
+      screen.highway_x[0] % PIXELS_PER_WORD ||
+      screen.highway_x[screen.players - 1] % PIXELS_PER_WORD) {
+    fprintf(stderr, "The VGA framebuffer only shows %dx%d\n",
+            VGA_SCREEN_WIDTH, VGA_SCREEN_HEIGHT);
+    return 1;
+  }
+
+  if ((framebuffer = arena_alloc(screen.width * screen.height * 4)) == NULL) {
+    perror("Error allocating framebuffer!\n");
+    return 1;
+  }
+  realtime_prefault(framebuffer, screen.width * screen.height * 4);
+  // Neither page has been drawn
+  damage_all(&pending_damage[0]);
+  damage_all(&pending_damage[1]);
+
+  // Set up VGA framebuffer connection
+  if ((vga_framebuffer_fd = open("/dev/vga_framebuffer", O_WRONLY)) == -1) {
+    perror("could not open /dev/vga_framebuffer\n");
+    return -1;
+  }
+  if (upload_palette())
+    return 1;
+
+  // Input is read as soon as it arrives: FIFOs and the guitar's interrupt
+  // wake the reactor up, and devices that cannot are read on a timer
+  int any_polled = 0;
+  if (reactor_init(&input_reactor, "input reactor", REALTIME_INPUT))
+    return 1;
+  for (int p = 0; p < screen.players; p++) {
+    if (open_player_input(self, &inputs[p], p))
+      return -1;
+    if (reactor_add_fd(&input_reactor, inputs[p].fd, read_player_input,
+                       &inputs[p]))
+      any_polled = inputs[p].polled = 1;
+  }
+  if (any_polled && reactor_add_timer(&input_reactor, DEVICE_POLL_US,
+                                      poll_player_inputs, NULL))
+    return 1;
+
+  running = 1;
+
+  // Pushing frames is the heavy work, and keeps a thread to itself
+  if (pthread_create(&fb_update_thread, NULL, &update_framebuffer, NULL) != 0) {
+    perror("pthread_create(fb_update_thread) failed\n");
+    return 1;
+  }
+
+  return reactor_start(&input_reactor);
+}
+
+// The device only gets whatever is latest when the push thread gets to it
+static void hardware_submit_frame(backend *self, const frame *f) {
+  (void)self;
+
+  trace_lock(&framebuffer_mutex, "wait framebuffer_mutex");
+  damage_copy(f->damage, framebuffer, f->pixels);
+  for (int page = 0; page < 2; page++) {
+    if (f->damage == NULL)
+      damage_all(&pending_damage[page]);
+    else
+      damage_merge(&pending_damage[page], f->damage);
+  }
+  framebuffer_scroll_px = f->scroll_px;
+  framebuffer_submit_us = current_time_in_us();
+  latency_merge(&framebuffer_latency, &f->latency);
+  framebuffer_seq++;
+  stats.frames_submitted++;
+  pthread_mutex_unlock(&framebuffer_mutex);
+}
+
+static int hardware_poll_input(backend *self, int player, guitar_state *gs) {
+  player_input *input = &inputs[player];
+  (void)self;
+
+  pthread_mutex_lock(&input->mutex);
+  *gs = input->state;
+  input->state.strum = 0; // Each strum is judged once
+  pthread_mutex_unlock(&input->mutex);
+  return 0;
+}
+
+// Lock to the display's refresh: render at most one frame ahead of what is
+// on screen
+static void hardware_wait_vsync(backend *self) {
+  (void)self;
+
+  pthread_mutex_lock(&framebuffer_mutex);
+  while (running && displayed_seq < framebuffer_seq - 1)
+    pthread_cond_wait(&vsync_cond, &framebuffer_mutex);
+  pthread_mutex_unlock(&framebuffer_mutex);
+}
+
+static void hardware_stats(backend *self, backend_stats *out) {
+  (void)self;
+
+  pthread_mutex_lock(&framebuffer_mutex);
+  *out = stats;
+  pthread_mutex_unlock(&framebuffer_mutex);
+  out->input_wakeups =
+      __atomic_load_n(&input_reactor.wakeups, __ATOMIC_RELAXED);
+}
+
+static void hardware_destroy(backend *self) {
+  (void)self;
+
+  running = 0;
+  pthread_join(fb_update_thread, NULL);
+  reactor_destroy(&input_reactor);
+  for (int p = 0; p < screen.players; p++) {
+    close(inputs[p].fd);
+    pthread_mutex_destroy(&inputs[p].mutex);
+  }
+  close(vga_framebuffer_fd);
+}
+
+backend hardware_backend = {.name = "hardware",
+                            .init = hardware_init,
+                            .submit_frame = hardware_submit_frame,
+                            .poll_input = hardware_poll_input,
+                            .wait_vsync = hardware_wait_vsync,
+                            .stats = hardware_stats,
+                            .destroy = hardware_destroy};
+
+// The co-simulation harness (hardware/sim) replaces the devices from inside
+// the process, so it is the hardware backend once the harness is preloaded
+static int cosim_init(backend *self) {
+  const char *preload = getenv("LD_PRELOAD");
+
+  if (preload == NULL || strstr(preload, "libcosim") == NULL) {
+    fprintf(stderr, "The cosim backend needs LD_PRELOAD=.../libcosim.so "
+                    "(built in hardware/sim)\n");
+    return 1;
+  }
+
+  return hardware_init(self);
+}
+
+backend cosim_backend = {.name = "cosim",
+                         .init = cosim_init,
+                         .submit_frame = hardware_submit_frame,
+                         .poll_input = hardware_poll_input,
+                         .wait_vsync = hardware_wait_vsync,
+                         .stats = hardware_stats,
+                         .destroy = hardware_destroy};
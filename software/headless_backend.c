@@ -0,0 +1,74 @@
+#include "backend.h"
+#include "guitar_state.h"
+#include "helpers.h"
+#include "replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Drops every frame. Measures what the game loop costs on its own, without
+// any display in the way. Never presses anything, unless given a replay to
+// play back in real time; the song starts when init returns, near enough
+
+static backend_stats stats;
+static long long start_us; // When the song started, by current_time_in_us()
+static replay_event *events;
+static int num_events;
+static replay_player cursors[MAX_PLAYERS];
+
+static int headless_init(backend *self) {
+  memset(&stats, 0, sizeof(stats));
+  events = NULL;
+  num_events = 0;
+  for (int p = 0; p < MAX_PLAYERS; p++)
+    replay_player_init(&cursors[p]);
+
+  if (self->replay_path != NULL &&
+      replay_load(self->replay_path, screen.players, &events, &num_events))
+    return 1;
+
+  start_us = current_time_in_us();
+  return 0;
+}
+
+// Nothing is pushed anywhere, so a frame is pushed as it is submitted
+static void headless_submit_frame(backend *self, const frame *f) {
+  latency_tag latency = f->latency;
+  (void)self;
+
+  latency_pushed(&latency, current_time_in_us());
+  stats.frames_submitted++;
+  stats.frames_shown++;
+}
+
+// Delivers the player's changes that are due, each stamped with the time it
+// was due, as an input thread would have
+static int headless_poll_input(backend *self, int player, guitar_state *gs) {
+  replay_deliver(events, num_events, current_time_in_us() - start_us, player,
+                 &cursors[player], self->listener,
+                 self->listener_args[player], start_us, gs);
+  return 0;
+}
+
+// There is no display to wait for
+static void headless_wait_vsync(backend *self) { (void)self; }
+
+static void headless_stats(backend *self, backend_stats *out) {
+  (void)self;
+
+  *out = stats;
+}
+
+static void headless_destroy(backend *self) {
+  (void)self;
+
+  free(events);
+}
+
+backend headless_backend = {.name = "headless",
+                            .init = headless_init,
+                            .submit_frame = headless_submit_frame,
+                            .poll_input = headless_poll_input,
+                            .wait_vsync = headless_wait_vsync,
+                            .stats = headless_stats,
+                            .destroy = headless_destroy};
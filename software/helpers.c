@@ -1,17 +1,17 @@
 #include "helpers.h"
-#include <sys/time.h>
+#include <time.h>
 #include <stddef.h>
 
-long long current_time_in_ms() {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  long long ms =
-      (tv.tv_sec * 1000LL) +
-      (tv.tv_usec /
-       1000); // Convert seconds to ms and add microseconds converted to ms
-  return ms;
+// Game time runs off the monotonic clock, the same one the kernel stamps
+// input events with (ktime_get_ns()), so it never jumps with the wall clock
+long long current_time_in_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
 
+long long current_time_in_ms() { return current_time_in_us() / 1000; }
+
 /* Constructs a properly-formatted writedata packet for the Avalon Bus */
 uint32_t pixel_writedata(unsigned char pixel_color, int pixel_row,
                          int pixel_col) {
@@ -19,8 +19,8 @@ uint32_t pixel_writedata(unsigned char pixel_color, int pixel_row,
   // Make pixel_color pixel_writedata fits into 6 bits
   pixel_color &= 0x3F;
 
-  // Make sure pixel_col fits into 8 bits
-  pixel_col &= 0xFF;
+  // Make sure pixel_col fits into 10 bits
+  pixel_col &= 0x3FF;
 
   // Make sure pixel_row fits into 9 bits
   pixel_row &= 0x1FF;
@@ -28,8 +28,19 @@ uint32_t pixel_writedata(unsigned char pixel_color, int pixel_row,
   // Combine the values
   pixel_writedata = 0;
   pixel_writedata |= (uint32_t)pixel_color;       // 6 least significant bits
-  pixel_writedata |= ((uint32_t)pixel_col << 6);  // Next 8 bits
-  pixel_writedata |= ((uint32_t)pixel_row << 14); // Next 9 bits
+  pixel_writedata |= ((uint32_t)pixel_col << 6);  // Next 10 bits
+  pixel_writedata |= ((uint32_t)pixel_row << 16); // Next 9 bits
 
   return pixel_writedata;
-}
\ No newline at end of file
+}
+
+/* Packs PIXELS_PER_WORD colors into a writedata packet for the packed pixel
+ * register; the first color is drawn first */
+uint32_t packed_pixel_writedata(const unsigned char *pixel_colors) {
+  uint32_t packed_writedata = 0;
+
+  for (int i = PIXELS_PER_WORD - 1; i >= 0; i--)
+    packed_writedata = (packed_writedata << 6) | (pixel_colors[i] & 0x3F);
+
+  return packed_writedata;
+}
@@ -7,8 +7,13 @@
 #include <stdint.h>
 #endif
 
+// Pixels carried by each auto-incrementing packed write
+#define PIXELS_PER_WORD 5
+
 long long current_time_in_ms();
+long long current_time_in_us();
 uint32_t pixel_writedata(unsigned char pixel_color, int pixel_row,
                          int pixel_col);
+uint32_t packed_pixel_writedata(const unsigned char *pixel_colors);
 
 #endif /* HELPERS_H */
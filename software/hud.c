@@ -0,0 +1,382 @@
+#include "hud.h"
+#include "arena.h"
+#include "global_consts.h"
+#include "helpers.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+// 5x7 font, one byte per row with the leftmost pixel in bit 4. Only what
+// the HUD needs; the rest stay blank
+static const unsigned char font[NUM_GLYPHS][GLYPH_HEIGHT] = {
+    ['%' - FIRST_GLYPH] = {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03},
+    ['+' - FIRST_GLYPH] = {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00},
+    ['-' - FIRST_GLYPH] = {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00},
+    ['.' - FIRST_GLYPH] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},
+    ['/' - FIRST_GLYPH] = {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},
+    ['0' - FIRST_GLYPH] = {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},
+    ['1' - FIRST_GLYPH] = {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    ['2' - FIRST_GLYPH] = {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+    ['3' - FIRST_GLYPH] = {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    ['4' - FIRST_GLYPH] = {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+    ['5' - FIRST_GLYPH] = {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    ['6' - FIRST_GLYPH] = {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+    ['7' - FIRST_GLYPH] = {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    ['8' - FIRST_GLYPH] = {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+    ['9' - FIRST_GLYPH] = {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+    [':' - FIRST_GLYPH] = {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00},
+    ['A' - FIRST_GLYPH] = {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11},
+    ['B' - FIRST_GLYPH] = {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},
+    ['C' - FIRST_GLYPH] = {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},
+    ['D' - FIRST_GLYPH] = {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+    ['E' - FIRST_GLYPH] = {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},
+    ['F' - FIRST_GLYPH] = {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},
+    ['G' - FIRST_GLYPH] = {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},
+    ['H' - FIRST_GLYPH] = {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+    ['I' - FIRST_GLYPH] = {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    ['J' - FIRST_GLYPH] = {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},
+    ['K' - FIRST_GLYPH] = {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},
+    ['L' - FIRST_GLYPH] = {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},
+    ['M' - FIRST_GLYPH] = {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},
+    ['N' - FIRST_GLYPH] = {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},
+    ['O' - FIRST_GLYPH] = {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+    ['P' - FIRST_GLYPH] = {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+    ['Q' - FIRST_GLYPH] = {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},
+    ['R' - FIRST_GLYPH] = {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},
+    ['S' - FIRST_GLYPH] = {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},
+    ['T' - FIRST_GLYPH] = {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},
+    ['U' - FIRST_GLYPH] = {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+    ['V' - FIRST_GLYPH] = {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},
+    ['W' - FIRST_GLYPH] = {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},
+    ['X' - FIRST_GLYPH] = {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},
+    ['Y' - FIRST_GLYPH] = {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},
+    ['Z' - FIRST_GLYPH] = {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},
+};
+
+// HUD lines sit above and below the guitar state line's circles
+#define HUD_TOP_Y (screen.height - 47)
+#define HUD_BOTTOM_Y (screen.height - 9)
+#define HUD_MARGIN 2
+
+// Side panel text, a line every PANEL_LINE_HEIGHT rows from the top
+#define PANEL_MARGIN 8
+#define PANEL_LINE_HEIGHT 12
+#define PANEL_CHARS 16
+#define PANEL_MIN_WIDTH (2 * PANEL_MARGIN + PANEL_CHARS * GLYPH_ADVANCE)
+
+void glyph_atlas_init(glyph_atlas *atlas, Color color) {
+  for (int glyph = 0; glyph < NUM_GLYPHS; glyph++) {
+    for (int row = 0; row < GLYPH_HEIGHT; row++) {
+      for (int col = 0; col < GLYPH_WIDTH; col++) {
+        int lit = font[glyph][row] & (0x10 >> col);
+        atlas->pixels[glyph][row][col] = lit ? color : GLYPH_CLEAR;
+      }
+    }
+  }
+}
+
+static int glyph_index(char c) {
+  c = toupper((unsigned char)c);
+  if (c < FIRST_GLYPH || c >= FIRST_GLYPH + NUM_GLYPHS)
+    return 0; // A space
+  return c - FIRST_GLYPH;
+}
+
+// Copies one character from the atlas into its cell of the field's sprite
+static void render_glyph(text_field *field, int cell, char c) {
+  const unsigned char(*glyph)[GLYPH_WIDTH] =
+      field->atlas->pixels[glyph_index(c)];
+
+  for (int row = 0; row < GLYPH_HEIGHT; row++) {
+    png_bytep px =
+        &field->rendered.pixel_buffer[row * field->rendered.B_per_row * 4 +
+                                      cell * GLYPH_ADVANCE * 4];
+
+    for (int col = 0; col < GLYPH_WIDTH; col++, px += 4) {
+      unsigned char index = glyph[row][col];
+      RGB color = palette[index == GLYPH_CLEAR ? BLACK : index];
+
+      px[0] = color.R;
+      px[1] = color.G;
+      px[2] = color.B;
+      px[3] = index == GLYPH_CLEAR ? 0 : 0xFF;
+    }
+  }
+
+  field->glyphs_rendered++;
+}
+
+int text_field_init(text_field *field, const glyph_atlas *atlas, int x, int y,
+                    int chars, int right_aligned) {
+  if (chars > TEXT_FIELD_MAX_CHARS)
+    chars = TEXT_FIELD_MAX_CHARS;
+
+  field->atlas = atlas;
+  field->x = x;
+  field->y = y;
+  field->chars = chars;
+  field->right_aligned = right_aligned;
+  field->glyphs_rendered = 0;
+  // Matches no character, so the first text renders every cell
+  memset(field->text, 0, sizeof(field->text));
+
+  // Laid out like a loaded PNG, so draw_sprite() can draw it
+  field->rendered.filename = NULL;
+  field->rendered.width = chars * GLYPH_ADVANCE;
+  field->rendered.height = GLYPH_HEIGHT;
+  field->rendered.B_per_row = field->rendered.width * 4;
+  field->rendered.pixel_buffer =
+      arena_alloc(field->rendered.height * field->rendered.B_per_row * 4);
+  if (field->rendered.pixel_buffer == NULL) {
+    perror("Error allocating text field!\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+void text_field_set(text_field *field, const char *text) {
+  char padded[TEXT_FIELD_MAX_CHARS + 1];
+
+  snprintf(padded, sizeof(padded), field->right_aligned ? "%*.*s" : "%-*.*s",
+           field->chars, field->chars, text);
+
+  for (int cell = 0; cell < field->chars; cell++) {
+    if (padded[cell] != field->text[cell]) {
+      render_glyph(field, cell, padded[cell]);
+      field->text[cell] = padded[cell];
+    }
+  }
+}
+
+// Renders every cell again, as if nothing were kept
+static void rerender_text_field(text_field *field) {
+  for (int cell = 0; cell < field->chars; cell++)
+    render_glyph(field, cell, field->text[cell]);
+}
+
+void draw_text_field(const text_field *field, draw_list *list) {
+  // Sprites are drawn by their center. Every re-rendered glyph is a new
+  // version of the sprite
+  draw_list_sprite_version(list, &field->rendered,
+                           field->x + field->rendered.width / 2,
+                           field->y + field->rendered.height / 2,
+                           field->glyphs_rendered);
+}
+
+// Lays out lines of panel text, starting first_line lines from the top of the
+// screen
+static int init_panel(hud *h, text_field *fields, int lines, int x,
+                      int first_line) {
+  for (int i = 0; i < lines; i++) {
+    if (text_field_init(&fields[i], &h->atlas, x,
+                        PANEL_MARGIN + (first_line + i) * PANEL_LINE_HEIGHT,
+                        PANEL_CHARS, 0))
+      return 1;
+  }
+
+  return 0;
+}
+
+// Lays out the fields around one player's guitar state line
+static int init_player_hud(hud *h, player_hud *p, int highway_x) {
+  int left_x = highway_x + HUD_MARGIN;
+  int right_x = highway_x + HIGHWAY_WIDTH - HUD_MARGIN;
+
+  return text_field_init(&p->score, &h->atlas, left_x, HUD_TOP_Y, 16, 0) ||
+         text_field_init(&p->multiplier, &h->atlas,
+                         right_x - 3 * GLYPH_ADVANCE, HUD_TOP_Y, 3, 1) ||
+         text_field_init(&p->combo, &h->atlas, left_x, HUD_BOTTOM_Y, 12, 0) ||
+         text_field_init(&p->progress, &h->atlas, right_x - 4 * GLYPH_ADVANCE,
+                         HUD_BOTTOM_Y, 4, 1);
+}
+
+int hud_init(hud *h, const char *title, int bpm, int num_notes, int cached) {
+  int right_panel_x = screen.highway_x[screen.players - 1] + HIGHWAY_WIDTH;
+  char text[TEXT_FIELD_MAX_CHARS + 1];
+
+  glyph_atlas_init(&h->atlas, WHITE);
+  h->players = screen.players;
+  h->cached = cached;
+  h->frames = 0;
+  h->render_us = 0;
+
+  for (int p = 0; p < h->players; p++) {
+    if (init_player_hud(h, &h->player[p], screen.highway_x[p]))
+      return 1;
+  }
+
+  h->panels = screen.highway_x[0] >= PANEL_MIN_WIDTH &&
+              screen.width - right_panel_x >= PANEL_MIN_WIDTH &&
+              h->players * HUD_RESULT_LINES * PANEL_LINE_HEIGHT +
+                      PANEL_MARGIN <=
+                  screen.height;
+  if (!h->panels)
+    return 0;
+
+  if (init_panel(h, h->info, HUD_INFO_LINES, PANEL_MARGIN, 0))
+    return 1;
+  // One block of results per player, one under the other
+  for (int p = 0; p < h->players; p++) {
+    if (init_panel(h, h->results[p], HUD_RESULT_LINES,
+                   right_panel_x + PANEL_MARGIN, p * HUD_RESULT_LINES))
+      return 1;
+    if (h->players == 1)
+      snprintf(text, sizeof(text), "RESULTS");
+    else
+      snprintf(text, sizeof(text), "PLAYER %d", p + 1);
+    text_field_set(&h->results[p][0], text);
+  }
+
+  // The song does not change, so neither do the first lines
+  text_field_set(&h->info[0], title);
+  snprintf(text, sizeof(text), "BPM %d", bpm);
+  text_field_set(&h->info[1], text);
+  snprintf(text, sizeof(text), "NOTES %d", num_notes);
+  text_field_set(&h->info[2], text);
+
+  return 0;
+}
+
+static void update_player_hud(player_hud *p, const judge_totals *totals,
+                              long long progress) {
+  char text[TEXT_FIELD_MAX_CHARS + 1];
+
+  snprintf(text, sizeof(text), "SCORE %lld", totals->score);
+  text_field_set(&p->score, text);
+  snprintf(text, sizeof(text), "X%d", judge_multiplier(totals));
+  text_field_set(&p->multiplier, text);
+  snprintf(text, sizeof(text), "COMBO %d", totals->combo);
+  text_field_set(&p->combo, text);
+  snprintf(text, sizeof(text), "%lld%%", progress);
+  text_field_set(&p->progress, text);
+}
+
+// Everything under a results block's heading
+static void update_results(text_field *results, const judge_totals *totals) {
+  char text[TEXT_FIELD_MAX_CHARS + 1];
+
+  for (int i = 0; i < NUM_JUDGMENTS; i++) {
+    snprintf(text, sizeof(text), "%s %d", judgment_name(i),
+             totals->counts[i]);
+    text_field_set(&results[1 + i], text);
+  }
+  snprintf(text, sizeof(text), "OVERSTRUMS %d", totals->overstrums);
+  text_field_set(&results[NUM_JUDGMENTS + 1], text);
+  snprintf(text, sizeof(text), "MAX COMBO %d", totals->max_combo);
+  text_field_set(&results[NUM_JUDGMENTS + 2], text);
+  snprintf(text, sizeof(text), "ACCURACY %.1f%%", judge_accuracy(totals));
+  text_field_set(&results[NUM_JUDGMENTS + 3], text);
+}
+
+// Throws away everything rendered, for an uncached HUD
+static void rerender_all(hud *h) {
+  for (int p = 0; p < h->players; p++) {
+    rerender_text_field(&h->player[p].score);
+    rerender_text_field(&h->player[p].multiplier);
+    rerender_text_field(&h->player[p].combo);
+    rerender_text_field(&h->player[p].progress);
+  }
+  if (!h->panels)
+    return;
+  for (int i = 0; i < HUD_INFO_LINES; i++)
+    rerender_text_field(&h->info[i]);
+  for (int p = 0; p < h->players; p++) {
+    for (int i = 0; i < HUD_RESULT_LINES; i++)
+      rerender_text_field(&h->results[p][i]);
+  }
+}
+
+void hud_update(hud *h, judge *judges, long long song_time_ms,
+                long long song_length_ms) {
+  long long start = current_time_in_us();
+  char text[TEXT_FIELD_MAX_CHARS + 1];
+  judge_totals totals[MAX_PLAYERS];
+  long long progress = song_length_ms ? 100 * song_time_ms / song_length_ms : 0;
+
+  if (progress < 0)
+    progress = 0;
+  else if (progress > 100)
+    progress = 100;
+
+  if (!h->cached)
+    rerender_all(h);
+
+  // Input threads keep judging while the HUD is drawn
+  for (int p = 0; p < h->players; p++) {
+    totals[p] = judge_get_totals(&judges[p]);
+    update_player_hud(&h->player[p], &totals[p], progress);
+  }
+
+  if (h->panels) {
+    int elapsed_s = song_time_ms < 0 ? 0 : song_time_ms / 1000 % 6000;
+    int length_s = song_length_ms / 1000 % 6000;
+
+    snprintf(text, sizeof(text), "TIME %d:%02d/%d:%02d", elapsed_s / 60,
+             elapsed_s % 60, length_s / 60, length_s % 60);
+    text_field_set(&h->info[3], text);
+
+    for (int p = 0; p < h->players; p++)
+      update_results(h->results[p], &totals[p]);
+  }
+
+  h->render_us += current_time_in_us() - start;
+}
+
+void hud_draw(hud *h, draw_list *list) {
+  long long start = current_time_in_us();
+
+  if (h->panels) {
+    int right_panel_x = screen.highway_x[h->players - 1] + HIGHWAY_WIDTH;
+
+    draw_list_fill(list, 0, 0, screen.highway_x[0], screen.height, NAVY);
+    draw_list_fill(list, right_panel_x, 0, screen.width - right_panel_x,
+                   screen.height, NAVY);
+    for (int i = 0; i < HUD_INFO_LINES; i++)
+      draw_text_field(&h->info[i], list);
+    for (int p = 0; p < h->players; p++) {
+      for (int i = 0; i < HUD_RESULT_LINES; i++)
+        draw_text_field(&h->results[p][i], list);
+    }
+  }
+
+  for (int p = 0; p < h->players; p++) {
+    draw_text_field(&h->player[p].score, list);
+    draw_text_field(&h->player[p].multiplier, list);
+    draw_text_field(&h->player[p].combo, list);
+    draw_text_field(&h->player[p].progress, list);
+  }
+
+  h->render_us += current_time_in_us() - start;
+  h->frames++;
+}
+
+void hud_print_stats(hud *h) {
+  long long glyphs = 0;
+
+  for (int p = 0; p < h->players; p++) {
+    glyphs += h->player[p].score.glyphs_rendered +
+              h->player[p].multiplier.glyphs_rendered +
+              h->player[p].combo.glyphs_rendered +
+              h->player[p].progress.glyphs_rendered;
+  }
+
+  if (h->panels) {
+    for (int i = 0; i < HUD_INFO_LINES; i++)
+      glyphs += h->info[i].glyphs_rendered;
+    for (int p = 0; p < h->players; p++) {
+      for (int i = 0; i < HUD_RESULT_LINES; i++)
+        glyphs += h->results[p][i].glyphs_rendered;
+    }
+  }
+
+  printf("---HUD STATISTICS---\n");
+  printf("Players: %d\n", h->players);
+  printf("Text cache: %s\n", h->cached ? "on" : "off");
+  printf("Frames: %lld\n", h->frames);
+  if (h->frames) {
+    printf("Render time: %.1fus/frame\n", (double)h->render_us / h->frames);
+    printf("Glyphs re-rendered: %lld (%.2f/frame)\n", glyphs,
+           (double)glyphs / h->frames);
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "colors.h"
+#include "global_consts.h"
+#include "judge.h"
+#include "rasterizer.h"
+#include "sprites.h"
+
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+#define GLYPH_ADVANCE 6 // One column of space between characters
+// Glyphs run from ' ' to 'Z'; anything else is drawn as a space
+#define FIRST_GLYPH ' '
+#define NUM_GLYPHS ('Z' - FIRST_GLYPH + 1)
+#define GLYPH_CLEAR 0xFF // Atlas pixel that lets the background through
+
+#define TEXT_FIELD_MAX_CHARS 24
+
+// Every glyph, rasterized once in one color as palette indices
+typedef struct {
+  unsigned char pixels[NUM_GLYPHS][GLYPH_HEIGHT][GLYPH_WIDTH];
+} glyph_atlas;
+
+// A line of text at a fixed place on screen. It is kept rendered in a
+// sprite, so drawing it each frame is a sprite draw, and setting new text
+// only re-renders the characters that changed
+typedef struct {
+  const glyph_atlas *atlas;
+  int x, y;  // Top left corner on screen
+  int chars; // Width in characters
+  int right_aligned;
+  char text[TEXT_FIELD_MAX_CHARS + 1]; // What the sprite shows, padded
+  sprite rendered;
+  long long glyphs_rendered; // Characters re-rendered over the field's life
+} text_field;
+
+// Builds the atlas for glyphs in the given color
+void glyph_atlas_init(glyph_atlas *atlas, Color color);
+
+// Returns 0 on success. The rendered text lives in the arena
+int text_field_init(text_field *field, const glyph_atlas *atlas, int x, int y,
+                    int chars, int right_aligned);
+void text_field_set(text_field *field, const char *text);
+void draw_text_field(const text_field *field, draw_list *list);
+
+// Lines of song information in the left panel, and of how the song is
+// going for each player in the right one
+#define HUD_INFO_LINES 4
+#define HUD_RESULT_LINES (NUM_JUDGMENTS + 4)
+
+// One player's score, multiplier, combo and song progress, drawn around
+// their guitar state line where the hardware never scrolls
+typedef struct {
+  text_field score, multiplier, combo, progress;
+} player_hud;
+
+// Every player's HUD, plus side panels when the screen is wider than the
+// highways
+typedef struct {
+  glyph_atlas atlas;
+  int players;
+  player_hud player[MAX_PLAYERS];
+  int panels; // Whether there is room for the side panels
+  text_field info[HUD_INFO_LINES], results[MAX_PLAYERS][HUD_RESULT_LINES];
+  // Whether rendered text is kept between frames. Off, every field is
+  // re-rendered every frame: for measuring what keeping it saves
+  int cached;
+  long long frames, render_us; // For the statistics
+} hud;
+
+// Lays the HUD out for screen.players; the song information does not change
+int hud_init(hud *h, const char *title, int bpm, int num_notes, int cached);
+// judges holds one judge per player. Cheap when nothing changed and cached:
+// only changed characters are re-rendered
+void hud_update(hud *h, judge *judges, long long song_time_ms,
+                long long song_length_ms);
+void hud_draw(hud *h, draw_list *list);
+void hud_print_stats(hud *h);
+
+#endif /* HUD_H */
@@ -0,0 +1,229 @@
+#include "judge.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Score for each judgment, before the multiplier
+static const int judgment_points[NUM_JUDGMENTS] = {100, 70, 40, 0};
+static const char *judgment_names[NUM_JUDGMENTS] = {"PERFECT", "GOOD", "OK",
+                                                    "MISS"};
+
+int hit_notes(guitar_state controller_state, note_row notes) {
+  return controller_state.frets == notes;
+}
+
+static long long row_time_us(const judge *j, int row) {
+  return j->first_note_us + row * j->note_us;
+}
+
+static void record(judge *j, int row, judgment result) {
+  judge_totals *totals = &j->totals;
+
+  j->results[row] = result;
+  totals->counts[result]++;
+
+  if (result == JUDGMENT_MISS) {
+    totals->combo = 0;
+    return;
+  }
+
+  totals->score += judgment_points[result] * judge_multiplier(totals);
+  if (++totals->combo > totals->max_combo)
+    totals->max_combo = totals->combo;
+}
+
+// Where time_us is in the chart, lined up with the notes: the player saw
+// the note display_offset late, and input got to us input_offset late
+static long long chart_time_us(const judge *j, long long time_us) {
+  return judge_song_time_us(j, time_us) -
+         (j->calibration.input_offset_ms + j->calibration.display_offset_ms) *
+             1000LL;
+}
+
+// Rows whose window closed before chart time t went by unplayed
+static void sweep(judge *j, long long t) {
+  long long ok_us = j->windows.ok_ms * 1000LL;
+
+  while (j->next_row < j->num_rows &&
+         (!j->rows[j->next_row] ||
+          row_time_us(j, j->next_row) + ok_us < t)) {
+    if (j->rows[j->next_row])
+      record(j, j->next_row, JUDGMENT_MISS);
+    j->next_row++;
+  }
+}
+
+int judge_init(judge *j, const note_row *rows, int num_rows,
+               long long first_note_us, long long note_us,
+               judge_windows windows, judge_calibration calibration) {
+  memset(j, 0, sizeof(*j));
+  pthread_mutex_init(&j->lock, NULL);
+  j->windows = windows;
+  j->calibration = calibration;
+  j->rows = rows;
+  j->num_rows = num_rows;
+  j->first_note_us = first_note_us;
+  j->note_us = note_us;
+
+  if ((j->results = arena_alloc(num_rows)) == NULL) {
+    perror("Error allocating judge results!\n");
+    return 1;
+  }
+  memset((unsigned char *)j->results, JUDGMENT_NONE, num_rows);
+
+  return 0;
+}
+
+void judge_start(judge *j, long long song_start_us) {
+  j->song_start_us = song_start_us;
+}
+
+long long judge_song_time_us(const judge *j, long long time_us) {
+  if (j->song_clock)
+    return j->song_clock(j->song_clock_arg, time_us);
+  return time_us - j->song_start_us;
+}
+
+void judge_input(void *arg, const guitar_state *gs, long long time_us) {
+  judge *j = (judge *)arg;
+
+  if (!gs->strum)
+    return; // Only strums are judged
+
+  // Line the strum up with the note it was aimed at
+  long long t = chart_time_us(j, time_us);
+  long long ok_us = j->windows.ok_ms * 1000LL;
+
+  pthread_mutex_lock(&j->lock);
+  sweep(j, t);
+
+  long long error_us = j->next_row < j->num_rows
+                           ? t - row_time_us(j, j->next_row)
+                           : ok_us + 1;
+  long long abs_error_us = error_us < 0 ? -error_us : error_us;
+
+  if (abs_error_us > ok_us || !hit_notes(*gs, j->rows[j->next_row])) {
+    // Nothing to hit, or the wrong frets: the row stays playable
+    j->totals.overstrums++;
+    j->totals.combo = 0;
+    pthread_mutex_unlock(&j->lock);
+    return;
+  }
+
+  judgment result = JUDGMENT_OK;
+  if (abs_error_us <= j->windows.perfect_ms * 1000LL)
+    result = JUDGMENT_PERFECT;
+  else if (abs_error_us <= j->windows.good_ms * 1000LL)
+    result = JUDGMENT_GOOD;
+
+  record(j, j->next_row++, result);
+  if (j->num_errors < JUDGE_MAX_ERRORS)
+    j->errors_us[j->num_errors++] = (int)error_us;
+  pthread_mutex_unlock(&j->lock);
+}
+
+void judge_sweep(judge *j, long long time_us) {
+  long long t = chart_time_us(j, time_us) - JUDGE_SWEEP_GRACE_MS * 1000LL;
+
+  pthread_mutex_lock(&j->lock);
+  sweep(j, t);
+  pthread_mutex_unlock(&j->lock);
+}
+
+void judge_finish(judge *j) {
+  pthread_mutex_lock(&j->lock);
+  for (; j->next_row < j->num_rows; j->next_row++) {
+    if (j->rows[j->next_row])
+      record(j, j->next_row, JUDGMENT_MISS);
+  }
+  pthread_mutex_unlock(&j->lock);
+}
+
+judge_totals judge_get_totals(judge *j) {
+  judge_totals totals;
+
+  pthread_mutex_lock(&j->lock);
+  totals = j->totals;
+  pthread_mutex_unlock(&j->lock);
+  return totals;
+}
+
+int judge_multiplier(const judge_totals *totals) {
+  int multiplier = 1 + totals->combo / 10;
+  return multiplier > 4 ? 4 : multiplier;
+}
+
+const char *judgment_name(judgment result) { return judgment_names[result]; }
+
+double judge_accuracy(const judge_totals *totals) {
+  long long points = 0;
+  int judged = 0;
+
+  for (int i = 0; i < NUM_JUDGMENTS; i++) {
+    points += (long long)totals->counts[i] * judgment_points[i];
+    judged += totals->counts[i];
+  }
+
+  return judged ? 100.0 * points / (judged * judgment_points[0]) : 0;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+int judge_median_error_us(judge *j) {
+  int sorted[JUDGE_MAX_ERRORS];
+
+  if (j->num_errors == 0)
+    return 0;
+
+  memcpy(sorted, j->errors_us, j->num_errors * sizeof(int));
+  qsort(sorted, j->num_errors, sizeof(int), compare_ints);
+  return sorted[j->num_errors / 2];
+}
+
+void judge_print_stats(judge *j) {
+  judge_totals totals = judge_get_totals(j);
+
+  printf("---SCORE---\n");
+  printf("Score: %lld\n", totals.score);
+  for (int i = 0; i < NUM_JUDGMENTS; i++)
+    printf("%s: %d\n", judgment_names[i], totals.counts[i]);
+  printf("Overstrums: %d\n", totals.overstrums);
+  printf("Max combo: %d\n", totals.max_combo);
+  printf("Accuracy: %.1f%%\n", judge_accuracy(&totals));
+  printf("Median timing error: %+.1fms\n", judge_median_error_us(j) / 1000.0);
+}
+
+void load_calibration(const char *path, judge_calibration *calibration) {
+  FILE *file = fopen(path, "r");
+
+  calibration->input_offset_ms = 0;
+  calibration->display_offset_ms = 0;
+  if (file == NULL)
+    return; // Not calibrated yet
+
+  if (fscanf(file, "%d %d", &calibration->input_offset_ms,
+             &calibration->display_offset_ms) != 2) {
+    fprintf(stderr, "Ignoring malformed calibration in %s\n", path);
+    calibration->input_offset_ms = 0;
+    calibration->display_offset_ms = 0;
+  }
+  fclose(file);
+}
+
+int save_calibration(const char *path, const judge_calibration *calibration) {
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    perror("could not write calibration");
+    return 1;
+  }
+
+  fprintf(file, "%d %d\n", calibration->input_offset_ms,
+          calibration->display_offset_ms);
+  fclose(file);
+  return 0;
+}
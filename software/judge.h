@@ -0,0 +1,118 @@
+#ifndef JUDGE_H
+#define JUDGE_H
+
+#include "guitar_state.h"
+#include "song_data.h"
+#include <pthread.h>
+
+typedef enum {
+  JUDGMENT_PERFECT,
+  JUDGMENT_GOOD,
+  JUDGMENT_OK,
+  JUDGMENT_MISS,
+  NUM_JUDGMENTS
+} judgment;
+
+// Marks a row that has not been judged yet, or has no notes to judge
+#define JUDGMENT_NONE NUM_JUDGMENTS
+
+// Largest timing error, in ms either way, that still earns each judgment.
+// Anything further out is a miss
+typedef struct {
+  int perfect_ms;
+  int good_ms;
+  int ok_ms;
+} judge_windows;
+
+#define DEFAULT_JUDGE_WINDOWS {.perfect_ms = 35, .good_ms = 70, .ok_ms = 110}
+// Wide enough to catch strums however far off an uncalibrated cabinet is
+#define CALIBRATION_JUDGE_WINDOWS                                              \
+  {.perfect_ms = 400, .good_ms = 400, .ok_ms = 400}
+
+// Where calibration mode leaves its measurements for later games
+#define CALIBRATION_FILE "calibration.txt"
+
+// How late each part of a cabinet is, measured by calibration mode
+typedef struct {
+  int input_offset_ms;   // From strumming to the strum being timestamped
+  int display_offset_ms; // From a frame being drawn to it being on screen
+} judge_calibration;
+
+// Strum errors kept for calibration
+#define JUDGE_MAX_ERRORS 256
+
+// How long after a row's window closes the game loop waits to call it
+// missed, in case a strum timestamped inside the window is still on its way
+#define JUDGE_SWEEP_GRACE_MS 100
+
+typedef struct {
+  long long score;
+  int combo, max_combo;
+  int counts[NUM_JUDGMENTS];
+  int overstrums; // Strums with nothing to hit, or the wrong frets
+} judge_totals;
+
+typedef struct {
+  judge_windows windows;
+  judge_calibration calibration;
+
+  const note_row *rows;
+  int num_rows;
+  long long first_note_us; // When row 0 reaches the line, in song time
+  long long note_us;       // Time between rows
+  long long song_start_us; // current_time_in_us() when the song started
+  // Where the song is at a given current_time_in_us() time, if something
+  // other than the time since song_start_us (e.g. the audio) keeps time
+  long long (*song_clock)(void *arg, long long time_us);
+  void *song_clock_arg;
+
+  // The thread delivering input judges strums while the game loop sweeps up
+  // missed rows and reads the totals; everything below is theirs under lock
+  pthread_mutex_t lock;
+
+  // Per row: a judgment, or JUDGMENT_NONE. The game loop reads this to stop
+  // drawing notes that have been hit
+  volatile unsigned char *results;
+  int next_row; // First row that can still be judged
+
+  judge_totals totals;
+  int errors_us[JUDGE_MAX_ERRORS]; // Signed strum errors of hits, in us
+  int num_errors;
+} judge;
+
+// Whether the frets held are exactly the notes in the row
+int hit_notes(guitar_state controller_state, note_row notes);
+// Sets the judge up for a chart; returns 0 on success
+int judge_init(judge *j, const note_row *rows, int num_rows,
+               long long first_note_us, long long note_us,
+               judge_windows windows, judge_calibration calibration);
+void judge_start(judge *j, long long song_start_us);
+// How far into the song time_us is, by the judge's clock
+long long judge_song_time_us(const judge *j, long long time_us);
+// Judges one input change. Meant to be a guitar_listener, with the judge as
+// its argument. Constant time per strum, apart from sweeping up rows that
+// went by unplayed, each of which is only ever swept once
+void judge_input(void *arg, const guitar_state *gs, long long time_us);
+// Counts the rows whose window closed JUDGE_SWEEP_GRACE_MS before time_us as
+// missed, strummed or not. Called by the game loop every frame, so a miss
+// shows without waiting for the next strum
+void judge_sweep(judge *j, long long time_us);
+// Counts everything still unjudged at the end of the song as missed
+void judge_finish(judge *j);
+// A consistent copy of the totals, safe to take while input is being judged
+judge_totals judge_get_totals(judge *j);
+// 1 + one per 10 notes of combo, up to 4
+int judge_multiplier(const judge_totals *totals);
+// e.g. "PERFECT"
+const char *judgment_name(judgment result);
+// Percentage of the best possible score (ignoring the multiplier)
+double judge_accuracy(const judge_totals *totals);
+// Median error of the hits so far, in us; 0 if there are none
+int judge_median_error_us(judge *j);
+void judge_print_stats(judge *j);
+
+// Reads the calibration file, leaving calibration at zero if there is none
+void load_calibration(const char *path, judge_calibration *calibration);
+int save_calibration(const char *path, const judge_calibration *calibration);
+
+#endif /* JUDGE_H */
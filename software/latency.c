@@ -0,0 +1,185 @@
+#include "latency.h"
+#include "global_consts.h"
+#include <pthread.h>
+#include <stdio.h>
+
+// Four buckets an octave: 0-3us exactly, then 4-4, 5-5, ... 8-9, 10-11, and
+// so on, each a quarter of its octave wide. The last one takes the rest
+#define LATENCY_BUCKETS 128
+#define BAR_WIDTH 40
+
+// Hops are recorded from whichever thread sees them, so counts are atomic
+typedef struct {
+  long long count, total_us, max_us;
+  long long buckets[LATENCY_BUCKETS];
+} latency_histogram;
+
+// A player's earliest change the game loop has not polled yet
+typedef struct {
+  int pending;
+  long long capture_us, read_us;
+} pending_input;
+
+static const char *hop_names[NUM_LATENCY_HOPS] = {
+    "Captured to read",    "Read to polled",     "Polled to submitted",
+    "Submitted to pushed", "Pushed to shown",    "Captured to pushed",
+    "Captured to shown"};
+
+static int measuring;
+static latency_histogram histograms[NUM_LATENCY_HOPS];
+static pending_input pending[MAX_PLAYERS];
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int bucket_of(long long us) {
+  if (us < 4)
+    return us < 0 ? 0 : us;
+
+  int octave = 63 - __builtin_clzll(us);
+  int bucket = 4 * (octave - 1) + (int)(us >> (octave - 2) & 3);
+  return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// The smallest latency that lands in the bucket
+static long long bucket_floor(int bucket) {
+  return bucket < 4 ? bucket : (4LL + bucket % 4) << (bucket / 4 - 1);
+}
+
+static void record(latency_hop hop, long long us) {
+  latency_histogram *h = &histograms[hop];
+  long long max;
+
+  if (us < 0)
+    us = 0;
+  __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->total_us, us, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->buckets[bucket_of(us)], 1, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+  while (us > max && !__atomic_compare_exchange_n(&h->max_us, &max, us, 1,
+                                                  __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED))
+    ;
+}
+
+void latency_enable(void) { measuring = 1; }
+
+void latency_input(int player, long long capture_us, long long now_us) {
+  if (!measuring)
+    return;
+
+  record(LATENCY_INPUT, now_us - capture_us);
+  pthread_mutex_lock(&pending_mutex);
+  // Later changes show in the same frame as the first; that one waits
+  // longest
+  if (!pending[player].pending) {
+    pending[player].pending = 1;
+    pending[player].capture_us = capture_us;
+    pending[player].read_us = now_us;
+  }
+  pthread_mutex_unlock(&pending_mutex);
+}
+
+void latency_poll(int player, long long now_us, latency_tag *frame) {
+  pending_input input;
+
+  if (!measuring)
+    return;
+
+  pthread_mutex_lock(&pending_mutex);
+  input = pending[player];
+  pending[player].pending = 0;
+  pthread_mutex_unlock(&pending_mutex);
+  if (!input.pending)
+    return;
+
+  record(LATENCY_POLL, now_us - input.read_us);
+  if (!frame->tagged || input.capture_us < frame->capture_us) {
+    frame->tagged = 1;
+    frame->capture_us = input.capture_us;
+    frame->polled_us = now_us;
+  }
+}
+
+void latency_submitted(latency_tag *tag, long long now_us) {
+  if (!measuring || !tag->tagged)
+    return;
+
+  record(LATENCY_RENDER, now_us - tag->polled_us);
+  tag->submitted_us = now_us;
+}
+
+void latency_merge(latency_tag *into, const latency_tag *tag) {
+  if (!tag->tagged)
+    return;
+  if (!into->tagged || tag->capture_us < into->capture_us)
+    *into = *tag;
+}
+
+void latency_pushed(latency_tag *tag, long long now_us) {
+  if (!measuring || !tag->tagged)
+    return;
+
+  record(LATENCY_PUSH, now_us - tag->submitted_us);
+  record(LATENCY_TO_DEVICE, now_us - tag->capture_us);
+  tag->pushed_us = now_us;
+}
+
+void latency_shown(latency_tag *tag, long long now_us) {
+  if (!measuring || !tag->tagged)
+    return;
+
+  record(LATENCY_DISPLAY, now_us - tag->pushed_us);
+  record(LATENCY_TO_SCREEN, now_us - tag->capture_us);
+}
+
+long long latency_percentile(latency_hop hop, double fraction) {
+  const latency_histogram *h = &histograms[hop];
+  long long rank = (long long)(fraction * h->count + 0.999999), seen = 0;
+
+  if (h->count == 0)
+    return 0;
+  if (rank < 1)
+    rank = 1;
+  for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+    seen += h->buckets[bucket];
+    if (seen >= rank) {
+      long long top = bucket_floor(bucket + 1) - 1;
+      return top < h->max_us ? top : h->max_us;
+    }
+  }
+  return h->max_us;
+}
+
+long long latency_count(latency_hop hop) { return histograms[hop].count; }
+
+void latency_print_stats(void) {
+  if (!measuring)
+    return;
+
+  printf("---LATENCY STATISTICS---\n");
+  for (int hop = 0; hop < NUM_LATENCY_HOPS; hop++) {
+    const latency_histogram *h = &histograms[hop];
+    long long most = 0;
+
+    if (h->count == 0) {
+      printf("%s: no samples\n", hop_names[hop]);
+      continue;
+    }
+    printf("%s: %lld samples, mean %lldus, p50 %lldus, p90 %lldus, "
+           "p99 %lldus, max %lldus\n",
+           hop_names[hop], h->count, h->total_us / h->count,
+           latency_percentile(hop, 0.5), latency_percentile(hop, 0.9),
+           latency_percentile(hop, 0.99), h->max_us);
+
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+      most = h->buckets[bucket] > most ? h->buckets[bucket] : most;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+      long long count = h->buckets[bucket];
+      int bar = (int)((count * BAR_WIDTH + most - 1) / most);
+
+      if (count == 0)
+        continue;
+      printf("  %8lldus %-*.*s %lld\n", bucket_floor(bucket), BAR_WIDTH, bar,
+             "########################################", count);
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// How long input takes to show, hop by hop: from when a change was captured
+// (the time its event carries), to its listener hearing about it on the
+// input thread, to the game loop polling it, to the frame it first shows in
+// being submitted, to that frame's push to the display completing, to the
+// display showing it. Each hop is a histogram, printed at exit.
+//
+// Times are by the backend's clock, so the sim backend measures in frames of
+// virtual time and gives the same numbers every run. With the measurement
+// off every call here is one branch
+
+typedef enum {
+  LATENCY_INPUT,   // Captured to read by the input thread
+  LATENCY_POLL,    // Read to polled by the game loop
+  LATENCY_RENDER,  // Polled to its frame being submitted
+  LATENCY_PUSH,    // Submitted to the push completing
+  LATENCY_DISPLAY, // Push completed to on screen
+  LATENCY_TO_DEVICE, // Captured to the push completing
+  LATENCY_TO_SCREEN, // Captured to on screen
+  NUM_LATENCY_HOPS
+} latency_hop;
+
+// Carried along with a frame: the earliest input it is the first to show.
+// All zero for a frame that shows no new input
+typedef struct {
+  int tagged;
+  long long capture_us, polled_us, submitted_us, pushed_us;
+} latency_tag;
+
+void latency_enable(void);
+// A player's change, captured at capture_us, reached its listener at now_us
+void latency_input(int player, long long capture_us, long long now_us);
+// The game loop polled the player at now_us; tags the frame being drawn
+// with whatever of theirs it is the first to show
+void latency_poll(int player, long long now_us, latency_tag *frame);
+void latency_submitted(latency_tag *tag, long long now_us);
+// For a frame that replaces one not yet pushed: into keeps the earlier
+// input, which the replacing frame is then the first to show
+void latency_merge(latency_tag *into, const latency_tag *tag);
+void latency_pushed(latency_tag *tag, long long now_us);
+void latency_shown(latency_tag *tag, long long now_us);
+// The latency below which fraction (0 to 1) of the hop's samples fall, to
+// the histogram's resolution; 0 if there are none
+long long latency_percentile(latency_hop hop, double fraction);
+long long latency_count(latency_hop hop);
+void latency_print_stats(void);
+
+#endif /* LATENCY_H */
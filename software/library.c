@@ -0,0 +1,354 @@
+// st_mtim, for modification times finer than a second
+#define _GNU_SOURCE
+#include "library.h"
+#include "helpers.h"
+#include "trace.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(((const song_info *)a)->name, ((const song_info *)b)->name);
+}
+
+static const song_info *find_name(const song_info *songs, int count,
+                                  const char *name) {
+  song_info key;
+
+  if (count == 0)
+    return NULL;
+  snprintf(key.name, sizeof(key.name), "%s", name);
+  return bsearch(&key, songs, count, sizeof(song_info), compare_names);
+}
+
+static void song_path(const song_library *lib, const char *name, char *path,
+                      size_t size) {
+  snprintf(path, size, "%s/%s", lib->dir, name);
+}
+
+// Maps the index if there is a sound one; a missing or stale index is just
+// an empty one
+static void map_index(song_library *lib) {
+  char path[LIBRARY_DIR_LENGTH + sizeof(LIBRARY_INDEX_NAME) + 1];
+  struct stat st;
+  int fd;
+
+  lib->map = NULL;
+  lib->songs = NULL;
+  lib->count = 0;
+
+  song_path(lib, LIBRARY_INDEX_NAME, path, sizeof(path));
+  if ((fd = open(path, O_RDONLY)) == -1)
+    return;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(library_index_header))
+    lib->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (lib->map == NULL || lib->map == MAP_FAILED) {
+    lib->map = NULL;
+    return;
+  }
+  lib->map_size = st.st_size;
+
+  const library_index_header *header = lib->map;
+  if (header->magic != LIBRARY_INDEX_MAGIC ||
+      header->record_size != sizeof(song_info) ||
+      header->count > MAX_LIBRARY_SONGS ||
+      lib->map_size != sizeof(*header) + header->count * sizeof(song_info)) {
+    munmap(lib->map, lib->map_size);
+    lib->map = NULL;
+    return;
+  }
+  lib->songs = (const song_info *)(header + 1);
+  lib->count = header->count;
+}
+
+// Reads a chart to work out what song select shows for it
+static int index_chart(song_library *lib, song_info *info,
+                       song_chart *chart) {
+  char path[LIBRARY_DIR_LENGTH + SONG_NAME_LENGTH + 1];
+  chart_stats stats;
+
+  song_path(lib, info->name, path, sizeof(path));
+  if (chart_load(path, chart))
+    return 1;
+  chart_analyze(chart->rows, chart->num_rows,
+                (int)(NOTES_PER_MEASURE * BEATS_PER_MEASURE), &stats);
+
+  memcpy(info->title, chart->title, sizeof(info->title));
+  info->bpm = chart->bpm;
+  info->rows = chart->num_rows;
+  info->notes = stats.notes;
+  info->chords = stats.chords;
+  info->length_ms = chart->num_rows * chart_row_ms(chart->bpm);
+  // Half a level per note a second in the densest measure
+  int window_ms = stats.window_rows * chart_row_ms(chart->bpm);
+  window_ms = window_ms > 0 ? window_ms : 1;
+  info->difficulty = 1 + stats.peak_notes * 1000 / window_ms / 2;
+  if (info->difficulty > 5)
+    info->difficulty = 5;
+  lib->parsed++;
+  return 0;
+}
+
+// Writes the index next to the charts, replacing the old one in one step
+static int write_index(song_library *lib, const song_info *songs,
+                       int count) {
+  char path[LIBRARY_DIR_LENGTH + sizeof(LIBRARY_INDEX_NAME) + 1];
+  char temp_path[sizeof(path) + 4];
+  library_index_header header = {LIBRARY_INDEX_MAGIC, sizeof(song_info),
+                                 count, 0};
+  FILE *file;
+
+  song_path(lib, LIBRARY_INDEX_NAME, path, sizeof(path));
+  snprintf(temp_path, sizeof(temp_path), "%s.new", path);
+  if ((file = fopen(temp_path, "wb")) == NULL)
+    return 1;
+  int failed = fwrite(&header, sizeof(header), 1, file) != 1 ||
+               (count > 0 &&
+                fwrite(songs, sizeof(song_info), count, file) != (size_t)count);
+  failed |= fclose(file) != 0;
+  if (failed || rename(temp_path, path) != 0) {
+    unlink(temp_path);
+    return 1;
+  }
+  return 0;
+}
+
+// Lists the charts in the library directory into songs, by file name. The
+// ones the index has unchanged are taken from it as they are; the rest are
+// read. Returns how many there are, or -1 if the directory cannot be read
+static int scan_charts(song_library *lib, song_info *songs,
+                       song_chart *chart) {
+  DIR *listing = opendir(lib->dir);
+  struct dirent *entry;
+  int count = 0;
+
+  if (listing == NULL) {
+    fprintf(stderr, "Could not open song library %s: %s\n", lib->dir,
+            strerror(errno));
+    return -1;
+  }
+
+  while ((entry = readdir(listing)) != NULL) {
+    const char *name = entry->d_name;
+    size_t length = strlen(name);
+    char path[LIBRARY_DIR_LENGTH + SONG_NAME_LENGTH + 1];
+    struct stat st;
+
+    if (name[0] == '.' || length < 5 || length >= SONG_NAME_LENGTH ||
+        strcmp(name + length - 4, ".txt") != 0)
+      continue;
+    song_path(lib, name, path, sizeof(path));
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+    if (count == MAX_LIBRARY_SONGS) {
+      fprintf(stderr, "Song library %s has over %d songs; the rest are "
+                      "left out\n",
+              lib->dir, MAX_LIBRARY_SONGS);
+      break;
+    }
+
+    song_info *info = &songs[count];
+    const song_info *indexed = find_name(lib->songs, lib->count, name);
+    long long mtime_ns =
+        st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    if (indexed && indexed->mtime_ns == mtime_ns &&
+        indexed->size == st.st_size) {
+      *info = *indexed;
+    } else {
+      memset(info, 0, sizeof(*info));
+      memcpy(info->name, name, length + 1);
+      info->mtime_ns = mtime_ns;
+      info->size = st.st_size;
+      if (index_chart(lib, info, chart))
+        continue;
+    }
+    count++;
+  }
+  closedir(listing);
+
+  qsort(songs, count, sizeof(*songs), compare_names);
+  return count;
+}
+
+int library_open(song_library *lib, const char *dir) {
+  long long start = current_time_in_us();
+  song_info *songs = malloc(MAX_LIBRARY_SONGS * sizeof(*songs));
+  song_chart *chart = malloc(sizeof(*chart));
+  int count = -1;
+
+  memset(lib, 0, sizeof(*lib));
+  snprintf(lib->dir, sizeof(lib->dir), "%s", dir);
+  lib->wanted = lib->loading = lib->ready = -1;
+  pthread_mutex_init(&lib->mutex, NULL);
+  pthread_cond_init(&lib->cond, NULL);
+
+  trace_begin("open song library");
+  map_index(lib);
+  if (songs == NULL || chart == NULL)
+    perror("Error allocating song library!\n");
+  else
+    count = scan_charts(lib, songs, chart);
+  free(chart);
+  if (count < 0) {
+    trace_end("open song library");
+    free(songs);
+    library_close(lib);
+    return 1;
+  }
+
+  // Every chart there either matched the index or was read, so with none
+  // read and as many charts, they are the same ones
+  if (lib->parsed > 0 || count != lib->count) {
+    if (lib->map)
+      munmap(lib->map, lib->map_size);
+    lib->map = NULL;
+    if (write_index(lib, songs, count) == 0)
+      map_index(lib);
+    if (lib->map == NULL) {
+      // Keep going without the index; it is rebuilt next time
+      fprintf(stderr, "Could not write the song library index in %s\n", dir);
+      lib->songs = lib->owned = songs;
+      lib->count = count;
+      songs = NULL;
+    }
+  }
+  free(songs);
+  trace_end("open song library");
+
+  lib->open_us = current_time_in_us() - start;
+  return 0;
+}
+
+int library_find(const song_library *lib, const char *song) {
+  char name[SONG_NAME_LENGTH];
+  char *end;
+  long number = strtol(song, &end, 10);
+
+  if (*song != '\0' && *end == '\0')
+    return number >= 1 && number <= lib->count ? (int)number - 1 : -1;
+
+  const song_info *info = find_name(lib->songs, lib->count, song);
+  snprintf(name, sizeof(name), "%s.txt", song);
+  if (info == NULL)
+    info = find_name(lib->songs, lib->count, name);
+  for (int i = 0; info == NULL && i < lib->count; i++) {
+    if (strcasecmp(lib->songs[i].title, song) == 0)
+      info = &lib->songs[i];
+  }
+  return info ? (int)(info - lib->songs) : -1;
+}
+
+static void *preload_loop(void *arg) {
+  song_library *lib = (song_library *)arg;
+  char path[LIBRARY_DIR_LENGTH + SONG_NAME_LENGTH + 1];
+
+  trace_thread("song preload");
+  pthread_mutex_lock(&lib->mutex);
+  while (1) {
+    while (!lib->stopping && lib->wanted < 0)
+      pthread_cond_wait(&lib->cond, &lib->mutex);
+    if (lib->stopping)
+      break;
+    // preloaded is only written to while no song is ready in it
+    lib->loading = lib->wanted;
+    lib->wanted = -1;
+    lib->ready = -1;
+    song_path(lib, lib->songs[lib->loading].name, path, sizeof(path));
+    pthread_mutex_unlock(&lib->mutex);
+
+    trace_begin("preload chart");
+    int failed = chart_load(path, &lib->preloaded);
+    trace_end("preload chart");
+
+    pthread_mutex_lock(&lib->mutex);
+    lib->ready = failed ? -1 : lib->loading;
+    lib->loading = -1;
+    pthread_cond_broadcast(&lib->cond);
+  }
+  pthread_mutex_unlock(&lib->mutex);
+
+  return NULL;
+}
+
+void library_preload(song_library *lib, int song) {
+  pthread_mutex_lock(&lib->mutex);
+  if (!lib->preload_started) {
+    if (pthread_create(&lib->preload_thread, NULL, preload_loop, lib) != 0) {
+      perror("pthread_create(song preload) failed\n");
+      pthread_mutex_unlock(&lib->mutex);
+      return; // library_load() reads the chart itself
+    }
+    lib->preload_started = 1;
+  }
+  if (song != lib->ready && song != lib->loading)
+    lib->wanted = song;
+  pthread_cond_broadcast(&lib->cond);
+  pthread_mutex_unlock(&lib->mutex);
+}
+
+int library_load(song_library *lib, int song, song_chart *chart) {
+  char path[LIBRARY_DIR_LENGTH + SONG_NAME_LENGTH + 1];
+
+  pthread_mutex_lock(&lib->mutex);
+  lib->loads++;
+  while (lib->wanted == song || lib->loading == song)
+    pthread_cond_wait(&lib->cond, &lib->mutex);
+  if (lib->ready == song) {
+    memcpy(chart, &lib->preloaded, sizeof(*chart));
+    lib->preload_hits++;
+    pthread_mutex_unlock(&lib->mutex);
+    return 0;
+  }
+  pthread_mutex_unlock(&lib->mutex);
+
+  song_path(lib, lib->songs[song].name, path, sizeof(path));
+  return chart_load(path, chart);
+}
+
+void library_print(const song_library *lib) {
+  printf("---SONGS (%s)---\n", lib->dir);
+  for (int i = 0; i < lib->count; i++) {
+    const song_info *info = &lib->songs[i];
+    printf("%3d. %-*s %3d BPM %2d:%02d %5d notes %4d chords  %.*s\n", i + 1,
+           SONG_TITLE_LENGTH - 1, info->title, info->bpm,
+           info->length_ms / 60000, info->length_ms / 1000 % 60, info->notes,
+           info->chords, info->difficulty, "*****");
+  }
+}
+
+void library_print_stats(const song_library *lib) {
+  printf("---SONG LIBRARY STATISTICS---\n");
+  printf("Songs: %d in %s\n", lib->count, lib->dir);
+  printf("Opened in: %.2fms (%d charts parsed)\n", lib->open_us / 1000.0,
+         lib->parsed);
+  printf("Charts loaded: %d (%d preloaded)\n", lib->loads, lib->preload_hits);
+}
+
+void library_close(song_library *lib) {
+  if (lib->preload_started) {
+    pthread_mutex_lock(&lib->mutex);
+    lib->stopping = 1;
+    pthread_cond_broadcast(&lib->cond);
+    pthread_mutex_unlock(&lib->mutex);
+    pthread_join(lib->preload_thread, NULL);
+    lib->preload_started = 0;
+  }
+  if (lib->map)
+    munmap(lib->map, lib->map_size);
+  lib->map = NULL;
+  free(lib->owned);
+  lib->owned = NULL;
+  lib->songs = NULL;
+  lib->count = 0;
+  pthread_mutex_destroy(&lib->mutex);
+  pthread_cond_destroy(&lib->cond);
+}
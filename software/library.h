@@ -0,0 +1,84 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "chart.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_LIBRARY_SONGS 1024
+#define SONG_NAME_LENGTH 64
+#define LIBRARY_DIR_LENGTH 256
+// The index, kept in the library directory next to the charts
+#define LIBRARY_INDEX_NAME ".songs.idx"
+#define LIBRARY_INDEX_MAGIC 0x58444953 // "SIDX"
+
+// What song select shows for one chart, worked out once when the chart is
+// indexed so the chart itself is only read to be played. Laid out the same
+// in memory and in the index file
+typedef struct {
+  char name[SONG_NAME_LENGTH]; // File name in the library directory
+  char title[SONG_TITLE_LENGTH];
+  int64_t mtime_ns, size; // Of the chart file when it was indexed
+  int32_t bpm;
+  int32_t rows, notes, chords;
+  int32_t length_ms;
+  int32_t difficulty; // 1 to 5, from the densest measure
+} song_info;
+
+// The index file: this, then count song_infos sorted by name
+typedef struct {
+  uint32_t magic;
+  uint32_t record_size; // sizeof(song_info), so an old layout is rebuilt
+  uint32_t count;
+  uint32_t unused;
+} library_index_header;
+
+// A directory of charts (*.txt). Opening it maps the index and only parses
+// the charts that are new or changed since it was written; charts are only
+// loaded when they are played, and one can be loaded ahead in the
+// background
+typedef struct {
+  char dir[LIBRARY_DIR_LENGTH];
+  const song_info *songs; // By file name
+  int count;
+  void *map;        // The mapped index file, or NULL
+  size_t map_size;
+  song_info *owned; // The songs, if the index could not be written back
+
+  // The background preload, of whichever song was asked for last
+  pthread_t preload_thread;
+  int preload_started;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int wanted;  // Song to load next, or -1
+  int loading; // Song being loaded, or -1
+  int ready;   // Song in preloaded, or -1
+  int stopping;
+  song_chart preloaded;
+
+  // For the statistics
+  long long open_us;
+  int parsed; // Charts that had to be read to refresh the index
+  int preload_hits, loads;
+} song_library;
+
+// Maps dir's index and brings it up to date with the charts there, writing
+// it back if anything changed. Returns 0 on success
+int library_open(song_library *lib, const char *dir);
+// Looks a song up by file name (with or without .txt), title, or number
+// from 1 as library_print() shows them; returns its index or -1
+int library_find(const song_library *lib, const char *song);
+// Starts loading a song in the background, say the one highlighted, so
+// library_load() has it at hand
+void library_preload(song_library *lib, int song);
+// Loads a song's chart, from the preload if it got there. Returns 0 on
+// success
+int library_load(song_library *lib, int song, song_chart *chart);
+// The song list
+void library_print(const song_library *lib);
+void library_print_stats(const song_library *lib);
+// Stops the preload and unmaps the index
+void library_close(song_library *lib);
+
+#endif /* LIBRARY_H */
@@ -0,0 +1,344 @@
+#include "rasterizer.h"
+#include "arena.h"
+#include "global_consts.h"
+#include "helpers.h"
+#include "realtime.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// A color as it sits in the framebuffer: B, G, R, unused
+static uint32_t framebuffer_pixel(Color color) {
+  unsigned char bytes[4] = {palette[color].B, palette[color].G,
+                            palette[color].R, 0};
+  uint32_t pixel;
+
+  memcpy(&pixel, bytes, sizeof(pixel));
+  return pixel;
+}
+
+void draw_list_clear(draw_list *list, Color background) {
+  list->background = framebuffer_pixel(background);
+  list->count = 0;
+}
+
+static draw_command *next_command(draw_list *list) {
+  if (list->count == MAX_DRAW_COMMANDS) {
+    list->dropped++;
+    return NULL;
+  }
+  return &list->commands[list->count++];
+}
+
+void draw_list_sprite(draw_list *list, const sprite *image, int x, int y) {
+  draw_list_sprite_version(list, image, x, y, 0);
+}
+
+void draw_list_sprite_version(draw_list *list, const sprite *image, int x,
+                              int y, long long version) {
+  draw_command *command = next_command(list);
+
+  if (command == NULL)
+    return;
+  command->kind = DRAW_SPRITE;
+  command->x = x;
+  command->y = y;
+  command->image = image;
+  command->version = version;
+}
+
+void draw_list_fill(draw_list *list, int x, int y, int width, int height,
+                    Color color) {
+  int right = x + width, bottom = y + height;
+  draw_command *command;
+
+  // The one clip this fill gets; bands only pick out their rows of it
+  x = x < 0 ? 0 : x;
+  y = y < 0 ? 0 : y;
+  right = right > screen.width ? screen.width : right;
+  bottom = bottom > screen.height ? screen.height : bottom;
+  if (x >= right || y >= bottom)
+    return;
+
+  if ((command = next_command(list)) == NULL)
+    return;
+  command->kind = DRAW_FILL;
+  command->x = x;
+  command->y = y;
+  command->width = right - x;
+  command->height = bottom - y;
+  command->pixel = framebuffer_pixel(color);
+}
+
+void draw_list_hline(draw_list *list, int x, int y, int width, Color color) {
+  draw_list_fill(list, x, y, width, 1, color);
+}
+
+void draw_list_vline(draw_list *list, int x, int y, int height, Color color) {
+  draw_list_fill(list, x, y, 1, height, color);
+}
+
+// Where a command draws
+static rect command_bounds(const draw_command *command) {
+  rect bounds = {command->x, command->y, command->width, command->height};
+
+  if (command->kind == DRAW_SPRITE) {
+    bounds.width = command->image->width;
+    bounds.height = command->image->height;
+    bounds.x -= bounds.width / 2;
+    bounds.y -= bounds.height / 2;
+  }
+  return bounds;
+}
+
+static int same_command(const draw_command *a, const draw_command *b) {
+  if (a->kind != b->kind || a->x != b->x || a->y != b->y)
+    return 0;
+  if (a->kind == DRAW_SPRITE)
+    return a->image == b->image && a->version == b->version;
+  return a->width == b->width && a->height == b->height &&
+         a->pixel == b->pixel;
+}
+
+static void damage_command(damage_list *damage, const draw_command *command) {
+  rect bounds = command_bounds(command);
+
+  damage_add(damage, bounds.x, bounds.y, bounds.width, bounds.height);
+}
+
+// Commands are matched up in order, so those left alone still draw over one
+// another the same way; whatever is not matched is damage where it was or
+// where it is now
+void draw_list_damage(const draw_list *before, const draw_list *after,
+                      damage_list *damage) {
+  int next = 0; // First command in before not matched or passed over yet
+
+  damage_clear(damage);
+  if (before->background != after->background) {
+    damage_all(damage);
+    return;
+  }
+
+  for (int i = 0; i < after->count; i++) {
+    int match = next;
+
+    while (match < before->count &&
+           !same_command(&before->commands[match], &after->commands[i]))
+      match++;
+    if (match == before->count) {
+      damage_command(damage, &after->commands[i]);
+      continue;
+    }
+    for (; next < match; next++)
+      damage_command(damage, &before->commands[next]);
+    next = match + 1;
+  }
+  for (; next < before->count; next++)
+    damage_command(damage, &before->commands[next]);
+}
+
+// Fills the part of an on-screen rectangle inside the clip, a framebuffer
+// word per pixel. A one-pixel-wide line is one store a row
+static void fill_clipped(unsigned char *framebuffer, rect fill, rect clip,
+                         uint32_t pixel) {
+  int left = fill.x > clip.x ? fill.x : clip.x;
+  int top = fill.y > clip.y ? fill.y : clip.y;
+  int right = fill.x + fill.width < clip.x + clip.width ? fill.x + fill.width
+                                                        : clip.x + clip.width;
+  int bottom = fill.y + fill.height < clip.y + clip.height
+                   ? fill.y + fill.height
+                   : clip.y + clip.height;
+
+  for (int row = top; row < bottom; row++) {
+    uint32_t *span = (uint32_t *)(framebuffer + row * SCREEN_LINE_LENGTH);
+
+    for (int col = left; col < right; col++)
+      span[col] = pixel;
+  }
+}
+
+// Draws all of the list that lands inside the clip
+static void draw_clipped(const draw_list *list, unsigned char *framebuffer,
+                         rect clip) {
+  rect background = {0, 0, screen.width, screen.height};
+
+  fill_clipped(framebuffer, background, clip, list->background);
+
+  for (int i = 0; i < list->count; i++) {
+    const draw_command *command = &list->commands[i];
+    rect bounds = command_bounds(command);
+
+    if (bounds.x >= clip.x + clip.width || clip.x >= bounds.x + bounds.width ||
+        bounds.y >= clip.y + clip.height || clip.y >= bounds.y + bounds.height)
+      continue;
+    if (command->kind == DRAW_SPRITE)
+      draw_sprite_clipped(*command->image, framebuffer, command->x, command->y,
+                          clip.x, clip.y, clip.x + clip.width,
+                          clip.y + clip.height);
+    else
+      fill_clipped(framebuffer, bounds, clip, command->pixel);
+  }
+}
+
+// Draws what lands on one band of rows, inside the damage if there is any;
+// returns the pixels drawn
+static long long draw_band(const draw_list *list, const damage_list *damage,
+                           unsigned char *framebuffer, int band) {
+  int first_row = band * BAND_HEIGHT;
+  int end_row = first_row + BAND_HEIGHT > screen.height
+                    ? screen.height
+                    : first_row + BAND_HEIGHT;
+  rect rows = {0, first_row, screen.width, end_row - first_row};
+  long long pixels = 0;
+
+  if (damage == NULL) {
+    draw_clipped(list, framebuffer, rows);
+    return (long long)rows.width * rows.height;
+  }
+
+  for (int i = 0; i < damage->count; i++) {
+    rect clip = damage->rects[i];
+    int top = clip.y > first_row ? clip.y : first_row;
+    int bottom =
+        clip.y + clip.height < end_row ? clip.y + clip.height : end_row;
+
+    if (top >= bottom)
+      continue;
+    clip.y = top;
+    clip.height = bottom - top;
+    draw_clipped(list, framebuffer, clip);
+    pixels += (long long)clip.width * clip.height;
+  }
+  return pixels;
+}
+
+// Takes bands until there are none left
+static void draw_bands(rasterizer *r, int thread) {
+  long long pixels = 0;
+  int band;
+
+  trace_begin("draw bands");
+  while ((band = __atomic_fetch_add(&r->next_band, 1, __ATOMIC_RELAXED)) <
+         r->num_bands) {
+    pixels += draw_band(r->list, r->damage, r->framebuffer, band);
+    r->bands_drawn[thread]++;
+  }
+  __atomic_fetch_add(&r->pixels_drawn, pixels, __ATOMIC_RELAXED);
+  trace_end("draw bands");
+}
+
+static void *render_worker_loop(void *arg) {
+  render_worker *worker = (render_worker *)arg;
+  rasterizer *r = worker->r;
+  long long seen = 0;
+
+  trace_thread("render worker");
+  realtime_thread(REALTIME_RENDER, worker->index);
+  arena_guard_thread();
+  pthread_mutex_lock(&r->mutex);
+  while (1) {
+    while (!r->stopping && r->generation == seen)
+      pthread_cond_wait(&r->start_cond, &r->mutex);
+    if (r->stopping)
+      break;
+    seen = r->generation;
+    pthread_mutex_unlock(&r->mutex);
+
+    draw_bands(r, worker->index);
+
+    pthread_mutex_lock(&r->mutex);
+    if (--r->busy_workers == 0)
+      pthread_cond_signal(&r->done_cond);
+  }
+  pthread_mutex_unlock(&r->mutex);
+
+  return NULL;
+}
+
+int rasterizer_init(rasterizer *r, int threads) {
+  memset(r, 0, sizeof(*r));
+
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  if (threads > MAX_RENDER_THREADS)
+    threads = MAX_RENDER_THREADS;
+  r->threads = threads;
+  r->num_bands = (screen.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+  pthread_mutex_init(&r->mutex, NULL);
+  pthread_cond_init(&r->start_cond, NULL);
+  pthread_cond_init(&r->done_cond, NULL);
+
+  for (int i = 0; i < threads - 1; i++) {
+    r->workers[i].r = r;
+    r->workers[i].index = i + 1;
+    if (pthread_create(&r->worker_threads[i], NULL, render_worker_loop,
+                       &r->workers[i]) != 0) {
+      perror("pthread_create(render worker) failed\n");
+      r->threads = i + 1; // Carry on with the ones that started
+      break;
+    }
+  }
+
+  return 0;
+}
+
+void rasterize(rasterizer *r, const draw_list *list,
+               const damage_list *damage, unsigned char *framebuffer) {
+  long long start = current_time_in_us();
+
+  r->list = list;
+  r->damage = damage;
+  r->framebuffer = framebuffer;
+  r->next_band = 0;
+
+  pthread_mutex_lock(&r->mutex);
+  r->generation++;
+  r->busy_workers = r->threads - 1;
+  pthread_cond_broadcast(&r->start_cond);
+  pthread_mutex_unlock(&r->mutex);
+
+  draw_bands(r, 0);
+
+  pthread_mutex_lock(&r->mutex);
+  while (r->busy_workers > 0)
+    pthread_cond_wait(&r->done_cond, &r->mutex);
+  pthread_mutex_unlock(&r->mutex);
+
+  r->frames++;
+  r->render_us += current_time_in_us() - start;
+}
+
+void rasterizer_print_stats(rasterizer *r) {
+  printf("---RASTERIZER STATISTICS---\n");
+  printf("Screen: %dx%d in %d bands\n", screen.width, screen.height,
+         r->num_bands);
+  printf("Threads: %d\n", r->threads);
+  printf("Frames: %lld\n", r->frames);
+  if (r->frames) {
+    printf("Render time: %.1fus/frame\n", (double)r->render_us / r->frames);
+    printf("Redrawn: %.1f%% of the screen/frame\n",
+           100.0 * r->pixels_drawn / r->frames / screen.width /
+               screen.height);
+    for (int i = 0; i < r->threads; i++)
+      printf("Thread %d: %.1f bands/frame\n", i,
+             (double)r->bands_drawn[i] / r->frames);
+  }
+}
+
+void rasterizer_destroy(rasterizer *r) {
+  pthread_mutex_lock(&r->mutex);
+  r->stopping = 1;
+  pthread_cond_broadcast(&r->start_cond);
+  pthread_mutex_unlock(&r->mutex);
+
+  for (int i = 0; i < r->threads - 1; i++)
+    pthread_join(r->worker_threads[i], NULL);
+
+  pthread_mutex_destroy(&r->mutex);
+  pthread_cond_destroy(&r->start_cond);
+  pthread_cond_destroy(&r->done_cond);
+}
@@ -0,0 +1,98 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include "colors.h"
+#include "damage.h"
+#include "sprites.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// Room for everything one frame draws: every note on screen, the highway
+// lines, the guitar state line, the HUD and the side panels
+#define MAX_DRAW_COMMANDS 256
+// The frame is split into bands this many rows tall. More bands than
+// threads, so a thread that finishes early takes another band
+#define BAND_HEIGHT 32
+#define MAX_RENDER_THREADS 8
+
+typedef enum { DRAW_SPRITE, DRAW_FILL } draw_kind;
+
+typedef struct {
+  draw_kind kind;
+  int x, y; // Center of a sprite, top left corner of a fill
+  int width, height; // Fills only, already clipped to the screen
+  const sprite *image; // Sprites only
+  long long version;   // Sprites only: changes when the image's pixels do
+  uint32_t pixel;      // Fills only: the color as a whole framebuffer word
+} draw_command;
+
+// What a frame is made of, in the order it is drawn: later commands draw
+// over earlier ones. Sprites are drawn from where they are when the frame
+// is rasterized, not when they are added
+typedef struct {
+  uint32_t background; // As a framebuffer word
+  int count;
+  long long dropped; // Commands that did not fit, for the statistics
+  draw_command commands[MAX_DRAW_COMMANDS];
+} draw_list;
+
+void draw_list_clear(draw_list *list, Color background);
+void draw_list_sprite(draw_list *list, const sprite *image, int x, int y);
+// For images that are redrawn in place: version must change whenever the
+// image does, so the frame it changes in redraws it
+void draw_list_sprite_version(draw_list *list, const sprite *image, int x,
+                              int y, long long version);
+// Solid rectangles and lines, clipped to the screen once here so drawing
+// them is just word-wide stores
+void draw_list_fill(draw_list *list, int x, int y, int width, int height,
+                    Color color);
+void draw_list_hline(draw_list *list, int x, int y, int width, Color color);
+void draw_list_vline(draw_list *list, int x, int y, int height, Color color);
+// Where after draws anything differently from before: the old and new
+// places of everything that moved, changed, came or went
+void draw_list_damage(const draw_list *before, const draw_list *after,
+                      damage_list *damage);
+
+typedef struct rasterizer rasterizer;
+
+typedef struct {
+  rasterizer *r;
+  int index; // 1 up; the calling thread is 0
+} render_worker;
+
+// Draws a draw_list into a frame, band by band, on a pool of threads that
+// lives as long as the rasterizer. The calling thread draws bands too
+struct rasterizer {
+  int threads; // Including the caller
+  pthread_t worker_threads[MAX_RENDER_THREADS - 1];
+  render_worker workers[MAX_RENDER_THREADS - 1];
+  pthread_mutex_t mutex;
+  pthread_cond_t start_cond, done_cond;
+  long long generation; // Frames handed to the workers so far
+  int busy_workers;     // Workers still drawing the current frame
+  int stopping;
+
+  // The frame being drawn
+  const draw_list *list;
+  const damage_list *damage;
+  unsigned char *framebuffer;
+  int num_bands, next_band; // next_band is claimed atomically
+
+  // For the statistics
+  long long frames, render_us, pixels_drawn;
+  long long bands_drawn[MAX_RENDER_THREADS]; // By each thread
+};
+
+// Starts threads - 1 workers; threads <= 0 uses one per online CPU. Returns
+// 0 on success
+int rasterizer_init(rasterizer *r, int threads);
+// Draws the list into framebuffer (screen.width x screen.height, word
+// aligned) inside the damaged rectangles, or everywhere if damage is NULL;
+// the rest of framebuffer is left as it is. Returns once every band is done
+void rasterize(rasterizer *r, const draw_list *list,
+               const damage_list *damage, unsigned char *framebuffer);
+void rasterizer_print_stats(rasterizer *r);
+// Stops and joins the workers
+void rasterizer_destroy(rasterizer *r);
+
+#endif /* RASTERIZER_H */
@@ -0,0 +1,181 @@
+#include "reactor.h"
+#include "arena.h"
+#include "helpers.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// Events handled per epoll_wait()
+#define MAX_READY 8
+
+static int add_source(reactor *r, int fd, int owned, reactor_handler handler,
+                      void *arg) {
+  struct epoll_event event;
+  reactor_source *source;
+
+  if (r->num_sources == MAX_REACTOR_SOURCES) {
+    fprintf(stderr, "%s: too many sources\n", r->name);
+    return -1;
+  }
+  source = &r->sources[r->num_sources];
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = source;
+  // Devices that do not support poll() are refused with EPERM
+  if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, fd, &event))
+    return -1;
+
+  source->fd = fd;
+  source->owned = owned;
+  source->handler = handler;
+  source->arg = arg;
+  r->num_sources++;
+  return 0;
+}
+
+int reactor_init(reactor *r, const char *name, realtime_role role) {
+  memset(r, 0, sizeof(*r));
+  r->name = name;
+  r->role = role;
+  r->stop_fd = -1;
+
+  if ((r->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    perror("epoll_create1 failed");
+    return 1;
+  }
+  if ((r->stop_fd = eventfd(0, EFD_CLOEXEC)) == -1 ||
+      add_source(r, r->stop_fd, 1, NULL, NULL)) {
+    perror("eventfd(reactor) failed");
+    if (r->stop_fd != -1)
+      close(r->stop_fd);
+    close(r->epoll_fd);
+    return 1;
+  }
+  return 0;
+}
+
+int reactor_add_fd(reactor *r, int fd, reactor_handler handler, void *arg) {
+  return add_source(r, fd, 0, handler, arg);
+}
+
+int reactor_add_timer(reactor *r, long long period_us, reactor_handler handler,
+                      void *arg) {
+  struct itimerspec period = {
+      .it_interval = {period_us / 1000000, period_us % 1000000 * 1000},
+      .it_value = {period_us / 1000000, period_us % 1000000 * 1000}};
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (fd == -1 || timerfd_settime(fd, 0, &period, NULL) ||
+      add_source(r, fd, 1, handler, arg)) {
+    perror("timerfd(reactor) failed");
+    if (fd != -1)
+      close(fd);
+    return 1;
+  }
+  r->sources[r->num_sources - 1].period_us = period_us;
+  r->sources[r->num_sources - 1].due_us = current_time_in_us() + period_us;
+  return 0;
+}
+
+static void *reactor_loop(void *arg) {
+  reactor *r = (reactor *)arg;
+  struct epoll_event ready[MAX_READY];
+
+  trace_thread(r->name);
+  realtime_thread(r->role, 0);
+  arena_guard_thread();
+  while (1) {
+    int count = epoll_wait(r->epoll_fd, ready, MAX_READY, -1);
+
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait failed");
+      break;
+    }
+    __atomic_add_fetch(&r->wakeups, 1, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < count; i++) {
+      reactor_source *source = (reactor_source *)ready[i].data.ptr;
+
+      if (source->fd == r->stop_fd)
+        return NULL;
+      // Nothing left to read and nobody left to write (a FIFO's writer has
+      // gone): it would only wake us up again straight away
+      if (!(ready[i].events & EPOLLIN)) {
+        epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+        continue;
+      }
+      // A timer has to be read to stop it being ready
+      if (source->owned) {
+        uint64_t expirations;
+        if (read(source->fd, &expirations, sizeof(expirations)) < 0)
+          continue;
+        realtime_note_wakeup(current_time_in_us() - source->due_us);
+        source->due_us += expirations * source->period_us;
+      }
+      trace_begin(r->name);
+      source->handler(source->arg, source->fd);
+      trace_end(r->name);
+      r->dispatches++;
+    }
+  }
+  return NULL;
+}
+
+int reactor_start(reactor *r) {
+  if (pthread_create(&r->thread, NULL, reactor_loop, r) != 0) {
+    perror("pthread_create(reactor) failed");
+    return 1;
+  }
+  r->started = 1;
+  return 0;
+}
+
+void reactor_destroy(reactor *r) {
+  uint64_t one = 1;
+
+  if (r->started) {
+    if (write(r->stop_fd, &one, sizeof(one)) != sizeof(one))
+      perror("write(reactor stop) failed");
+    pthread_join(r->thread, NULL);
+  }
+  for (int i = 0; i < r->num_sources; i++) {
+    if (r->sources[i].owned)
+      close(r->sources[i].fd);
+  }
+  close(r->epoll_fd);
+}
+
+int frame_timer_create(void) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+  if (fd == -1)
+    perror("timerfd_create(frame timer) failed");
+  return fd;
+}
+
+void frame_timer_wait_until(int timer_fd, long long deadline_us) {
+  struct itimerspec deadline = {
+      .it_interval = {0, 0},
+      .it_value = {deadline_us / 1000000, deadline_us % 1000000 * 1000}};
+  uint64_t expirations;
+
+  // A zero time would disarm the timer rather than fire it
+  if (deadline_us <= 0)
+    return;
+  // Already past is fine: the timer fires straight away
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &deadline, NULL) ||
+      read(timer_fd, &expirations, sizeof(expirations)) < 0)
+    perror("frame timer failed");
+  else
+    realtime_note_wakeup(current_time_in_us() - deadline_us);
+}
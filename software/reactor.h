@@ -0,0 +1,59 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "realtime.h"
+#include <pthread.h>
+
+// Enough for every player's input, the timers and the stop signal
+#define MAX_REACTOR_SOURCES 16
+
+// Called on the reactor's thread when fd is ready. Timers have already had
+// their expirations read
+typedef void (*reactor_handler)(void *arg, int fd);
+
+typedef struct {
+  int fd;
+  int owned; // Whether the reactor made fd (timers), and closes it
+  long long period_us, due_us; // Timers only: when the next one is due
+  reactor_handler handler;
+  void *arg;
+} reactor_source;
+
+// One thread that sleeps in epoll_wait() until a source has something for
+// it, instead of a thread per source waking up on its own schedule
+typedef struct {
+  int epoll_fd;
+  int stop_fd; // An eventfd, written to wake the thread up to stop
+  reactor_source sources[MAX_REACTOR_SOURCES];
+  int num_sources;
+  pthread_t thread;
+  const char *name; // For the trace
+  realtime_role role;
+  int started;
+  long long wakeups; // For the statistics; atomic
+  long long dispatches;
+} reactor;
+
+// The thread runs as role; returns 0 on success
+int reactor_init(reactor *r, const char *name, realtime_role role);
+// Watches fd for input, until whatever writes to it goes away. Returns -1 if
+// it cannot be watched (e.g. a device without poll() support), in which case
+// poll it from a timer instead
+int reactor_add_fd(reactor *r, int fd, reactor_handler handler, void *arg);
+// Calls handler every period_us, on a timerfd; returns 0 on success
+int reactor_add_timer(reactor *r, long long period_us, reactor_handler handler,
+                      void *arg);
+// Starts the thread; no sources can be added after this. Returns 0 on
+// success
+int reactor_start(reactor *r);
+// Stops and joins the thread, and closes what the reactor opened
+void reactor_destroy(reactor *r);
+
+// Frame deadlines: a timerfd that sleeps until an absolute time on the
+// current_time_in_us() clock, so a late wake-up does not push the next one
+// back. How late it wakes up is noted for realtime_print_stats(). Returns -1
+// on failure
+int frame_timer_create(void);
+void frame_timer_wait_until(int timer_fd, long long deadline_us);
+
+#endif /* REACTOR_H */
@@ -0,0 +1,147 @@
+// CPU_SET() and friends
+#define _GNU_SOURCE
+#include "realtime.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Stack each thread faults in up front
+#define STACK_PREFAULT_BYTES (64 * 1024)
+
+static realtime_profile profile;
+static int memory_locked;
+// Each kind of failure is only worth hearing about once
+static int warned_lock, warned_pin, warned_priority;
+static long minor_faults_start, major_faults_start;
+static __thread int thread_role = -1;
+
+// Wake-up lateness by role; atomic
+static struct {
+  long long wakeups, late_us, max_late_us;
+} wakeups[NUM_REALTIME_ROLES];
+
+static const char *role_names[NUM_REALTIME_ROLES] = {"Input", "Render",
+                                                     "Push"};
+
+static void warn_once(int *warned, const char *what, int error) {
+  if (!*warned)
+    fprintf(stderr, "realtime: could not %s (%s); carrying on without\n",
+            what, strerror(error));
+  *warned = 1;
+}
+
+void realtime_init(const realtime_profile *p) {
+  struct rlimit limit, unlimited = {RLIM_INFINITY, RLIM_INFINITY};
+
+  profile = *p;
+  if (!profile.enabled)
+    return;
+
+  // Under a locked memory limit, locking future memory would only make
+  // allocations past it fail, so only lock when there is no limit
+  getrlimit(RLIMIT_MEMLOCK, &limit);
+  if (limit.rlim_cur != RLIM_INFINITY &&
+      setrlimit(RLIMIT_MEMLOCK, &unlimited)) {
+    warn_once(&warned_lock, "lift the locked memory limit", errno);
+    return;
+  }
+
+  // Nothing gets paged out, and everything allocated from here on is
+  // faulted in as it is allocated
+  if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    warn_once(&warned_lock, "lock memory", errno);
+  else
+    memory_locked = 1;
+}
+
+void realtime_thread(realtime_role role, int index) {
+  thread_role = role;
+  if (!profile.enabled)
+    return;
+
+  if (profile.cpus[role] >= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    int error;
+
+    CPU_ZERO(&set);
+    CPU_SET((profile.cpus[role] + index) % (cpus > 0 ? cpus : 1), &set);
+    if ((error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)))
+      warn_once(&warned_pin, "pin threads to CPUs", error);
+  }
+
+  if (role == REALTIME_INPUT) {
+    struct sched_param param = {.sched_priority = profile.input_priority};
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    if (error)
+      warn_once(&warned_priority, "run input under SCHED_FIFO", error);
+  }
+
+  // The stack as deep as the thread is likely to go
+  volatile unsigned char stack[STACK_PREFAULT_BYTES];
+  for (size_t i = 0; i < sizeof(stack); i += 4096)
+    stack[i] = 0;
+}
+
+void realtime_prefault(void *memory, size_t size) {
+  volatile unsigned char *bytes = (volatile unsigned char *)memory;
+  long page = sysconf(_SC_PAGESIZE);
+
+  // Written back as it was, so this works on memory already in use
+  for (size_t i = 0; i < size; i += page > 0 ? page : 4096)
+    bytes[i] = bytes[i];
+}
+
+void realtime_start(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  minor_faults_start = usage.ru_minflt;
+  major_faults_start = usage.ru_majflt;
+}
+
+void realtime_note_wakeup(long long late_us) {
+  long long max;
+
+  if (thread_role < 0)
+    return;
+  __atomic_add_fetch(&wakeups[thread_role].wakeups, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&wakeups[thread_role].late_us, late_us,
+                     __ATOMIC_RELAXED);
+  max = __atomic_load_n(&wakeups[thread_role].max_late_us, __ATOMIC_RELAXED);
+  while (late_us > max &&
+         !__atomic_compare_exchange_n(&wakeups[thread_role].max_late_us, &max,
+                                      late_us, 0, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+    ;
+}
+
+void realtime_print_stats(void) {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  printf("---REALTIME STATISTICS---\n");
+  if (profile.enabled)
+    printf("Profile: on (memory %slocked, input %s)\n",
+           memory_locked ? "" : "not ",
+           warned_priority ? "not SCHED_FIFO" : "SCHED_FIFO");
+  else
+    printf("Profile: off\n");
+  printf("Page faults while playing: %ld minor, %ld major\n",
+         usage.ru_minflt - minor_faults_start,
+         usage.ru_majflt - major_faults_start);
+  for (int role = 0; role < NUM_REALTIME_ROLES; role++) {
+    if (wakeups[role].wakeups)
+      printf("%s wake-up latency: %.1fus average, %lldus worst (%lld)\n",
+             role_names[role],
+             (double)wakeups[role].late_us / wakeups[role].wakeups,
+             wakeups[role].max_late_us, wakeups[role].wakeups);
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+
+// What a thread does, for where it is pinned and how it is scheduled
+typedef enum {
+  REALTIME_INPUT,  // Reads and judges input; SCHED_FIFO in the profile
+  REALTIME_RENDER, // The game loop and the render workers
+  REALTIME_PUSH,   // Gets finished frames onto the display
+  NUM_REALTIME_ROLES
+} realtime_role;
+
+// How the game runs on a loaded cabinet
+typedef struct {
+  int enabled;
+  int input_priority;            // SCHED_FIFO priority of input threads
+  int cpus[NUM_REALTIME_ROLES];  // Where each role runs, or -1 for anywhere
+} realtime_profile;
+
+#define DEFAULT_INPUT_PRIORITY 80
+
+// With the profile enabled, locks all memory, present and future. Whatever
+// is not permitted is warned about once and left out
+void realtime_init(const realtime_profile *profile);
+// Puts the calling thread in its place. index spreads threads that share a
+// role across the CPUs after the role's own. Does nothing with the profile
+// off; either way, times the thread's timer wake-ups under role
+void realtime_thread(realtime_role role, int index);
+// Touches every page of memory the game will need in a hurry, so it does not
+// fault while playing
+void realtime_prefault(void *memory, size_t size);
+// Counts page faults from here on
+void realtime_start(void);
+// How late a wake-up on a timer was; counted under the calling thread's
+// role, if it has one
+void realtime_note_wakeup(long long late_us);
+void realtime_print_stats(void);
+
+#endif /* REALTIME_H */
@@ -0,0 +1,122 @@
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int replay_load(const char *path, int players, replay_event **events,
+                int *count) {
+  FILE *file = fopen(path, "r");
+  char line[128];
+  int capacity = 256, line_number = 0;
+
+  *count = 0;
+  if (file == NULL) {
+    perror("could not open replay");
+    return 1;
+  }
+  if ((*events = malloc(capacity * sizeof(replay_event))) == NULL) {
+    perror("Error allocating replay!\n");
+    fclose(file);
+    return 1;
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    replay_event event;
+    char frets[NUM_FRETS + 1];
+    int strum;
+
+    line_number++;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (sscanf(line, "%lld %d %5s %d", &event.song_us, &event.player, frets,
+               &strum) != 4 ||
+        strlen(frets) != NUM_FRETS || event.player < 1) {
+      fprintf(stderr, "%s:%d: expected song_us player frets strum\n", path,
+              line_number);
+      fclose(file);
+      free(*events);
+      return 1;
+    }
+    if (event.player > players) {
+      fprintf(stderr, "The replay has input for player %d; use --players\n",
+              event.player);
+      fclose(file);
+      free(*events);
+      return 1;
+    }
+
+    event.player--;
+    event.gs.frets = 0;
+    for (int fret = 0; fret < NUM_FRETS; fret++)
+      event.gs.frets |= (frets[fret] == '1') << fret;
+    event.gs.strum = strum != 0;
+
+    if (*count == capacity) {
+      replay_event *grown =
+          realloc(*events, 2 * capacity * sizeof(replay_event));
+      if (grown == NULL) {
+        perror("Error allocating replay!\n");
+        fclose(file);
+        free(*events);
+        return 1;
+      }
+      *events = grown;
+      capacity *= 2;
+    }
+    (*events)[(*count)++] = event;
+  }
+
+  fclose(file);
+  return 0;
+}
+
+void replay_player_init(replay_player *cursor) {
+  cursor->next = 0;
+  init_guitar_state(&cursor->state);
+}
+
+void replay_deliver(const replay_event *events, int count, long long until_us,
+                    int player, replay_player *cursor,
+                    guitar_listener listener, void *listener_arg,
+                    long long start_us, guitar_state *gs) {
+  for (; cursor->next < count && events[cursor->next].song_us <= until_us;
+       cursor->next++) {
+    const replay_event *event = &events[cursor->next];
+
+    if (event->player != player)
+      continue;
+    if (listener)
+      listener(listener_arg, &event->gs, start_us + event->song_us);
+
+    // A strum stays latched until the game loop has picked it up
+    int strum = event->gs.strum || cursor->state.strum;
+    cursor->state = event->gs;
+    cursor->state.strum = strum;
+  }
+
+  *gs = cursor->state;
+  cursor->state.strum = 0; // Each strum is judged once
+}
+
+int replay_save(const char *path, const replay_event *events, int count) {
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    perror("could not write replay");
+    return 1;
+  }
+
+  fprintf(file, "# song_us player frets strum\n");
+  for (int i = 0; i < count; i++) {
+    char frets[NUM_FRETS + 1];
+
+    for (int fret = 0; fret < NUM_FRETS; fret++)
+      frets[fret] = events[i].gs.frets & (1 << fret) ? '1' : '0';
+    frets[NUM_FRETS] = '\0';
+    fprintf(file, "%lld %d %s %d\n", events[i].song_us, events[i].player + 1,
+            frets, events[i].gs.strum);
+  }
+
+  fclose(file);
+  return 0;
+}
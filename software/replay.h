@@ -0,0 +1,42 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "guitar_state.h"
+
+// One change of a player's controller, at a point in the song. Replay files
+// hold one per line, in song order:
+//
+//   # song_us player frets strum
+//   1523000 1 10100 1
+//
+// with the frets green first, and strum 1 on the change that strummed.
+// Lines starting with # are comments
+typedef struct {
+  long long song_us; // Song time, as the judge sees it
+  int player;        // From 0
+  guitar_state gs;
+} replay_event;
+
+// Where one player is in a replay being played back
+typedef struct {
+  int next;           // Their next change to deliver
+  guitar_state state; // What they are holding, strum latched until polled
+} replay_player;
+
+// Reads a whole replay for a game of players players, failing if it has
+// input for any other; *events is malloc()ed. Returns 0 on success
+int replay_load(const char *path, int players, replay_event **events,
+                int *count);
+void replay_player_init(replay_player *cursor);
+// Delivers player's changes up to song time until_us, as an input thread
+// would have: each goes to listener (if any) stamped start_us + its song
+// time. *gs gets what the player is holding, strummed if they strummed since
+// the last call
+void replay_deliver(const replay_event *events, int count, long long until_us,
+                    int player, replay_player *cursor,
+                    guitar_listener listener, void *listener_arg,
+                    long long start_us, guitar_state *gs);
+// Writes events in the order given; returns 0 on success
+int replay_save(const char *path, const replay_event *events, int count);
+
+#endif /* REPLAY_H */
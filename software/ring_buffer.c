@@ -0,0 +1,71 @@
+#include "ring_buffer.h"
+#include "arena.h"
+#include <string.h>
+
+// head and tail are published with release stores and picked up with acquire
+// loads, so the samples they cover are visible to the other side first
+
+int ring_buffer_init(ring_buffer *rb, size_t capacity, int channels) {
+  rb->capacity = 1;
+  while (rb->capacity < capacity)
+    rb->capacity <<= 1;
+  rb->channels = channels;
+  rb->head = 0;
+  rb->tail = 0;
+
+  rb->samples = arena_alloc(rb->capacity * channels * sizeof(int16_t));
+  return rb->samples == NULL;
+}
+
+size_t ring_buffer_available(ring_buffer *rb) {
+  return __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+}
+
+size_t ring_buffer_space(ring_buffer *rb) {
+  return rb->capacity - ring_buffer_available(rb);
+}
+
+// Copies frames between the ring, starting at frame index, and samples,
+// wrapping around the end of the ring
+static void copy_frames(ring_buffer *rb, size_t index, int16_t *samples,
+                        size_t frames, int into_ring) {
+  size_t first = index & (rb->capacity - 1);
+  size_t run = frames < rb->capacity - first ? frames : rb->capacity - first;
+  size_t frame_bytes = rb->channels * sizeof(int16_t);
+
+  if (into_ring) {
+    memcpy(rb->samples + first * rb->channels, samples, run * frame_bytes);
+    memcpy(rb->samples, samples + run * rb->channels,
+           (frames - run) * frame_bytes);
+  } else {
+    memcpy(samples, rb->samples + first * rb->channels, run * frame_bytes);
+    memcpy(samples + run * rb->channels, rb->samples,
+           (frames - run) * frame_bytes);
+  }
+}
+
+size_t ring_buffer_write(ring_buffer *rb, const int16_t *samples,
+                         size_t frames) {
+  size_t head = rb->head; // Ours to change
+  size_t space = rb->capacity - (head - __atomic_load_n(&rb->tail,
+                                                         __ATOMIC_ACQUIRE));
+
+  if (frames > space)
+    frames = space;
+  copy_frames(rb, head, (int16_t *)samples, frames, 1);
+  __atomic_store_n(&rb->head, head + frames, __ATOMIC_RELEASE);
+  return frames;
+}
+
+size_t ring_buffer_read(ring_buffer *rb, int16_t *samples, size_t frames) {
+  size_t tail = rb->tail; // Ours to change
+  size_t available = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE) - tail;
+
+  if (frames > available)
+    frames = available;
+  copy_frames(rb, tail, samples, frames, 0);
+  __atomic_store_n(&rb->tail, tail + frames, __ATOMIC_RELEASE);
+  return frames;
+}
+
@@ -0,0 +1,29 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Single-producer, single-consumer queue of interleaved 16-bit audio frames.
+// One thread may write and one other thread may read at the same time
+// without any locking, so the reader can be an audio callback
+typedef struct {
+  int16_t *samples;
+  size_t capacity; // In frames; a power of two
+  int channels;
+  size_t head; // Frames ever written. Only the writer stores to it
+  size_t tail; // Frames ever read. Only the reader stores to it
+} ring_buffer;
+
+// Returns 0 on success. capacity is rounded up to a power of two; the
+// samples come from the arena
+int ring_buffer_init(ring_buffer *rb, size_t capacity, int channels);
+// Frames that can be read / written right now
+size_t ring_buffer_available(ring_buffer *rb);
+size_t ring_buffer_space(ring_buffer *rb);
+// Copy up to frames frames in / out; return how many were copied
+size_t ring_buffer_write(ring_buffer *rb, const int16_t *samples,
+                         size_t frames);
+size_t ring_buffer_read(ring_buffer *rb, int16_t *samples, size_t frames);
+
+#endif /* RING_BUFFER_H */
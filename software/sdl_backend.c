@@ -0,0 +1,112 @@
+#include "backend.h"
+#include "arena.h"
+#include "global_consts.h"
+#include "guitar_state.h"
+#include "helpers.h"
+#include "reactor.h"
+#include "realtime.h"
+#include "vga_emulator.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAME_US 16667 // 60 Hz, like the VGA output
+
+static VGAEmulator emulator;
+static unsigned char *framebuffer;
+static guitar_state emulated_states[MAX_PLAYERS];
+static long long frames_submitted, next_vsync_us;
+static int frame_timer;
+
+// Set up VGA emulator. Requires libsdl2-dev
+static int sdl_init(backend *self) {
+  printf("Running in VGA EMULATION MODE\n");
+
+  if ((framebuffer = arena_alloc(screen.width * screen.height * 4)) == NULL) {
+    perror("Error allocating framebuffer!\n");
+    return 1;
+  }
+  realtime_prefault(framebuffer, screen.width * screen.height * 4);
+
+  printf("Player 1: frets 1-5, strum SPACE\n");
+  if (screen.players > 1)
+    printf("Player 2: frets 6-0, strum RETURN\n");
+  if (screen.players > EMULATOR_KEY_SETS)
+    printf("Players %d and up have no keys\n", EMULATOR_KEY_SETS + 1);
+
+  if ((frame_timer = frame_timer_create()) == -1)
+    return 1;
+  next_vsync_us = current_time_in_us() + FRAME_US;
+  emulator.listener = self->listener;
+  for (int p = 0; p < screen.players; p++) {
+    init_guitar_state(&emulated_states[p]);
+    emulator.listener_args[p] = self->listener_args[p];
+  }
+
+  return VGAEmulator_init(&emulator, framebuffer, emulated_states,
+                          screen.players);
+}
+
+// The emulator draws straight from framebuffer, so copying what changed is
+// all it takes; the frame is pushed once it is there
+static void sdl_submit_frame(backend *self, const frame *f) {
+  latency_tag latency = f->latency;
+  (void)self;
+
+  damage_copy(f->damage, framebuffer, f->pixels);
+  latency_pushed(&latency, current_time_in_us());
+  pthread_mutex_lock(&emulator.latency_mutex);
+  latency_merge(&emulator.latency, &latency);
+  pthread_mutex_unlock(&emulator.latency_mutex);
+  frames_submitted++;
+}
+
+static int sdl_poll_input(backend *self, int player, guitar_state *gs) {
+  (void)self;
+
+  pthread_mutex_lock(&emulator.input_mutex[player]);
+  *gs = emulated_states[player];
+  emulated_states[player].strum = 0; // Each strum is judged once
+  pthread_mutex_unlock(&emulator.input_mutex[player]);
+
+  return emulator.running ? 0 : -1;
+}
+
+static void sdl_wait_vsync(backend *self) {
+  (void)self;
+
+  long long now = current_time_in_us();
+  if (next_vsync_us > now)
+    frame_timer_wait_until(frame_timer, next_vsync_us);
+  else
+    next_vsync_us = now; // Running late; don't try to catch up
+  next_vsync_us += FRAME_US;
+}
+
+static void sdl_stats(backend *self, backend_stats *stats) {
+  (void)self;
+
+  memset(stats, 0, sizeof(*stats)); // Nothing to say about the rest
+  stats->frames_submitted = frames_submitted;
+  stats->frames_shown = emulator.frames_rendered;
+  // One window surface update per frame
+  stats->transfers = emulator.frames_rendered;
+  stats->transfer_us = emulator.render_us;
+  stats->input_wakeups = emulator.input_wakeups;
+}
+
+static void sdl_destroy(backend *self) {
+  (void)self;
+
+  VGAEmulator_destroy(&emulator);
+  close(frame_timer);
+}
+
+backend sdl_backend = {.name = "sdl",
+                       .init = sdl_init,
+                       .submit_frame = sdl_submit_frame,
+                       .poll_input = sdl_poll_input,
+                       .wait_vsync = sdl_wait_vsync,
+                       .stats = sdl_stats,
+                       .destroy = sdl_destroy};
@@ -0,0 +1,98 @@
+#include "backend.h"
+#include "global_consts.h"
+#include "guitar_state.h"
+#include "helpers.h"
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs the game on a clock of its own that moves on a fixed step each
+// frame, so a whole song runs as fast as the CPU allows. Frames are dropped
+// like headless; input comes from a replay, delivered at exactly the song
+// time it says. The clock starts at 0 when init returns, which is where the
+// game starts the song
+
+#define DEFAULT_FRAME_US 16667 // 60 Hz, like the VGA output
+
+static backend_stats stats;
+static long long now_us, frame_us;
+static long long work_start_us; // Wall clock time the last frame started
+static replay_event *events;
+static int num_events;
+static replay_player cursors[MAX_PLAYERS];
+
+static int sim_init(backend *self) {
+  memset(&stats, 0, sizeof(stats));
+  now_us = 0;
+  frame_us = self->frame_us > 0 ? self->frame_us : DEFAULT_FRAME_US;
+  events = NULL;
+  num_events = 0;
+  for (int p = 0; p < MAX_PLAYERS; p++)
+    replay_player_init(&cursors[p]);
+
+  if (self->replay_path != NULL &&
+      replay_load(self->replay_path, screen.players, &events, &num_events))
+    return 1;
+
+  printf("Simulating %lldus frames, %d input changes\n", frame_us,
+         num_events);
+  work_start_us = current_time_in_us();
+  return 0;
+}
+
+// There is nothing to push to, so a frame is pushed as it is submitted
+static void sim_submit_frame(backend *self, const frame *f) {
+  latency_tag latency = f->latency;
+  (void)self;
+
+  latency_pushed(&latency, now_us);
+  stats.frames_submitted++;
+  stats.frames_shown++;
+}
+
+// Delivers the player's changes up to now, each at the time it happened, as
+// an input thread would have
+static int sim_poll_input(backend *self, int player, guitar_state *gs) {
+  replay_deliver(events, num_events, now_us, player, &cursors[player],
+                 self->listener, self->listener_args[player], 0, gs);
+  return 0;
+}
+
+// The next frame is due as soon as this one is done
+static void sim_wait_vsync(backend *self) {
+  long long now = current_time_in_us();
+  (void)self;
+
+  stats.frame_work_us += now - work_start_us;
+  work_start_us = now;
+  now_us += frame_us;
+}
+
+static long long sim_now_us(backend *self) {
+  (void)self;
+
+  return now_us;
+}
+
+static void sim_stats(backend *self, backend_stats *out) {
+  (void)self;
+
+  *out = stats;
+}
+
+static void sim_destroy(backend *self) {
+  (void)self;
+
+  free(events);
+}
+
+backend sim_backend = {.name = "sim",
+                       .init = sim_init,
+                       .submit_frame = sim_submit_frame,
+                       .poll_input = sim_poll_input,
+                       .wait_vsync = sim_wait_vsync,
+                       .now_us = sim_now_us,
+                       .stats = sim_stats,
+                       .destroy = sim_destroy};
@@ -1,17 +1,18 @@
 #ifndef SONG_DATA_H
 #define SONG_DATA_H
 
-#define NUM_NOTE_ROWS 300 // Number of note rows in song_data buffer
-#define SONG_BPM 137 // Barracuda's BPM
+#include "guitar_state.h"
+
+// The chart played without a song library, from the working directory. Only
+// its first BUILTIN_CHART_ROWS rows are played
+#define BUILTIN_CHART "single_note_comaless.txt"
+#define BUILTIN_CHART_ROWS 100
+#define SONG_BPM 137 // For charts with no #bpm line: Barracuda's BPM
 #define NOTES_PER_MEASURE 1.75 // How many note rows per measure 
+#define BEATS_PER_MEASURE 4 // Barracuda is in 4/4
 
-// Each of these is a bool: 1 if there's one of these notes in this line
-typedef struct {
-  int green;
-  int red;
-  int yellow;
-  int blue;
-  int orange;
-} note_row;
+// The notes in one line of the chart, as FRET_* bits. A chart is an array
+// of these, a byte a row
+typedef unsigned char note_row;
 
 #endif /* SONG_DATA_H */
@@ -1,4 +1,5 @@
 #include "sprites.h"
+#include "arena.h"
 #include "global_consts.h"
 #include <stdlib.h>
 #include <string.h>
@@ -61,25 +62,21 @@ sprite load_sprite(char *filename) {
 
   loaded_sprite.B_per_row = png_get_rowbytes(png, info);
 
+  // Rows are read straight into their place in the pixel buffer
   png_bytep *row_pointers =
-      (png_bytep *)malloc(sizeof(png_bytep) * loaded_sprite.height);
-
-  for (int y = 0; y < loaded_sprite.height; y++) {
-    row_pointers[y] = (png_byte *)malloc(loaded_sprite.B_per_row);
-  }
-
-  png_read_image(png, row_pointers);
-
+      arena_alloc(sizeof(png_bytep) * loaded_sprite.height);
   loaded_sprite.pixel_buffer =
-      malloc(loaded_sprite.height * loaded_sprite.B_per_row * 4);
-
-  for (int y = 0; y < loaded_sprite.height; y++) {
-    memcpy(loaded_sprite.pixel_buffer + y * loaded_sprite.B_per_row * 4,
-           row_pointers[y], loaded_sprite.B_per_row);
-    free(row_pointers[y]);
+      arena_alloc(loaded_sprite.height * loaded_sprite.B_per_row * 4);
+  if (row_pointers == NULL || loaded_sprite.pixel_buffer == NULL) {
+    perror("Error allocating memory for pixel buffer");
+    exit(EXIT_FAILURE);
   }
 
-  free(row_pointers);
+  for (int y = 0; y < loaded_sprite.height; y++)
+    row_pointers[y] =
+        loaded_sprite.pixel_buffer + y * loaded_sprite.B_per_row * 4;
+
+  png_read_image(png, row_pointers);
 
   fclose(fp);
   png_destroy_read_struct(&png, &info, NULL);
@@ -90,7 +87,7 @@ sprite load_sprite(char *filename) {
 sprite deep_copy_sprite(sprite original) {
   sprite copy;
 
-  copy.pixel_buffer = malloc(original.height * original.B_per_row * 4);
+  copy.pixel_buffer = arena_alloc(original.height * original.B_per_row * 4);
   if (copy.pixel_buffer == NULL) {
     // Handle memory allocation error
     perror("Error allocating memory for pixel buffer");
@@ -109,15 +106,6 @@ sprite deep_copy_sprite(sprite original) {
   return copy;
 }
 
-void unload_sprite(sprite loaded_sprite) { free(loaded_sprite.pixel_buffer); }
-void unload_sprites(generated_circles circles) {
-  unload_sprite(circles.green);
-  unload_sprite(circles.red);
-  unload_sprite(circles.yellow);
-  unload_sprite(circles.blue);
-  unload_sprite(circles.orange);
-}
-
 void sprite_for_each_pixel(sprite loaded_sprite,
                            void (*fn)(png_bytep px, int px_row, int px_col)) {
   for (int y = 0; y < loaded_sprite.height; y++) {
@@ -131,46 +119,57 @@ void sprite_for_each_pixel(sprite loaded_sprite,
 
 void draw_sprite(sprite loaded_sprite, unsigned char *framebuffer, int screenX,
                  int screenY) {
+  draw_sprite_clipped(loaded_sprite, framebuffer, screenX, screenY, 0, 0,
+                      screen.width, screen.height);
+}
+
+void draw_sprite_clipped(sprite loaded_sprite, unsigned char *framebuffer,
+                         int screenX, int screenY, int first_col,
+                         int first_row, int end_col, int end_row) {
   // Determine the coordinates of the top left corner of the sprite on the
   // screen
   int tl[] = {screenX - loaded_sprite.width / 2,
               screenY - loaded_sprite.height / 2};
 
-  for (int sprite_row = 0; sprite_row < loaded_sprite.height; sprite_row++) {
-    for (int sprite_col = 0; sprite_col < loaded_sprite.width; sprite_col++) {
+  // Only the part of the sprite that lands inside the clip
+  if (first_col < 0)
+    first_col = 0;
+  if (first_row < 0)
+    first_row = 0;
+  if (end_col > screen.width)
+    end_col = screen.width;
+  if (end_row > screen.height)
+    end_row = screen.height;
+  int first_sprite_col = first_col - tl[0] > 0 ? first_col - tl[0] : 0;
+  int end_sprite_col = end_col - tl[0] < loaded_sprite.width
+                           ? end_col - tl[0]
+                           : loaded_sprite.width;
+  int first_sprite_row = first_row - tl[1] > 0 ? first_row - tl[1] : 0;
+  int end_sprite_row = end_row - tl[1] < loaded_sprite.height
+                           ? end_row - tl[1]
+                           : loaded_sprite.height;
+
+  for (int sprite_row = first_sprite_row; sprite_row < end_sprite_row;
+       sprite_row++) {
+    for (int sprite_col = first_sprite_col; sprite_col < end_sprite_col;
+         sprite_col++) {
       png_bytep px = &(
           loaded_sprite.pixel_buffer[sprite_row * loaded_sprite.B_per_row * 4 +
                                      sprite_col * 4]);
 
-      unsigned char R = (unsigned char)px[0], G = (unsigned char)px[1],
-                    B = (unsigned char)px[2];
-
       if (!pixel_visible(px))
         continue;
 
       // Determine the offset of the framebuffer for this pixel
       int screen_x = tl[0] + sprite_col;
       int screen_y = tl[1] + sprite_row;
-
-      if (screen_x < 0 || screen_y < 0)
-        continue;
-
-      long long framebuffer_offset = screen_y * SCREEN_LINE_LENGTH + screen_x * 4;
-
-      if (framebuffer_offset < 0 ||
-          framebuffer_offset >= WINDOW_WIDTH * WINDOW_HEIGHT * 4 ||
-          screen_x < 0 || screen_x >= WINDOW_WIDTH || screen_y < 0 ||
-          screen_y >= WINDOW_HEIGHT)
-        continue;
-
-      // printf("Drawing (R: %d, G: %d, B: %d) at screen coords (%d, %d), png "
-            //  "coords (%d, %d)\n",
-            //  R, G, B, screen_x, screen_y, sprite_col, sprite_row);
+      unsigned char *pixel =
+          framebuffer + screen_y * SCREEN_LINE_LENGTH + screen_x * 4;
 
       // Set R, G, B
-      (framebuffer + framebuffer_offset)[2] = R;
-      (framebuffer + framebuffer_offset)[1] = G;
-      (framebuffer + framebuffer_offset)[0] = B;
+      pixel[2] = px[0];
+      pixel[1] = px[1];
+      pixel[0] = px[2];
     }
   }
 }
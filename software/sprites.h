@@ -40,11 +40,9 @@ typedef struct {
   RGB dark_gray;
 } circle_colors;
 
-// Load a sprite from a filename
+// Load a sprite from a filename. Its pixels come from the arena, and go
+// when it does
 sprite load_sprite(char *filename);
-// Free remaining memory
-void unload_sprite(sprite loaded_sprite);
-void unload_sprites(generated_circles circles);
 
 void sprite_for_each_pixel(sprite loaded_sprite,
                            void (*fn)(png_bytep px, int px_row, int px_col));
@@ -53,8 +51,14 @@ void sprite_for_each_pixel(sprite loaded_sprite,
 // Considers the top left corner of the screen (0, 0);
 void draw_sprite(sprite loaded_sprite, unsigned char *framebuffer, int screenX,
                  int screenY);
+// Same, but only touches screen columns first_col up to (not including)
+// end_col on rows first_row up to end_row
+void draw_sprite_clipped(sprite loaded_sprite, unsigned char *framebuffer,
+                         int screenX, int screenY, int first_col,
+                         int first_row, int end_col, int end_row);
 
-// Performs a deep copy of the given sprite. Does NOT copy the filename
+// Performs a deep copy of the given sprite, into the arena. Does NOT copy
+// the filename
 sprite deep_copy_sprite(sprite original);
 
 // Returns the average of the RGB values
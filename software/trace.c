@@ -0,0 +1,156 @@
+#include "trace.h"
+#include "helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *name;
+  long long time_us;
+  char phase; // 'B'egin, 'E'nd or 'i'nstant, as the JSON has them
+} trace_event;
+
+// Only ever written by the thread it belongs to
+typedef struct {
+  char thread_name[32];
+  int count;
+  long long dropped;
+  trace_event events[TRACE_EVENTS_PER_THREAD];
+} trace_buffer;
+
+static const char *trace_path;
+static int tracing;
+static trace_buffer *buffers[MAX_TRACE_THREADS];
+static int num_buffers; // Slots are claimed atomically
+static __thread trace_buffer *thread_buffer;
+static __thread int thread_untraceable; // Every slot was taken
+
+// The calling thread's buffer, claiming one the first time
+static trace_buffer *own_buffer(void) {
+  if (thread_buffer != NULL || thread_untraceable)
+    return thread_buffer;
+
+  int slot = __atomic_fetch_add(&num_buffers, 1, __ATOMIC_RELAXED);
+  if (slot >= MAX_TRACE_THREADS) {
+    thread_untraceable = 1;
+    return NULL;
+  }
+  if ((thread_buffer = calloc(1, sizeof(trace_buffer))) == NULL) {
+    thread_untraceable = 1;
+    return NULL;
+  }
+  snprintf(thread_buffer->thread_name, sizeof(thread_buffer->thread_name),
+           "thread %d", slot);
+  // Published for trace_finish(), which runs after this thread is done
+  __atomic_store_n(&buffers[slot], thread_buffer, __ATOMIC_RELEASE);
+  return thread_buffer;
+}
+
+static void record(const char *name, char phase) {
+  trace_buffer *buffer = own_buffer();
+
+  if (buffer == NULL)
+    return;
+  if (buffer->count == TRACE_EVENTS_PER_THREAD) {
+    buffer->dropped++;
+    return;
+  }
+
+  trace_event *event = &buffer->events[buffer->count++];
+  event->name = name;
+  event->time_us = current_time_in_us();
+  event->phase = phase;
+}
+
+int trace_init(const char *path) {
+  trace_path = path;
+  tracing = path != NULL;
+  return 0;
+}
+
+void trace_thread(const char *name) {
+  trace_buffer *buffer;
+
+  if (!tracing || (buffer = own_buffer()) == NULL)
+    return;
+  snprintf(buffer->thread_name, sizeof(buffer->thread_name), "%s", name);
+}
+
+void trace_begin(const char *name) {
+  if (tracing)
+    record(name, 'B');
+}
+
+void trace_end(const char *name) {
+  if (tracing)
+    record(name, 'E');
+}
+
+void trace_instant(const char *name) {
+  if (tracing)
+    record(name, 'i');
+}
+
+void trace_lock(pthread_mutex_t *mutex, const char *name) {
+  if (!tracing) {
+    pthread_mutex_lock(mutex);
+    return;
+  }
+
+  // Only a lock someone else holds is worth a mark on the timeline
+  if (pthread_mutex_trylock(mutex) == 0)
+    return;
+  record(name, 'B');
+  pthread_mutex_lock(mutex);
+  record(name, 'E');
+}
+
+void trace_finish(void) {
+  int threads = num_buffers < MAX_TRACE_THREADS ? num_buffers
+                                                : MAX_TRACE_THREADS;
+  long long events = 0, dropped = 0;
+  const char *separator = ""; // JSON has no trailing commas
+  FILE *file;
+
+  if (!tracing)
+    return;
+  tracing = 0;
+
+  if ((file = fopen(trace_path, "w")) == NULL) {
+    perror("could not write trace");
+  } else {
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int t = 0; t < threads; t++) {
+      trace_buffer *buffer = __atomic_load_n(&buffers[t], __ATOMIC_ACQUIRE);
+
+      if (buffer == NULL)
+        continue;
+      fprintf(file,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              separator, t, buffer->thread_name);
+      separator = ",\n";
+      for (int i = 0; i < buffer->count; i++) {
+        const trace_event *event = &buffer->events[i];
+
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,"
+                "\"tid\":%d%s}",
+                event->name, event->phase, event->time_us, t,
+                event->phase == 'i' ? ",\"s\":\"t\"" : "");
+      }
+      events += buffer->count;
+      dropped += buffer->dropped;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+  }
+
+  printf("---TRACE---\n");
+  printf("Threads: %d\n", threads);
+  printf("Events: %lld (%lld dropped)\n", events, dropped);
+  printf("Written to: %s\n", trace_path);
+
+  for (int t = 0; t < threads; t++)
+    free(buffers[t]);
+}
@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+
+// Threads that can be traced, and how many events each keeps. Events past
+// that are counted and dropped
+#define MAX_TRACE_THREADS 24
+#define TRACE_EVENTS_PER_THREAD 65536
+
+// A timeline of what every thread was doing, written at exit as Chrome
+// trace JSON (chrome://tracing, or ui.perfetto.dev). Each thread records
+// into its own buffer, so recording takes no locks; with tracing off every
+// call here is one branch.
+//
+// Names must outlive the trace: string literals
+
+// Starts recording, to be written to path; path NULL leaves tracing off.
+// Returns 0 on success
+int trace_init(const char *path);
+// Names the calling thread on the timeline. Threads that record without
+// naming themselves show up numbered
+void trace_thread(const char *name);
+void trace_begin(const char *name);
+void trace_end(const char *name);
+// Something that happened at one moment, e.g. a push overrunning its frame
+void trace_instant(const char *name);
+// Locks mutex, recording a wait named name on the timeline if it was taken
+void trace_lock(pthread_mutex_t *mutex, const char *name);
+// Writes the trace. Every traced thread must have finished recording
+void trace_finish(void);
+
+#endif /* TRACE_H */
@@ -1,74 +1,141 @@
 #include "vga_emulator.h"
 #include "global_consts.h"
 #include "guitar_state.h"
+#include "helpers.h"
+#include "reactor.h"
+#include "realtime.h"
+#include "trace.h"
 #include <SDL2/SDL_events.h>
 #include <unistd.h>
 
 extern int SCREEN_LINE_LENGTH;
 
+#define FRAME_US 16667 // 60 Hz refresh rate
+// Longest the event thread sleeps without looking at whether to stop
+#define EVENT_WAIT_MS 50
+
 void *render(void *args) {
   VGAEmulator *emulator = (VGAEmulator *)args;
   SDL_Surface *surface = emulator->surface;
   unsigned char *framebuffer = emulator->framebuffer;
+  // Frames are due on a fixed cadence, however long each one took
+  int frame_timer = frame_timer_create();
+  long long next_frame_us = current_time_in_us();
 
+  trace_thread("emulator render");
+  realtime_thread(REALTIME_PUSH, 0);
   while (emulator->running) {
-    for (int y = 0; y < WINDOW_HEIGHT; ++y) {
-      for (int x = 0; x < WINDOW_WIDTH; ++x) {
-        unsigned char *pixel = framebuffer + (y * WINDOW_WIDTH + x) * 4;
+    long long render_start = current_time_in_us();
+    trace_begin("emulator render");
+    pthread_mutex_lock(&emulator->latency_mutex);
+    latency_tag latency = emulator->latency;
+    emulator->latency.tagged = 0;
+    pthread_mutex_unlock(&emulator->latency_mutex);
+    // Straight into the (32 bits/pixel) window surface: a fill per pixel is
+    // far too slow for a whole 640x480 screen
+    SDL_LockSurface(surface);
+    for (int y = 0; y < screen.height; ++y) {
+      Uint32 *row = (Uint32 *)((Uint8 *)surface->pixels + y * surface->pitch);
+
+      for (int x = 0; x < screen.width; ++x) {
+        unsigned char *pixel = framebuffer + (y * screen.width + x) * 4;
 
         Uint8 r = pixel[2];
         Uint8 g = pixel[1];
         Uint8 b = pixel[0];
 
-        Uint32 color = SDL_MapRGB(surface->format, r, g, b);
-        SDL_Rect pixel_rect = {x, y, 1, 1};
-
-        SDL_FillRect(surface, &pixel_rect, color);
+        row[x] = SDL_MapRGB(surface->format, r, g, b);
       }
     }
+    SDL_UnlockSurface(surface);
     SDL_UpdateWindowSurface(emulator->window);
-    usleep(16667); // 60 Hz refresh rate
+    latency_shown(&latency, current_time_in_us());
+    emulator->frames_rendered++;
+    emulator->render_us += current_time_in_us() - render_start;
+    trace_end("emulator render");
+
+    long long now = current_time_in_us();
+    next_frame_us += FRAME_US;
+    if (next_frame_us < now)
+      next_frame_us = now; // Running late; don't try to catch up
+    if (frame_timer != -1)
+      frame_timer_wait_until(frame_timer, next_frame_us);
+    else
+      usleep(next_frame_us - now);
   }
+  if (frame_timer != -1)
+    close(frame_timer);
   return NULL;
 }
 
+// Each player's frets, green to orange, then their strum
+#define KEY_STRUM 5
+static const SDL_Keycode player_keys[EMULATOR_KEY_SETS][KEY_STRUM + 1] = {
+    {SDLK_1, SDLK_2, SDLK_3, SDLK_4, SDLK_5, SDLK_SPACE},
+    {SDLK_6, SDLK_7, SDLK_8, SDLK_9, SDLK_0, SDLK_RETURN},
+};
+
+// Finds whose key it is and what it does; returns 0 if nobody's
+static int find_key(SDL_Keycode key, int *player, int *button) {
+  for (*player = 0; *player < EMULATOR_KEY_SETS; (*player)++) {
+    for (*button = 0; *button <= KEY_STRUM; (*button)++) {
+      if (player_keys[*player][*button] == key)
+        return 1;
+    }
+  }
+  return 0;
+}
+
 void *handle_events(void *args) {
   VGAEmulator *emulator = (VGAEmulator *)args;
   SDL_Event event;
-  while (1) {
-    while (emulator->running && SDL_PollEvent(&event)) {
+
+  trace_thread("emulator input");
+  realtime_thread(REALTIME_INPUT, 0);
+  while (emulator->running) {
+    // Sleeps until there is an event, rather than checking every so often
+    if (SDL_WaitEventTimeout(&event, EVENT_WAIT_MS)) {
+      int player, button;
+
+      emulator->input_wakeups++;
       if (event.type == SDL_QUIT) {
-        VGAEmulator_destroy(emulator);
+        // The game notices through poll_input and shuts us down
+        emulator->running = 0;
         return NULL;
-      } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+      } else if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) &&
+                 !event.key.repeat &&
+                 find_key(event.key.keysym.sym, &player, &button) &&
+                 player < emulator->players) {
         int new_value = event.type == SDL_KEYDOWN;
-        switch (event.key.keysym.sym) {
-        case SDLK_1:
-          emulator->gs->green = new_value;
-          break;
-        case SDLK_2:
-          emulator->gs->red = new_value;
-          break;
-        case SDLK_3:
-          emulator->gs->yellow = new_value;
-          break;
-        case SDLK_4:
-          emulator->gs->blue = new_value;
-          break;
-        case SDLK_5:
-          emulator->gs->orange = new_value;
-          break;
-        case SDLK_SPACE:
-          emulator->gs->strum = new_value;
-          break;
+        guitar_state *gs = &emulator->gs[player];
+        guitar_state change;
+        trace_lock(&emulator->input_mutex[player], "wait input mutex");
+        change = *gs;
+        change.strum = 0;
+        if (button != KEY_STRUM) {
+          // Buttons are in the same order as the fret bits
+          gs->frets = (gs->frets & ~(1 << button)) | new_value << button;
+          change.frets = gs->frets;
+        } else if (new_value) {
+          // Latched like the hardware: stays set until the game picks it up
+          gs->strum = change.strum = 1;
+        }
+        pthread_mutex_unlock(&emulator->input_mutex[player]);
+
+        if (emulator->listener) {
+          trace_begin("judge input");
+          emulator->listener(emulator->listener_args[player], &change,
+                             current_time_in_us());
+          trace_end("judge input");
         }
       }
     }
   }
+  return NULL;
 }
 
 int VGAEmulator_init(VGAEmulator *emulator, unsigned char *framebuffer,
-                     guitar_state *gs) {
+                     guitar_state *gs, int players) {
   // Initialize SDL
   if (SDL_Init(SDL_INIT_VIDEO) < 0) {
     printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
@@ -77,8 +144,8 @@ int VGAEmulator_init(VGAEmulator *emulator, unsigned char *framebuffer,
 
   // Create window
   emulator->window = SDL_CreateWindow("VGA Emulator", SDL_WINDOWPOS_UNDEFINED,
-                                      SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH,
-                                      WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
+                                      SDL_WINDOWPOS_UNDEFINED, screen.width,
+                                      screen.height, SDL_WINDOW_SHOWN);
   if (emulator->window == NULL) {
     printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
     exit(1);
@@ -90,6 +157,14 @@ int VGAEmulator_init(VGAEmulator *emulator, unsigned char *framebuffer,
   emulator->framebuffer = framebuffer;
   emulator->running = 1;
   emulator->gs = gs;
+  emulator->players = players;
+  emulator->frames_rendered = 0;
+  emulator->render_us = 0;
+  emulator->input_wakeups = 0;
+  emulator->latency.tagged = 0;
+  pthread_mutex_init(&emulator->latency_mutex, NULL);
+  for (int p = 0; p < players; p++)
+    pthread_mutex_init(&emulator->input_mutex[p], NULL);
 
   if (pthread_create(&emulator->render_thread, NULL, render, emulator) != 0) {
     printf("Error creating render thread\n");
@@ -115,4 +190,7 @@ void VGAEmulator_destroy(VGAEmulator *emulator) {
   // Clean up SDL resources
   SDL_DestroyWindow(emulator->window);
   SDL_Quit();
+  for (int p = 0; p < emulator->players; p++)
+    pthread_mutex_destroy(&emulator->input_mutex[p]);
+  pthread_mutex_destroy(&emulator->latency_mutex);
 }
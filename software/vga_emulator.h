@@ -1,22 +1,41 @@
 #ifndef VGA_EMULATOR_H
 #define VGA_EMULATOR_H
 
+#include "global_consts.h"
 #include "guitar_state.h"
+#include "latency.h"
 #include <SDL2/SDL.h>
 #include <pthread.h>
 
 typedef struct {
   SDL_Window *window;
   SDL_Surface *surface;
-  guitar_state *gs;
+  int players;
+  guitar_state *gs; // One per player
   pthread_t render_thread;
   pthread_t event_thread;
   int running;
   unsigned char *framebuffer;
+  // Each guards one player's gs against the event thread
+  pthread_mutex_t input_mutex[MAX_PLAYERS];
+  // If set (before VGAEmulator_init), told about every key change, with the
+  // argument for the player whose key it was
+  guitar_listener listener;
+  void *listener_args[MAX_PLAYERS];
+  long long frames_rendered;
+  long long render_us; // Time spent drawing the framebuffer to the window
+  long long input_wakeups; // Events the event thread woke up for
+  // The earliest input in framebuffer not drawn to the window yet
+  pthread_mutex_t latency_mutex;
+  latency_tag latency;
 } VGAEmulator;
 
-// Initialize the VGA emulator
-int VGAEmulator_init(VGAEmulator *emulator, unsigned char *framebuffer, guitar_state *gs);
+// Players with their own set of keys: 1-5 and space, then 6-0 and return
+#define EMULATOR_KEY_SETS 2
+
+// Initialize the VGA emulator; gs has a state for each of the players
+int VGAEmulator_init(VGAEmulator *emulator, unsigned char *framebuffer,
+                     guitar_state *gs, int players);
 
 // Destroy the VGA emulator
 void VGAEmulator_destroy(VGAEmulator *emulator);
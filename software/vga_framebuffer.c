@@ -22,24 +22,74 @@
 #include "vga_framebuffer.h"
 #include "colors.h"
 #include "global_consts.h"
+#include "helpers.h"
+#include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
+#include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/kernel.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
+#include <linux/of_irq.h>
 #include <linux/platform_device.h>
+#include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/wait.h>
 
 #define DRIVER_NAME "vga_framebuffer"
 
-/* Device registers */
-#define FIRST_CHUNK(x) (x)
+/* Device registers, from the word addresses in vga_framebuffer.h */
+#define REGISTER(x, reg) ((x) + 4 * VGA_FRAMEBUFFER_REG_##reg)
+#define FIRST_CHUNK(x) REGISTER(x, PIXEL)
+#define SCROLL_OFFSET(x) REGISTER(x, SCROLL_OFFSET)
+#define FIXED_START(x) REGISTER(x, FIXED_START)
+#define WRITE_POINTER(x) REGISTER(x, WRITE_POINTER)
+#define PACKED_PIXELS(x) REGISTER(x, PACKED_PIXELS)
+#define PAGE_FLIP(x) REGISTER(x, PAGE_FLIP)
+#define IRQ_CONTROL(x) REGISTER(x, IRQ_CONTROL)
+#define SCROLL_COLUMNS(x) REGISTER(x, SCROLL_COLUMNS)
+#define PALETTE(x) REGISTER(x, PALETTE)
+#define BLIT_DEST(x) REGISTER(x, BLIT_DEST)
+#define BLIT_SIZE(x) REGISTER(x, BLIT_SIZE)
+#define BLIT_SOURCE(x) REGISTER(x, BLIT_SOURCE)
+#define BLIT_START(x) REGISTER(x, BLIT_START)
+#define STATUS(x) REGISTER(x, STATUS)
+
+#define BLIT_COPY VGA_FRAMEBUFFER_START_COPY
+#define BLIT_SOURCE_ON_SCREEN VGA_FRAMEBUFFER_START_SOURCE_ON_SCREEN
+
+#define IRQ_ENABLE VGA_FRAMEBUFFER_IRQ_ENABLE
+#define STATUS_BUSY VGA_FRAMEBUFFER_STATUS_BUSY
+
+/*
+ * Waiting for the device: status reads to spin through before sleeping,
+ * enough for the note-sized blits most of a frame is made of, and how
+ * long to sleep between reads after that
+ */
+#define IDLE_SPIN_POLLS 32
+#define IDLE_SLEEP_US 20
+
+/*
+ * Test builds only (make modules KCFLAGS=-DVGA_FRAMEBUFFER_FAKE_VBLANK): with
+ * no interrupt in the device tree, fake vblank with a timer. The timer has
+ * nothing to do with VGA_VS, so a flip may not have happened when it fires,
+ * and a push into the page it was meant to hide tears. Real builds need the
+ * interrupt
+ */
+#ifdef VGA_FRAMEBUFFER_FAKE_VBLANK
+#define VBLANK_PERIOD_NS 16683333 /* 25 MHz / (800 * 525) */
+#endif
+
+#define FRAME_WORDS (VGA_FRAMEBUFFER_FRAME_BYTES / 4)
 
 /*
  * Information about our device
@@ -47,16 +97,178 @@
 struct framebuffer_dev {
   struct resource res;    /* Resource: our registers */
   void __iomem *virtbase; /* Where registers can be accessed in memory */
+  unsigned int irq;       /* Vblank interrupt, or 0 if it is being faked */
+#ifdef VGA_FRAMEBUFFER_FAKE_VBLANK
+  struct hrtimer fake_vblank;
+#endif
+  wait_queue_head_t vblank_wait;
+  unsigned long vblank_count; /* Vertical blanks seen since probe */
+  uint32_t fixed_start;       /* Last fixed_start given to the device */
+  struct mutex write_lock;    /* Held while the write pointer is in use */
+  uint32_t *words;            /* A frame of packed pixels from userspace */
 } dev;
 
+/*
+ * Wait until the device has finished the last blit or packed write. A blit
+ * runs on after its BLIT_START write returns, and the device would hold a
+ * pixel, packed, page flip or blit register write on the bus until it is
+ * done, so wait here instead, where a long fill can sleep
+ */
+static void wait_idle(void) {
+  int polls;
+
+  for (polls = 0; ioread32(STATUS(dev.virtbase)) & STATUS_BUSY; polls++)
+    if (polls >= IDLE_SPIN_POLLS)
+      usleep_range(IDLE_SLEEP_US, 2 * IDLE_SLEEP_US);
+}
+
 /*
  * Write segments of a single digit
  * Assumes digit is in range and the device information has been set up
  */
 static void write_background(uint32_t writedata) {
+  wait_idle();
   iowrite32(writedata, FIRST_CHUNK(dev.virtbase));
 }
 
+/*
+ * Set the scrolling region. Assumes the arguments have been range-checked
+ */
+static void write_scroll(vga_framebuffer_scroll_t *scroll) {
+  iowrite32(scroll->end_column << 10 | scroll->first_column,
+            SCROLL_COLUMNS(dev.virtbase));
+  iowrite32(scroll->fixed_start, FIXED_START(dev.virtbase));
+  iowrite32(scroll->offset, SCROLL_OFFSET(dev.virtbase));
+}
+
+/*
+ * Stream a run of packed pixels from userspace to the auto-incrementing
+ * packed pixel register: one copy from userspace and one burst of writes.
+ * Assumes count has been range-checked
+ */
+static long write_packed(uint32_t start, const uint32_t __user *words,
+                         uint32_t count) {
+  long ret = 0;
+
+  mutex_lock(&dev.write_lock);
+  if (copy_from_user(dev.words, words, count * sizeof(uint32_t))) {
+    ret = -EACCES;
+  } else {
+    wait_idle();
+    iowrite32(start, WRITE_POINTER(dev.virtbase));
+    iowrite32_rep(PACKED_PIXELS(dev.virtbase), dev.words, count);
+  }
+  mutex_unlock(&dev.write_lock);
+
+  return ret;
+}
+
+/*
+ * Load palette entries: one register write each, {index, RGB}. Assumes the
+ * range has been checked
+ */
+static long write_palette(uint32_t first, const uint32_t __user *colors,
+                          uint32_t count) {
+  uint32_t entries[VGA_FRAMEBUFFER_PALETTE_SIZE];
+  uint32_t i;
+
+  if (copy_from_user(entries, colors, count * sizeof(uint32_t)))
+    return -EACCES;
+  for (i = 0; i < count; i++)
+    iowrite32((first + i) << 24 | (entries[i] & 0xffffff),
+              PALETTE(dev.virtbase));
+  return 0;
+}
+
+/* Whether a width x height rectangle at (row, col) is on screen */
+static int on_screen(uint32_t row, uint32_t col, uint32_t width,
+                     uint32_t height) {
+  return row <= VGA_SCREEN_HEIGHT && height <= VGA_SCREEN_HEIGHT - row &&
+         col <= VGA_SCREEN_WIDTH && width <= VGA_SCREEN_WIDTH - col;
+}
+
+/*
+ * Start a list of blits, one at a time from userspace. Each is four register
+ * writes, made once the blit before is done; the last is left running
+ */
+static long write_blits(const vga_framebuffer_blit_t __user *blits,
+                        uint32_t count) {
+  vga_framebuffer_blit_t blit;
+  uint32_t i, start;
+
+  for (i = 0; i < count; i++) {
+    if (copy_from_user(&blit, &blits[i], sizeof(blit)))
+      return -EACCES;
+    if (blit.op > VGA_FRAMEBUFFER_BLIT_COPY ||
+        !on_screen(blit.row, blit.col, blit.width, blit.height) ||
+        (blit.op == VGA_FRAMEBUFFER_BLIT_COPY &&
+         !on_screen(blit.src_row, blit.src_col, blit.width, blit.height)) ||
+        blit.color >= VGA_FRAMEBUFFER_PALETTE_SIZE)
+      return -EINVAL;
+
+    wait_idle();
+    start = blit.color;
+    if (blit.op == VGA_FRAMEBUFFER_BLIT_COPY) {
+      iowrite32(VGA_FRAMEBUFFER_POINTER(blit.src_row, blit.src_col),
+                BLIT_SOURCE(dev.virtbase));
+      start |= BLIT_COPY | (blit.src_on_screen ? BLIT_SOURCE_ON_SCREEN : 0);
+    }
+    iowrite32(VGA_FRAMEBUFFER_POINTER(blit.row, blit.col),
+              BLIT_DEST(dev.virtbase));
+    iowrite32(VGA_FRAMEBUFFER_POINTER(blit.height, blit.width),
+              BLIT_SIZE(dev.virtbase));
+    iowrite32(start, BLIT_START(dev.virtbase));
+  }
+  return 0;
+}
+
+/*
+ * Request a page flip at the next vblank. Assumes the offset has been
+ * range-checked
+ */
+static void write_flip(uint32_t offset) {
+  wait_idle();
+  iowrite32(offset, PAGE_FLIP(dev.virtbase));
+}
+
+/* Count a vertical blank and wake anybody waiting for one */
+static void vblank_tick(void) {
+  WRITE_ONCE(dev.vblank_count, dev.vblank_count + 1);
+  wake_up_interruptible(&dev.vblank_wait);
+}
+
+static irqreturn_t vga_framebuffer_irq(int irq, void *dev_id) {
+  /* Acknowledge, leaving the interrupt enabled */
+  iowrite32(IRQ_ENABLE, IRQ_CONTROL(dev.virtbase));
+  vblank_tick();
+  return IRQ_HANDLED;
+}
+
+#ifdef VGA_FRAMEBUFFER_FAKE_VBLANK
+static enum hrtimer_restart vga_framebuffer_fake_vblank(struct hrtimer *timer) {
+  vblank_tick();
+  hrtimer_forward_now(timer, ns_to_ktime(VBLANK_PERIOD_NS));
+  return HRTIMER_RESTART;
+}
+#endif
+
+/*
+ * Block until the next vertical blank. Each open file remembers the last
+ * vblank it waited for so that poll() can report ones it has not seen
+ */
+static long wait_vblank(struct file *f, uint32_t *count) {
+  unsigned long seen = READ_ONCE(dev.vblank_count);
+
+  if (wait_event_interruptible(dev.vblank_wait,
+                               READ_ONCE(dev.vblank_count) != seen))
+    return -ERESTARTSYS;
+
+  seen = READ_ONCE(dev.vblank_count);
+  f->private_data = (void *)seen;
+  *count = seen;
+  return 0;
+}
+
 /*
  * Handle ioctl() calls from userspace:
  * Read or write the segments on single digits.
@@ -65,6 +277,12 @@ static void write_background(uint32_t writedata) {
 static long vga_framebuffer_ioctl(struct file *f, unsigned int cmd,
                                   unsigned long arg) {
   vga_framebuffer_arg_t vfba;
+  vga_framebuffer_scroll_t vfbs;
+  vga_framebuffer_packed_t vfbp;
+  vga_framebuffer_palette_t vfbc;
+  vga_framebuffer_blits_t vfbb;
+  uint32_t value;
+  long ret;
 
   switch (cmd) {
   case VGA_FRAMEBUFFER_UPDATE:
@@ -74,6 +292,63 @@ static long vga_framebuffer_ioctl(struct file *f, unsigned int cmd,
     write_background(vfba.pixel_writedata);
     break;
 
+  case VGA_FRAMEBUFFER_SET_SCROLL:
+    if (copy_from_user(&vfbs, (vga_framebuffer_scroll_t *)arg,
+                       sizeof(vga_framebuffer_scroll_t)))
+      return -EACCES;
+    if (vfbs.fixed_start == 0 || vfbs.fixed_start > VGA_SCREEN_HEIGHT ||
+        vfbs.offset >= vfbs.fixed_start ||
+        vfbs.first_column >= vfbs.end_column ||
+        vfbs.end_column > VGA_SCREEN_WIDTH)
+      return -EINVAL;
+    write_scroll(&vfbs);
+    dev.fixed_start = vfbs.fixed_start;
+    break;
+
+  case VGA_FRAMEBUFFER_WRITE_PACKED:
+    if (copy_from_user(&vfbp, (vga_framebuffer_packed_t *)arg,
+                       sizeof(vga_framebuffer_packed_t)))
+      return -EACCES;
+    if (vfbp.count > FRAME_WORDS)
+      return -EINVAL;
+    return write_packed(vfbp.start, (const uint32_t __user *)vfbp.words,
+                        vfbp.count);
+
+  case VGA_FRAMEBUFFER_FLIP:
+    if (copy_from_user(&value, (uint32_t *)arg, sizeof(uint32_t)))
+      return -EACCES;
+    if (value >= dev.fixed_start)
+      return -EINVAL;
+    write_flip(value);
+    break;
+
+  case VGA_FRAMEBUFFER_SET_PALETTE:
+    if (copy_from_user(&vfbc, (vga_framebuffer_palette_t *)arg,
+                       sizeof(vga_framebuffer_palette_t)))
+      return -EACCES;
+    if (vfbc.first >= VGA_FRAMEBUFFER_PALETTE_SIZE ||
+        vfbc.count > VGA_FRAMEBUFFER_PALETTE_SIZE - vfbc.first)
+      return -EINVAL;
+    return write_palette(vfbc.first, (const uint32_t __user *)vfbc.colors,
+                         vfbc.count);
+
+  case VGA_FRAMEBUFFER_BLIT:
+    if (copy_from_user(&vfbb, (vga_framebuffer_blits_t *)arg,
+                       sizeof(vga_framebuffer_blits_t)))
+      return -EACCES;
+    if (vfbb.count > VGA_FRAMEBUFFER_MAX_BLITS)
+      return -EINVAL;
+    return write_blits((const vga_framebuffer_blit_t __user *)vfbb.blits,
+                       vfbb.count);
+
+  case VGA_FRAMEBUFFER_WAIT_VBLANK:
+    ret = wait_vblank(f, &value);
+    if (ret)
+      return ret;
+    if (copy_to_user((uint32_t *)arg, &value, sizeof(uint32_t)))
+      return -EACCES;
+    break;
+
   default:
     return -EINVAL;
   }
@@ -81,9 +356,73 @@ static long vga_framebuffer_ioctl(struct file *f, unsigned int cmd,
   return 0;
 }
 
+/*
+ * Handle write() calls from userspace: packed pixels at the file position,
+ * laid out as described in vga_framebuffer.h
+ */
+static ssize_t vga_framebuffer_write(struct file *f, const char __user *buf,
+                                     size_t count, loff_t *ppos) {
+  loff_t pos = *ppos;
+  uint32_t word, start;
+  long ret;
+
+  if (pos < 0 || pos % 4 || count % 4)
+    return -EINVAL;
+  if (pos >= VGA_FRAMEBUFFER_FRAME_BYTES)
+    return count ? -ENOSPC : 0;
+  count = min_t(size_t, count, VGA_FRAMEBUFFER_FRAME_BYTES - pos);
+  if (count == 0)
+    return 0;
+
+  word = pos / 4;
+  start = VGA_FRAMEBUFFER_POINTER(
+      word / (VGA_SCREEN_WIDTH / PIXELS_PER_WORD),
+      word % (VGA_SCREEN_WIDTH / PIXELS_PER_WORD) * PIXELS_PER_WORD);
+
+  ret = write_packed(start, (const uint32_t __user *)buf, count / 4);
+  if (ret)
+    return ret;
+
+  *ppos = pos + count;
+  return count;
+}
+
+static loff_t vga_framebuffer_llseek(struct file *f, loff_t offset,
+                                     int whence) {
+  return fixed_size_llseek(f, offset, whence, VGA_FRAMEBUFFER_FRAME_BYTES);
+}
+
+static int vga_framebuffer_open(struct inode *inode, struct file *f) {
+  f->private_data = (void *)READ_ONCE(dev.vblank_count);
+  return 0;
+}
+
+/*
+ * A file that wrote a whole frame in order has nothing else to show it,
+ * so show it unscrolled
+ */
+static int vga_framebuffer_release(struct inode *inode, struct file *f) {
+  if (f->f_pos == VGA_FRAMEBUFFER_FRAME_BYTES)
+    write_flip(0);
+  return 0;
+}
+
+/* Readable once a vblank has happened that this file has not waited for */
+static __poll_t vga_framebuffer_poll(struct file *f, poll_table *wait) {
+  poll_wait(f, &dev.vblank_wait, wait);
+  if (READ_ONCE(dev.vblank_count) != (unsigned long)f->private_data)
+    return POLLIN | POLLRDNORM;
+  return 0;
+}
+
 /* The operations our device knows how to do */
 static const struct file_operations vga_framebuffer_fops = {
     .owner = THIS_MODULE,
+    .open = vga_framebuffer_open,
+    .release = vga_framebuffer_release,
+    .llseek = vga_framebuffer_llseek,
+    .write = vga_framebuffer_write,
+    .poll = vga_framebuffer_poll,
     .unlocked_ioctl = vga_framebuffer_ioctl,
 };
 
@@ -101,22 +440,15 @@ static struct miscdevice vga_framebuffer_misc_device = {
 static int __init vga_framebuffer_probe(struct platform_device *pdev) {
   int ret;
 
-  /* Register ourselves as a misc device: creates /dev/vga_framebuffer */
-  ret = misc_register(&vga_framebuffer_misc_device);
-
   /* Get the address of our registers from the device tree */
   ret = of_address_to_resource(pdev->dev.of_node, 0, &dev.res);
-  if (ret) {
-    ret = -ENOENT;
-    goto out_deregister;
-  }
+  if (ret)
+    return -ENOENT;
 
   /* Make sure we can use these registers */
   if (request_mem_region(dev.res.start, resource_size(&dev.res), DRIVER_NAME) ==
-      NULL) {
-    ret = -EBUSY;
-    goto out_deregister;
-  }
+      NULL)
+    return -EBUSY;
 
   /* Arrange access to our registers */
   dev.virtbase = of_iomap(pdev->dev.of_node, 0);
@@ -125,20 +457,84 @@ static int __init vga_framebuffer_probe(struct platform_device *pdev) {
     goto out_release_mem_region;
   }
 
+  init_waitqueue_head(&dev.vblank_wait);
+  mutex_init(&dev.write_lock);
+  dev.fixed_start = VGA_SCREEN_HEIGHT;
+
+  /* A whole 640x480 frame is too big to count on kmalloc() for */
+  dev.words = kvmalloc(VGA_FRAMEBUFFER_FRAME_BYTES, GFP_KERNEL);
+  if (dev.words == NULL) {
+    ret = -ENOMEM;
+    goto out_iounmap;
+  }
+
+  /*
+   * WAIT_VBLANK promises the flip has been latched, and only the vblank
+   * interrupt (raised on VGA_VS) can keep that promise
+   */
+  dev.irq = irq_of_parse_and_map(pdev->dev.of_node, 0);
+  if (dev.irq) {
+    ret = request_irq(dev.irq, vga_framebuffer_irq, 0, DRIVER_NAME, &dev);
+    if (ret)
+      goto out_free_words;
+    iowrite32(IRQ_ENABLE, IRQ_CONTROL(dev.virtbase));
+  } else {
+#ifdef VGA_FRAMEBUFFER_FAKE_VBLANK
+    pr_warn(DRIVER_NAME ": no interrupt, faking vblank with a timer\n");
+    hrtimer_init(&dev.fake_vblank, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev.fake_vblank.function = vga_framebuffer_fake_vblank;
+    hrtimer_start(&dev.fake_vblank, ns_to_ktime(VBLANK_PERIOD_NS),
+                  HRTIMER_MODE_REL);
+#else
+    pr_err(DRIVER_NAME ": no vblank interrupt in the device tree\n");
+    ret = -ENXIO;
+    goto out_free_words;
+#endif
+  }
+
+  /*
+   * Register ourselves as a misc device: creates /dev/vga_framebuffer. Last,
+   * so that open() and write() only ever see a device that is ready
+   */
+  ret = misc_register(&vga_framebuffer_misc_device);
+  if (ret)
+    goto out_stop_vblank;
+
   return 0;
 
+out_stop_vblank:
+  if (dev.irq) {
+    iowrite32(0, IRQ_CONTROL(dev.virtbase));
+    free_irq(dev.irq, &dev);
+  }
+#ifdef VGA_FRAMEBUFFER_FAKE_VBLANK
+  if (!dev.irq)
+    hrtimer_cancel(&dev.fake_vblank);
+#endif
+out_free_words:
+  kvfree(dev.words);
+out_iounmap:
+  iounmap(dev.virtbase);
 out_release_mem_region:
   release_mem_region(dev.res.start, resource_size(&dev.res));
-out_deregister:
-  misc_deregister(&vga_framebuffer_misc_device);
   return ret;
 }
 
 /* Clean-up code: release resources */
 static int vga_framebuffer_remove(struct platform_device *pdev) {
+  /* Gone from /dev first, so nothing new can open it while we tear down */
+  misc_deregister(&vga_framebuffer_misc_device);
+  if (dev.irq) {
+    iowrite32(0, IRQ_CONTROL(dev.virtbase));
+    free_irq(dev.irq, &dev);
+  }
+#ifdef VGA_FRAMEBUFFER_FAKE_VBLANK
+  if (!dev.irq)
+    hrtimer_cancel(&dev.fake_vblank);
+#endif
+  kvfree(dev.words);
   iounmap(dev.virtbase);
   release_mem_region(dev.res.start, resource_size(&dev.res));
-  misc_deregister(&vga_framebuffer_misc_device);
   return 0;
 }
 
@@ -1,6 +1,8 @@
 #ifndef _VGA_FRAMEBUFFER_H
 #define _VGA_FRAMEBUFFER_H
 
+#include "global_consts.h"
+#include "helpers.h"
 #include <linux/ioctl.h>
 #ifdef __KERNEL__
 #include <linux/io.h>
@@ -12,10 +14,115 @@ typedef struct {
   uint32_t pixel_writedata;
 } vga_framebuffer_arg_t;
 
+// Scrolling region setup. In columns first_column up to end_column, screen
+// row y < fixed_start shows buffer row (y + offset) % fixed_start; rows >=
+// fixed_start and the other columns never scroll.
+typedef struct {
+  uint32_t offset;
+  uint32_t fixed_start;
+  uint32_t first_column;
+  uint32_t end_column;
+} vga_framebuffer_scroll_t;
+
+// The peripheral's registers (vga_framebuffer.sv), by word address. The
+// driver, the co-simulation harness and the testbenches all use these
+#define VGA_FRAMEBUFFER_REG_PIXEL 0
+#define VGA_FRAMEBUFFER_REG_SCROLL_OFFSET 1
+#define VGA_FRAMEBUFFER_REG_FIXED_START 2
+#define VGA_FRAMEBUFFER_REG_WRITE_POINTER 3
+#define VGA_FRAMEBUFFER_REG_PACKED_PIXELS 4
+#define VGA_FRAMEBUFFER_REG_PAGE_FLIP 5
+#define VGA_FRAMEBUFFER_REG_IRQ_CONTROL 6
+#define VGA_FRAMEBUFFER_REG_SCROLL_COLUMNS 7
+#define VGA_FRAMEBUFFER_REG_PALETTE 8
+#define VGA_FRAMEBUFFER_REG_BLIT_DEST 9
+#define VGA_FRAMEBUFFER_REG_BLIT_SIZE 10
+#define VGA_FRAMEBUFFER_REG_BLIT_SOURCE 11
+#define VGA_FRAMEBUFFER_REG_BLIT_START 12
+#define VGA_FRAMEBUFFER_REG_STATUS 13 // Read only
+
+// Blit start: a copy rather than a fill, and from the page on screen
+#define VGA_FRAMEBUFFER_START_COPY 0x80000000
+#define VGA_FRAMEBUFFER_START_SOURCE_ON_SCREEN 0x40000000
+// Irq control: raise irq at each vertical sync
+#define VGA_FRAMEBUFFER_IRQ_ENABLE 1
+// Status: a blit or packed pixels are still being written
+#define VGA_FRAMEBUFFER_STATUS_BUSY 1
+
+// The device's write pointer, and pixel writes, take {row, column} like this
+#define VGA_FRAMEBUFFER_POINTER(row, col) ((uint32_t)(row) << 16 | (col) << 6)
+
+// A run of packed pixels, PIXELS_PER_WORD to a word, written starting at
+// start (a VGA_FRAMEBUFFER_POINTER()). The device
+// advances across the visible columns of each row and wraps after the last
+// row.
+typedef struct {
+  uint32_t start;
+  uint32_t count; // Number of words
+  const uint32_t *words;
+} vga_framebuffer_packed_t;
+
+// Palette entries first up to first + count, each 0xRRGGBB. Pixels hold
+// color indices into the palette, so a new entry recolors every pixel of its
+// index from the next one scanned out
+#define VGA_FRAMEBUFFER_PALETTE_SIZE 64
+typedef struct {
+  uint32_t first;
+  uint32_t count;
+  const uint32_t *colors;
+} vga_framebuffer_palette_t;
+
+// One blitter command, on the page being drawn. A fill sets the width x
+// height rectangle at (row, col) to a color index; a copy moves the same
+// rectangle there from (src_row, src_col), on the page being drawn or, with
+// src_on_screen, the one on screen. Rectangles must be on screen
+#define VGA_FRAMEBUFFER_BLIT_FILL 0
+#define VGA_FRAMEBUFFER_BLIT_COPY 1
+typedef struct {
+  uint32_t op;
+  uint32_t row, col, width, height;
+  uint32_t src_row, src_col, src_on_screen; // Copies only
+  uint32_t color;                           // Fills only
+} vga_framebuffer_blit_t;
+
+// A list of blits, carried out in order
+#define VGA_FRAMEBUFFER_MAX_BLITS 64
+typedef struct {
+  uint32_t count;
+  const vga_framebuffer_blit_t *blits;
+} vga_framebuffer_blits_t;
+
+// write() takes packed pixels laid out row after row, PIXELS_PER_WORD to a
+// word; the file position is the byte offset into that layout. A whole frame
+// is one write() of VGA_FRAMEBUFFER_FRAME_BYTES at offset 0, a range of rows
+// one pwrite() at the offset of its first row. Like the ioctls, this draws
+// on the page not on screen. Closing a file that was written through to the
+// end of the frame (cat frame.bin > /dev/vga_framebuffer) flips to it.
+#define VGA_FRAMEBUFFER_ROW_BYTES (VGA_SCREEN_WIDTH / PIXELS_PER_WORD * 4)
+#define VGA_FRAMEBUFFER_FRAME_BYTES                                            \
+  (VGA_FRAMEBUFFER_ROW_BYTES * VGA_SCREEN_HEIGHT)
+#define VGA_FRAMEBUFFER_OFFSET(row, col)                                       \
+  ((row) * VGA_FRAMEBUFFER_ROW_BYTES + (col) / PIXELS_PER_WORD * 4)
+
 #define VGA_FRAMEBUFFER_MAGIC 'q'
 
 /* ioctls and their arguments */
 #define VGA_FRAMEBUFFER_UPDATE                                                 \
   _IOW(VGA_FRAMEBUFFER_MAGIC, 1, vga_framebuffer_arg_t *)
+#define VGA_FRAMEBUFFER_SET_SCROLL                                             \
+  _IOW(VGA_FRAMEBUFFER_MAGIC, 2, vga_framebuffer_scroll_t *)
+#define VGA_FRAMEBUFFER_WRITE_PACKED                                           \
+  _IOW(VGA_FRAMEBUFFER_MAGIC, 3, vga_framebuffer_packed_t *)
+// Show the page that has been written to since the last flip, scrolled by
+// the given offset, starting at the next vblank. Writes go to the other page
+// from then on, so wait for that vblank before drawing the next frame.
+#define VGA_FRAMEBUFFER_FLIP _IOW(VGA_FRAMEBUFFER_MAGIC, 4, uint32_t *)
+// Block until the next vblank, which is when a requested flip takes effect;
+// gives back the number of vblanks so far. Needs the vblank interrupt
+#define VGA_FRAMEBUFFER_WAIT_VBLANK _IOR(VGA_FRAMEBUFFER_MAGIC, 5, uint32_t *)
+#define VGA_FRAMEBUFFER_SET_PALETTE                                            \
+  _IOW(VGA_FRAMEBUFFER_MAGIC, 6, vga_framebuffer_palette_t *)
+#define VGA_FRAMEBUFFER_BLIT                                                   \
+  _IOW(VGA_FRAMEBUFFER_MAGIC, 7, vga_framebuffer_blits_t *)
 
 #endif
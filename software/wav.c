@@ -0,0 +1,160 @@
+#include "wav.h"
+#include <string.h>
+
+// WAV headers and samples are little-endian, like the ARM and x86 hosts we
+// run on, so samples go straight between the file and memory
+
+#define WAV_FORMAT_PCM 1
+#define WAV_HEADER_BYTES 44
+
+static uint32_t read_le32(const unsigned char *bytes) {
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint16_t read_le16(const unsigned char *bytes) {
+  return bytes[0] | bytes[1] << 8;
+}
+
+static void write_le32(unsigned char *bytes, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    bytes[i] = value >> (8 * i);
+}
+
+static void write_le16(unsigned char *bytes, uint16_t value) {
+  bytes[0] = value;
+  bytes[1] = value >> 8;
+}
+
+int wav_open(wav_file *wav, const char *path) {
+  unsigned char header[12], chunk[8], format[16];
+  int have_format = 0;
+
+  memset(wav, 0, sizeof(*wav));
+  if ((wav->file = fopen(path, "rb")) == NULL) {
+    perror("could not open song audio");
+    return 1;
+  }
+
+  if (fread(header, 1, sizeof(header), wav->file) != sizeof(header) ||
+      memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+    fprintf(stderr, "%s is not a WAV file\n", path);
+    goto fail;
+  }
+
+  // Walk the chunks until the samples, picking up the format on the way
+  while (fread(chunk, 1, sizeof(chunk), wav->file) == sizeof(chunk)) {
+    uint32_t size = read_le32(chunk + 4);
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && size >= sizeof(format)) {
+      if (fread(format, 1, sizeof(format), wav->file) != sizeof(format))
+        break;
+      if (read_le16(format) != WAV_FORMAT_PCM || read_le16(format + 14) != 16) {
+        fprintf(stderr, "%s is not 16-bit PCM\n", path);
+        goto fail;
+      }
+      wav->channels = read_le16(format + 2);
+      wav->rate = read_le32(format + 4);
+      have_format = 1;
+      size -= sizeof(format);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (!have_format || wav->channels == 0)
+        break;
+      wav->frames = size / (wav->channels * sizeof(int16_t));
+      wav->data_start = ftell(wav->file);
+      return 0;
+    }
+
+    // Chunks are padded to an even length
+    if (fseek(wav->file, size + (size & 1), SEEK_CUR))
+      break;
+  }
+
+  fprintf(stderr, "%s has no audio\n", path);
+fail:
+  fclose(wav->file);
+  wav->file = NULL;
+  return 1;
+}
+
+int wav_read(wav_file *wav, int16_t *samples, int frames) {
+  if (frames > wav->frames - wav->done)
+    frames = wav->frames - wav->done;
+
+  size_t got = fread(samples, wav->channels * sizeof(int16_t), frames,
+                     wav->file);
+  if (got < (size_t)frames && ferror(wav->file)) {
+    perror("could not read song audio");
+    return -1;
+  }
+
+  wav->done += got;
+  return got;
+}
+
+static void fill_header(wav_file *wav, unsigned char *header) {
+  uint32_t data_bytes = wav->done * wav->channels * sizeof(int16_t);
+
+  memcpy(header, "RIFF", 4);
+  write_le32(header + 4, WAV_HEADER_BYTES - 8 + data_bytes);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  write_le32(header + 16, 16);
+  write_le16(header + 20, WAV_FORMAT_PCM);
+  write_le16(header + 22, wav->channels);
+  write_le32(header + 24, wav->rate);
+  write_le32(header + 28, wav->rate * wav->channels * sizeof(int16_t));
+  write_le16(header + 32, wav->channels * sizeof(int16_t));
+  write_le16(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  write_le32(header + 40, data_bytes);
+}
+
+int wav_create(wav_file *wav, const char *path, int rate, int channels) {
+  unsigned char header[WAV_HEADER_BYTES];
+
+  memset(wav, 0, sizeof(*wav));
+  wav->rate = rate;
+  wav->channels = channels;
+  wav->data_start = WAV_HEADER_BYTES;
+
+  if ((wav->file = fopen(path, "wb")) == NULL) {
+    perror("could not create audio file");
+    return 1;
+  }
+
+  // The sizes are filled in once we know them
+  fill_header(wav, header);
+  if (fwrite(header, 1, sizeof(header), wav->file) != sizeof(header)) {
+    perror("could not write audio file");
+    fclose(wav->file);
+    wav->file = NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+int wav_write(wav_file *wav, const int16_t *samples, int frames) {
+  size_t put = fwrite(samples, wav->channels * sizeof(int16_t), frames,
+                      wav->file);
+
+  wav->done += put;
+  wav->frames = wav->done;
+  return put == (size_t)frames ? 0 : -1;
+}
+
+void wav_close(wav_file *wav, int writing) {
+  unsigned char header[WAV_HEADER_BYTES];
+
+  if (wav->file == NULL)
+    return;
+
+  if (writing) {
+    fill_header(wav, header);
+    if (fseek(wav->file, 0, SEEK_SET) ||
+        fwrite(header, 1, sizeof(header), wav->file) != sizeof(header))
+      perror("could not finish audio file");
+  }
+
+  fclose(wav->file);
+  wav->file = NULL;
+}
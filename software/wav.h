@@ -0,0 +1,31 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// A 16-bit PCM WAV file being streamed in or out
+typedef struct {
+  FILE *file;
+  int rate;          // Frames per second
+  int channels;      // Samples per frame, interleaved
+  long long frames;  // Frames of audio in the file
+  long long done;    // Frames read or written so far
+  long data_start;   // File offset of the first sample
+} wav_file;
+
+// Opens a WAV for reading; returns 0 on success. Only 16-bit PCM is
+// supported
+int wav_open(wav_file *wav, const char *path);
+// Reads up to frames frames; returns how many were read, 0 at the end of the
+// audio, or -1 on error
+int wav_read(wav_file *wav, int16_t *samples, int frames);
+
+// Creates a WAV for writing; returns 0 on success
+int wav_create(wav_file *wav, const char *path, int rate, int channels);
+int wav_write(wav_file *wav, const int16_t *samples, int frames);
+
+// Closes the file, filling in the header's sizes if it was being written
+void wav_close(wav_file *wav, int writing);
+
+#endif /* WAV_H */